@@ -0,0 +1,179 @@
+/*
+* Copyright 2009, KyTea Development Team
+* 
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+* 
+*     http://www.apache.org/licenses/LICENSE-2.0
+* 
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <kytea/kytea-config.h>
+#include <kytea/kytea.h>
+#include <kytea/corpus-io.h>
+
+using namespace std;
+using namespace kytea;
+
+void usage() {
+    cerr << 
+"kytea-prune:" << endl << 
+"  Remove the least important features from a KyTea model" << endl <<
+"" << endl <<
+"Options: " << endl <<
+"  -model   The model to prune" << endl <<
+"  -out     The file to write the pruned model to" << endl <<
+"  -feats   Keep at most this many feature entries" << endl <<
+"  -size    Make the model file at most this many bytes" << endl <<
+"  -cutoff  Remove entries where no weight is larger than this value" << endl <<
+"  -test    A fully annotated corpus to report the accuracy on" << endl <<
+"  -modtext Write the pruned model in text format" << endl;
+    exit(1);
+}
+
+// read a model, and prune it if cutoff is not negative
+Kytea * readPruned(const string & file, double cutoff, bool modText) {
+    KyteaConfig * config = new KyteaConfig;
+    config->setDebug(0);
+    config->setOnTraining(false);
+    Kytea * kytea = new Kytea(config);
+    kytea->readModel(file.c_str());
+    config->setModelFormat(modText ? 'T' : 'B');
+    if(cutoff >= 0)
+        kytea->pruneFeatures(cutoff);
+    return kytea;
+}
+
+// write a model and return the size of the file
+long writeModel(Kytea & kytea, const string & file) {
+    kytea.writeModel(file.c_str());
+    ifstream ifs(file.c_str(), ios::binary | ios::ate);
+    return ifs.tellg();
+}
+
+// report the word segmentation F-measure and tagging accuracy on a corpus
+void reportAccuracy(Kytea & kytea, const string & file, const char * name) {
+    KyteaConfig * config = kytea.getConfig();
+    StringUtil * util = kytea.getStringUtil();
+    CorpusIO * in = CorpusIO::createIO(file.c_str(), CORP_FORMAT_FULL, *config, false, util);
+    const int numTags = config->getNumTags();
+    unsigned ref = 0, sys = 0, correct = 0;
+    vector<unsigned> tagCorrect(numTags, 0);
+    KyteaSentence * next;
+    while((next = in->readSentence()) != 0) {
+        KyteaSentence sent(next->chars);
+        kytea.analyzeSentence(sent);
+        // match the words by their start and end
+        unsigned i = 0, j = 0, refPos = 0, sysPos = 0;
+        while(i < next->words.size() && j < sent.words.size()) {
+            const KyteaWord & refWord = next->words[i], & sysWord = sent.words[j];
+            const unsigned refEnd = refPos+refWord.surf.length(), sysEnd = sysPos+sysWord.surf.length();
+            if(refPos == sysPos && refEnd == sysEnd) {
+                correct++;
+                for(int k = 0; k < numTags; k++)
+                    if(refWord.hasTag(k) && sysWord.hasTag(k) && refWord.getTagSurf(k) == sysWord.getTagSurf(k))
+                        tagCorrect[k]++;
+            }
+            if(refEnd <= sysEnd) { refPos = refEnd; i++; }
+            if(sysEnd <= refEnd) { sysPos = sysEnd; j++; }
+        }
+        ref += next->words.size();
+        sys += sent.words.size();
+        delete next;
+    }
+    delete in;
+    double prec = (sys ? (double)correct/sys : 0), rec = (ref ? (double)correct/ref : 0);
+    cout << name << ": WS F-measure=" << (prec+rec > 0 ? 2*prec*rec/(prec+rec) : 0);
+    for(int k = 0; k < numTags; k++)
+        cout << ", tag " << k+1 << " accuracy=" << (ref ? (double)tagCorrect[k]/ref : 0);
+    cout << endl;
+}
+
+// prunes a KyTea model to a target number of features or file size
+int main(int argv, const char **argc) {
+
+#ifndef KYTEA_SAFE
+    try {
+#endif
+        string model, out, test;
+        long feats = -1, size = -1;
+        double cutoff = -1;
+        bool modText = false;
+        for(int i = 1; i < argv; i++) {
+            if(!strcmp(argc[i], "-modtext")) { modText = true; continue; }
+            if(i+1 == argv) usage();
+            if(!strcmp(argc[i], "-model"))       model = argc[++i];
+            else if(!strcmp(argc[i], "-out"))    out = argc[++i];
+            else if(!strcmp(argc[i], "-test"))   test = argc[++i];
+            else if(!strcmp(argc[i], "-feats"))  feats = atol(argc[++i]);
+            else if(!strcmp(argc[i], "-size"))   size = atol(argc[++i]);
+            else if(!strcmp(argc[i], "-cutoff")) cutoff = atof(argc[++i]);
+            else usage();
+        }
+        if(model.length() == 0 || out.length() == 0 || (feats < 0 && size < 0 && cutoff < 0))
+            usage();
+
+        // find the weights of every entry, from least to most important
+        Kytea * orig = readPruned(model, -1, modText);
+        vector<double> weights;
+        orig->getFeatureWeights(weights);
+        sort(weights.begin(), weights.end());
+        const long total = weights.size();
+        if(test.length() > 0)
+            reportAccuracy(*orig, test, "Original");
+        delete orig;
+
+        // find the number of entries to remove
+        long remove = 0;
+        if(cutoff >= 0)
+            remove = upper_bound(weights.begin(), weights.end(), cutoff) - weights.begin();
+        if(feats >= 0)
+            remove = max(remove, total-feats);
+        if(size >= 0) {
+            // binary search for the fewest removed entries that fit in the size
+            long low = remove, high = total;
+            while(low < high) {
+                long mid = (low+high)/2;
+                Kytea * pruned = readPruned(model, (mid ? weights[mid-1] : -1), modText);
+                long mySize = writeModel(*pruned, out);
+                delete pruned;
+                if(mySize <= size)
+                    high = mid;
+                else
+                    low = mid+1;
+            }
+            remove = low;
+        }
+
+        // prune and write the model
+        Kytea * pruned = readPruned(model, (remove ? weights[remove-1] : -1), modText);
+        long mySize = writeModel(*pruned, out);
+        vector<double> left;
+        pruned->getFeatureWeights(left);
+        cout << "Kept " << left.size() << " of " << total << " feature entries, model size " << mySize << " bytes" << endl;
+        if(size >= 0 && mySize > size)
+            cerr << "WARNING: the model could not be pruned to " << size << " bytes" << endl;
+        if(test.length() > 0)
+            reportAccuracy(*pruned, test, "Pruned");
+        delete pruned;
+        return 0;
+#ifndef KYTEA_SAFE
+    } catch (exception &e) {
+        cerr << endl;
+        cerr << " KyTea Error: " << e.what() << endl;
+        return 1;
+    }
+#endif
+
+}
@@ -0,0 +1,151 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <kytea/config.h>
+#include <kytea/kytea-config.h>
+#include <kytea/kytea.h>
+#include <kytea/model-handle.h>
+#include <kytea/kytea-server.h>
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+using namespace std;
+using namespace kytea;
+
+void usage() {
+    cerr <<
+"kytea-server:" << endl <<
+"  Keep a KyTea model in memory and analyze requests from local clients" << endl <<
+"" << endl <<
+"Options: " << endl <<
+"  -socket   The Unix domain socket to listen on" << endl <<
+"  -port     The localhost TCP port to listen on (instead of -socket)" << endl <<
+"  -threads  The number of threads analyzing requests (default 4)" << endl <<
+"  -batch    The most requests that are analyzed together (default 16)" << endl <<
+"  -deadline The longest time in milliseconds to wait for a batch (default 2)" << endl <<
+"  -queue    The most requests waiting to be analyzed (default 256)" << endl <<
+"" << endl <<
+"  Other options (-model, -notags, -out, -overlay, ...) are the same as kytea," << endl <<
+"  and are the defaults for each request. Sending SIGHUP reads the model again," << endl <<
+"  and SIGINT or SIGTERM stops the server." << endl;
+    exit(1);
+}
+
+// read the model with the options of kytea
+void loadModel(ModelHandle & handle, const vector<const char*> & args) {
+    KyteaConfig * config = new KyteaConfig;
+    config->setDebug(0);
+    config->setOnTraining(false);
+    config->parseRunCommandLine(args.size(), const_cast<const char**>(&args[0]));
+    handle.loadModel(config->getModelFile(), config);
+}
+
+#if HAVE_PTHREAD_H
+struct SignalArgs {
+    KyteaServer * server;
+    ModelHandle * handle;
+    vector<const char*> * args;
+    sigset_t * signals;
+};
+
+// reload the model on SIGHUP, and stop the server on other signals
+void * handleSignals(void * arg) {
+    SignalArgs * sa = (SignalArgs*)arg;
+    int sig;
+    while(sigwait(sa->signals, &sig) == 0) {
+        if(sig != SIGHUP) {
+            sa->server->stop();
+            break;
+        }
+        try {
+            loadModel(*sa->handle, *sa->args);
+            cerr << "Reloaded the model (generation " << sa->handle->getGeneration() << ")" << endl;
+        } catch (exception &e) {
+            cerr << "Could not reload the model, still using the old one: " << e.what() << endl;
+        }
+    }
+    return 0;
+}
+#endif
+
+// serves analysis requests from a model that is read once
+int main(int argv, const char **argc) {
+
+#ifndef KYTEA_SAFE
+    try {
+#endif
+        string socketFile;
+        int port = 0, threads = 4, batch = 16, deadline = 2, queue = 256;
+        vector<const char*> args(1, argc[0]);
+        for(int i = 1; i < argv; i++) {
+            if(!strcmp(argc[i], "-socket") || !strcmp(argc[i], "-port") ||
+               !strcmp(argc[i], "-threads") || !strcmp(argc[i], "-batch") ||
+               !strcmp(argc[i], "-deadline") || !strcmp(argc[i], "-queue")) {
+                if(i+1 == argv) usage();
+                const char * v = argc[++i];
+                if(!strcmp(argc[i-1], "-socket")) socketFile = v;
+                else if(!strcmp(argc[i-1], "-port")) {
+                    port = atoi(v);
+                    if(port <= 0) usage();
+                }
+                else if(!strcmp(argc[i-1], "-threads")) threads = atoi(v);
+                else if(!strcmp(argc[i-1], "-batch"))   batch = atoi(v);
+                else if(!strcmp(argc[i-1], "-deadline")) deadline = atoi(v);
+                else queue = atoi(v);
+            } else
+                args.push_back(argc[i]);
+        }
+        // exactly one of -socket and -port must be given
+        if((socketFile.length() == 0) == (port == 0))
+            usage();
+
+        ModelHandle handle;
+        loadModel(handle, args);
+        KyteaServer server(handle, threads, batch, deadline, queue);
+        if(port) server.listenPort(port);
+        else server.listenSocket(socketFile);
+#if HAVE_PTHREAD_H
+        // handle signals in their own thread, so block them everywhere else
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGHUP);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+        SignalArgs sa = { &server, &handle, &args, &signals };
+        pthread_t signalThread;
+        pthread_create(&signalThread, NULL, handleSignals, &sa);
+        pthread_detach(signalThread);
+#endif
+        if(port) cerr << "Listening on port " << port << endl;
+        else cerr << "Listening on " << socketFile << endl;
+        server.serve();
+        return 0;
+#ifndef KYTEA_SAFE
+    } catch (exception &e) {
+        cerr << endl;
+        cerr << " KyTea Error: " << e.what() << endl;
+        return 1;
+    }
+#endif
+
+}
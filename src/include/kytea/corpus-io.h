@@ -24,6 +24,7 @@ const static char CORP_FORMAT_FULL = 1;
 const static char CORP_FORMAT_PART = 2;
 const static char CORP_FORMAT_PROB = 3;
 const static char CORP_FORMAT_DEFAULT = 4;
+const static char CORP_FORMAT_OFFSET = 5;
 }
 
 #include "general-io.h"
@@ -105,6 +106,16 @@ public:
     KyteaSentence * readSentence();
     void writeSentence(const KyteaSentence * sent, double conf = 0.0);
 
+    // Write the words of a sentence from firstWord, after a word boundary if
+    //  they continue words that were already written, and finish the line
+    //  if lineEnd is set
+    void writeWords(const KyteaSentence * sent, unsigned firstWord, bool continued, bool lineEnd);
+
+    // Write a sentence without tags straight from its characters, with a
+    //  boundary where wsConfs is above conf. If unknown is not null, it
+    //  says which words are unknown
+    void writeBoundaries(const KyteaSentence * sent, double conf, const std::vector<char> * unknown);
+
 };
 
 class PartCorpusIO : public CorpusIO {
@@ -178,17 +189,46 @@ public:
 
 };
 
+// Output of the byte range of each word in the raw input line, followed by
+// its tags, such as "0-6/名詞/がくしゅう"
+class OffsetCorpusIO : public CorpusIO {
+
+protected:
+
+    std::string wordBound_, tagBound_;
+
+public:
+    OffsetCorpusIO(StringUtil * util, const char* file, bool out, const std::string & wordBound = " ", const std::string & tagBound = "/") : CorpusIO(util,file,out), wordBound_(wordBound), tagBound_(tagBound) { }
+    OffsetCorpusIO(StringUtil * util, std::iostream & str, bool out, const std::string & wordBound = " ", const std::string & tagBound = "/") : CorpusIO(util,str,out), wordBound_(wordBound), tagBound_(tagBound) { }
+
+    KyteaSentence * readSentence();
+    void writeSentence(const KyteaSentence * sent, double conf = 0.0);
+
+};
+
 class RawCorpusIO : public CorpusIO {
 
+protected:
+
+    // the bytes of an incomplete character at the end of the last part,
+    // and whether the last part was in the middle of a line
+    std::string partRest_;
+    bool inLine_;
+
 public:
-    RawCorpusIO(StringUtil * util) : CorpusIO(util) { }
-    RawCorpusIO(const CorpusIO & c) : CorpusIO(c) { }
-    RawCorpusIO(StringUtil * util, const char* file, bool out) : CorpusIO(util,file,out) { } 
-    RawCorpusIO(StringUtil * util, std::iostream & str, bool out) : CorpusIO(util,str,out) { }
+    RawCorpusIO(StringUtil * util) : CorpusIO(util), partRest_(), inLine_(false) { }
+    RawCorpusIO(const CorpusIO & c) : CorpusIO(c), partRest_(), inLine_(false) { }
+    RawCorpusIO(StringUtil * util, const char* file, bool out) : CorpusIO(util,file,out), partRest_(), inLine_(false) { } 
+    RawCorpusIO(StringUtil * util, std::iostream & str, bool out) : CorpusIO(util,str,out), partRest_(), inLine_(false) { }
 
     KyteaSentence * readSentence();
     void writeSentence(const KyteaSentence * sent, double conf = 0.0);
 
+    // Read the next part of a line, up to maxBytes more bytes of it that end
+    //  on a character boundary. lineEnd is set if the part ends its line,
+    //  and 0 is returned at the end of the input
+    KyteaSentence * readSentencePart(unsigned maxBytes, bool & lineEnd);
+
 };
 
 
@@ -20,7 +20,6 @@
 #include "kytea/kytea-string.h"
 #include "kytea/kytea-model.h"
 #include <map>
-#include <deque>
 
 namespace kytea  {
 
@@ -98,35 +97,40 @@ public:
 
 };
 
+// flags for each state of a dictionary
+#define DICTIONARY_BRANCH 1
+#define DICTIONARY_DENSE 2
+// states with more gotos than this are given a dense table
+#define DICTIONARY_DENSE_GOTOS 256
+// the number of characters on each page of a dense table
+#define DICTIONARY_PAGE_BITS 8
+#define DICTIONARY_PAGE_SIZE (1 << DICTIONARY_PAGE_BITS)
+#define DICTIONARY_NUM_PAGES ((1 << (8*sizeof(KyteaChar))) / DICTIONARY_PAGE_SIZE)
+// the number of chunks that the words are split into when building an
+// index, and the number of words needed to build the chunks in parallel
+#define DICTIONARY_BUILD_CHUNKS 64
+#define DICTIONARY_PARALLEL_WORDS 100000
+
+// A state of the trie while the index is built, with its parent, the
+// character that leads to it, and the word that ends in it (or -1)
 class DictionaryState {
 public:
-    DictionaryState() : failure(0), gotos(), output(), isBranch(false) { }
-    
-    typedef std::vector< std::pair< KyteaChar, unsigned> > Gotos;
-
-    unsigned failure;
-    Gotos gotos;
-    std::vector< unsigned > output;
-    bool isBranch;
-
-    inline unsigned step(KyteaChar input) {
-        Gotos::const_iterator l=gotos.begin(), r=gotos.end(), m;
-        KyteaChar check;
-        while(r != l) {
-            m = l+std::distance(l,r)/2;
-            check = m->first;
-            if(input<check) r=m;
-            else if(input>check) l=m+1;
-            else return m->second;
-        }
-        return 0;
-    }
+    DictionaryState(unsigned p, KyteaChar c) : parent(p), label(c), entry(-1) { }
 
+    unsigned parent;
+    KyteaChar label;
+    int entry;
 };
 
 
 // a dictionary that uses a FA tree and the Aho-Corasick algorithm for search
 //  Aho-Corasick "Efficient String Matching: An Aid to Bibliographic Search"
+// The states are kept in parallel arrays, with the gotos and outputs of all
+// states pooled together, and the range of state i given by starts[i] and
+// starts[i+1]. States with many gotos are also given a dense table, a
+// two-level page table indexed by the character, instead of a binary search.
+// Each state only holds the word that ends in it, and the words ending in
+// its suffixes are found by following the output links
 template <class Entry>
 class Dictionary {
 
@@ -134,6 +138,9 @@ public:
 
     typedef std::map<KyteaString, Entry*> WordMap;
     typedef typename WordMap::const_iterator wm_const_iterator;
+    typedef std::vector< std::pair<KyteaChar, unsigned> > Gotos;
+    // Words and their entries, sorted by the word with no duplicates
+    typedef std::vector< std::pair<KyteaString, Entry*> > WordArray;
 
     // A result of dictionary matching, containing pairs of the ending point
     // and the entry
@@ -142,20 +149,34 @@ public:
 private:
 
     StringUtil * util_;
-    std::vector<DictionaryState*> states_;
+    std::vector<unsigned> failures_;
+    std::vector<unsigned char> flags_;
+    std::vector<unsigned> gotoStarts_;
+    Gotos gotos_;
+    std::vector<unsigned> outputStarts_;
+    std::vector<unsigned> outputs_;
+    // the closest state on the failure chain that has an output (or 0)
+    std::vector<unsigned> outputLinks_;
+    // the states with dense tables in order, where the page ids of each
+    // state start (0 for states without a table), the page of each of their
+    // characters, and the pages, where page 0 is empty
+    std::vector<unsigned> denseStates_;
+    std::vector<unsigned> denseStarts_;
+    std::vector<unsigned> densePageIds_;
+    std::vector<unsigned> densePages_;
     std::vector<Entry*> entries_;
     unsigned char numDicts_;
 
-    std::string space(unsigned lev) {
-        std::ostringstream oss;
-        while(lev-- > 0)
-            oss << " ";
-        return oss.str();
-    }
-
-    // Build the goto and failures for the Aho-Corasick method
-    void buildGoto(wm_const_iterator start, wm_const_iterator end, unsigned lev, unsigned nid);
+    // Build the trie states for the words [start,end) in depth-first order.
+    // The first state is at index 0, and parent 0 is the root
+    static void buildTrie(const WordArray & input, unsigned start, unsigned end, std::vector<DictionaryState> & states);
+    // Build the failures for the Aho-Corasick method
     void buildFailures();
+    // Build the tables that are derived from the states
+    void buildDenseTables();
+    void buildOutputLinks();
+    // Get the states in breadth-first order, without the root
+    void getBreadthOrder(std::vector<unsigned> & order) const;
 
 public:
 
@@ -168,18 +189,65 @@ public:
     };
 
     void buildIndex(const WordMap & input);
+    void buildIndex(const WordArray & input);
     void print();
 
+    // Recover the words and entries that the index was built from
+    void getWordMap(WordMap & ret) const;
+
     const Entry * findEntry(KyteaString str) const;
     Entry * findEntry(KyteaString str);
     unsigned getTagID(KyteaString str, KyteaString tag, int lev);
 
     MatchResult match( const KyteaString & chars ) const;
 
+    // The length of the longest word in the dictionary
+    unsigned getMaxLength() const {
+        unsigned ret = 0;
+        for(unsigned i = 0; i < entries_.size(); i++)
+            ret = std::max(ret, entries_[i]->word.length());
+        return ret;
+    }
+
+    // Follow the goto from a state, returning 0 if there is none
+    inline unsigned step(unsigned state, KyteaChar input) const {
+        if(flags_[state] & DICTIONARY_DENSE) {
+            const unsigned page = densePageIds_[denseStarts_[state] + (input >> DICTIONARY_PAGE_BITS)];
+            return densePages_[page*DICTIONARY_PAGE_SIZE + (input & (DICTIONARY_PAGE_SIZE-1))];
+        }
+        Gotos::const_iterator l=gotos_.begin()+gotoStarts_[state], r=gotos_.begin()+gotoStarts_[state+1], m;
+        KyteaChar check;
+        while(r != l) {
+            m = l+std::distance(l,r)/2;
+            check = m->first;
+            if(input<check) r=m;
+            else if(input>check) l=m+1;
+            else return m->second;
+        }
+        return 0;
+    }
+
+    // Check that the arrays read from a model fit together
+    void checkStates() const;
+    // Build the dense tables and output links after the arrays are read
+    void buildLookupTables() { buildDenseTables(); buildOutputLinks(); }
+
+    unsigned getNumStates() const { return failures_.size(); }
     std::vector<Entry*> & getEntries() { return entries_; }
-    std::vector<DictionaryState*> & getStates() { return states_; }
+    std::vector<unsigned> & getFailures() { return failures_; }
+    std::vector<unsigned char> & getFlags() { return flags_; }
+    std::vector<unsigned> & getGotoStarts() { return gotoStarts_; }
+    Gotos & getGotos() { return gotos_; }
+    std::vector<unsigned> & getOutputStarts() { return outputStarts_; }
+    std::vector<unsigned> & getOutputs() { return outputs_; }
     const std::vector<Entry*> & getEntries() const { return entries_; }
-    const std::vector<DictionaryState*> & getStates() const { return states_; }
+    const std::vector<unsigned> & getFailures() const { return failures_; }
+    const std::vector<unsigned char> & getFlags() const { return flags_; }
+    unsigned getNumDenseStates() const { return denseStates_.size(); }
+    const std::vector<unsigned> & getGotoStarts() const { return gotoStarts_; }
+    const Gotos & getGotos() const { return gotos_; }
+    const std::vector<unsigned> & getOutputStarts() const { return outputStarts_; }
+    const std::vector<unsigned> & getOutputs() const { return outputs_; }
     unsigned char getNumDicts() const { return numDicts_; }
     void setNumDicts(unsigned char numDicts) { numDicts_ = numDicts; }
 
@@ -187,8 +255,14 @@ public:
     // and entries are identical for now, if necessary expand to check
     // the values as well
     void checkEqual(const Dictionary<Entry> & rhs) const {
-        if(states_.size() != rhs.states_.size())
-            THROW_ERROR("states_.size() != rhs.states_.size() ("<<states_.size()<<" != "<<rhs.states_.size());
+        if(failures_.size() != rhs.failures_.size())
+            THROW_ERROR("failures_.size() != rhs.failures_.size() ("<<failures_.size()<<" != "<<rhs.failures_.size());
+        if(gotos_.size() != rhs.gotos_.size())
+            THROW_ERROR("gotos_.size() != rhs.gotos_.size() ("<<gotos_.size()<<" != "<<rhs.gotos_.size());
+        if(outputs_.size() != rhs.outputs_.size())
+            THROW_ERROR("outputs_.size() != rhs.outputs_.size() ("<<outputs_.size()<<" != "<<rhs.outputs_.size());
+        if(denseStates_ != rhs.denseStates_)
+            THROW_ERROR("denseStates_ != rhs.denseStates_ ("<<denseStates_.size()<<" != "<<rhs.denseStates_.size());
         if(entries_.size() != rhs.entries_.size())
             THROW_ERROR("entries_.size() != rhs.entries_.size() ("<<entries_.size()<<" != "<<rhs.entries_.size());
         if(numDicts_ != rhs.numDicts_)
@@ -199,144 +273,269 @@ public:
 };
 
 template <class Entry>
-void Dictionary<Entry>::buildGoto(wm_const_iterator start, wm_const_iterator end, unsigned lev, unsigned nid) {
-#ifdef KYTEA_SAFE
-    if(start == end) return;
-    if(nid >= states_.size())
-        THROW_ERROR("Out of bounds node in buildGoto ("<<nid<<" >= "<<states_.size()<<")");
-#endif
-    wm_const_iterator startCopy = start;
-    DictionaryState & node = *states_[nid];
-    // add equal strings
-    if(startCopy->first.length() == lev) {
-        node.output.push_back(entries_.size());
-        node.isBranch = true;
-        entries_.push_back(startCopy->second);
-        startCopy++;
-    }
-    if(startCopy == end) return;
-    // count the number of buckets
-    wm_const_iterator binEnd = startCopy, binStart;
-    unsigned numBins = 0;
-    KyteaChar lastChar = binEnd->first[lev];
-    do {
-        binEnd++;
-        KyteaChar nextChar = (binEnd == end?0:binEnd->first[lev]);
-        if(nextChar != lastChar) {
-            numBins++;
-            lastChar = nextChar;
+void Dictionary<Entry>::buildTrie(const WordArray & input, unsigned start, unsigned end, std::vector<DictionaryState> & states) {
+    // the states on the path to the previous word, where 0 is the root and
+    // state i is at states[i-1]
+    std::vector<unsigned> path(1, 0);
+    for(unsigned i = start; i < end; i++) {
+        const KyteaString & word = input[i].first;
+        // keep the prefix shared with the previous word
+        unsigned shared = 0;
+        if(i != start) {
+            const KyteaString & prev = input[i-1].first;
+            while(shared < prev.length() && shared < word.length() && prev[shared] == word[shared])
+                shared++;
         }
-    } while(binEnd != end);
-    node.gotos.reserve(numBins);
-    // add bucket strings
-    binStart = startCopy, binEnd = startCopy;
-    lastChar = binStart->first[lev];
-    do {
-        binEnd++;
-        KyteaChar nextChar = (binEnd == end?0:binEnd->first[lev]);
-        if(nextChar != lastChar) {
-            unsigned nextNode = states_.size();
-            states_.push_back(new DictionaryState());
-            node.gotos.push_back(std::pair<KyteaChar,unsigned>(lastChar,nextNode));
-            buildGoto(binStart,binEnd,lev+1,nextNode);
-            binStart = binEnd;
-            lastChar = nextChar;
+        path.resize(shared+1);
+        for(unsigned j = shared; j < word.length(); j++) {
+            states.push_back(DictionaryState(path.back(), word[j]));
+            path.push_back(states.size());
         }
-    } while(binEnd != end);
+        states.back().entry = i;
+    }
+}
+
+template <class Entry>
+void Dictionary<Entry>::getBreadthOrder(std::vector<unsigned> & order) const {
+    order.clear();
+    order.reserve(failures_.size());
+    for(unsigned i = gotoStarts_[0]; i < gotoStarts_[1]; i++)
+        order.push_back(gotos_[i].second);
+    for(unsigned pos = 0; pos < order.size(); pos++) {
+        const unsigned r = order[pos];
+        for(unsigned i = gotoStarts_[r]; i < gotoStarts_[r+1]; i++)
+            order.push_back(gotos_[i].second);
+    }
 }
 
 template <class Entry>
 void Dictionary<Entry>::buildFailures() {
-    if(states_.size() == 0)
-        return;
-    std::deque<unsigned> sq;
-    DictionaryState::Gotos & g0 = states_[0]->gotos;
-    for(unsigned i = 0; i < g0.size(); i++)
-        sq.push_back(g0[i].second);
-    while(sq.size() != 0) {
-        unsigned r = sq.front();
-        sq.pop_front();
-        DictionaryState::Gotos & gr = states_[r]->gotos;
-        for(unsigned i = 0; i < gr.size(); i++) {
-            KyteaChar a = gr[i].first;
-            unsigned s = gr[i].second;
-            sq.push_back(s);
-            unsigned state = states_[r]->failure;
+    std::vector<unsigned> order;
+    getBreadthOrder(order);
+    for(unsigned pos = 0; pos < order.size(); pos++) {
+        const unsigned r = order[pos];
+        for(unsigned i = gotoStarts_[r]; i < gotoStarts_[r+1]; i++) {
+            KyteaChar a = gotos_[i].first;
+            unsigned state = failures_[r];
             unsigned trans = 0;
-            while((trans = states_[state]->step(a)) == 0 && (state != 0))
-                state = states_[state]->failure;
-            states_[s]->failure = trans;
-            for(unsigned j = 0; j < states_[trans]->output.size(); j++)
-                states_[s]->output.push_back(states_[trans]->output[j]);
+            while((trans = step(state, a)) == 0 && (state != 0))
+                state = failures_[state];
+            failures_[gotos_[i].second] = trans;
         }
     }
+}
 
+template <class Entry>
+void Dictionary<Entry>::buildOutputLinks() {
+    outputLinks_.assign(failures_.size(), 0);
+    std::vector<unsigned> order;
+    getBreadthOrder(order);
+    // failures are closer to the root, so their links are already known
+    for(unsigned pos = 0; pos < order.size(); pos++) {
+        const unsigned s = order[pos], f = failures_[s];
+        outputLinks_[s] = (outputStarts_[f] != outputStarts_[f+1] ? f : outputLinks_[f]);
+    }
+}
+
+template <class Entry>
+void Dictionary<Entry>::buildDenseTables() {
+    denseStates_.clear();
+    denseStarts_.assign(flags_.size(), 0);
+    densePageIds_.clear();
+    densePages_.assign(DICTIONARY_PAGE_SIZE, 0);
+    for(unsigned i = 0; i < flags_.size(); i++) {
+        if(!(flags_[i] & DICTIONARY_DENSE))
+            continue;
+        denseStates_.push_back(i);
+        const unsigned pageStart = densePageIds_.size();
+        denseStarts_[i] = pageStart;
+        densePageIds_.resize(pageStart + DICTIONARY_NUM_PAGES, 0);
+        // the gotos are sorted, so each page is filled in turn
+        for(unsigned j = gotoStarts_[i]; j < gotoStarts_[i+1]; j++) {
+            const KyteaChar c = gotos_[j].first;
+            unsigned & page = densePageIds_[pageStart + (c >> DICTIONARY_PAGE_BITS)];
+            if(page == 0) {
+                page = densePages_.size() / DICTIONARY_PAGE_SIZE;
+                densePages_.resize(densePages_.size() + DICTIONARY_PAGE_SIZE, 0);
+            }
+            densePages_[page*DICTIONARY_PAGE_SIZE + (c & (DICTIONARY_PAGE_SIZE-1))] = gotos_[j].second;
+        }
+    }
 }
 
 template <class Entry>
 void Dictionary<Entry>::clearData() {
-    for(unsigned i = 0; i < states_.size(); i++)
-        delete states_[i];
     for(unsigned i = 0; i < entries_.size(); i++)
         delete entries_[i];
     entries_.clear();
-    states_.clear();
+    failures_.clear();
+    flags_.clear();
+    gotoStarts_.clear();
+    gotos_.clear();
+    outputStarts_.clear();
+    outputs_.clear();
+    outputLinks_.clear();
+    denseStates_.clear();
+    denseStarts_.clear();
+    densePageIds_.clear();
+    densePages_.clear();
 }
 
 template <class Entry>
 void Dictionary<Entry>::buildIndex(const WordMap & input) {
+    buildIndex(WordArray(input.begin(), input.end()));
+}
+
+template <class Entry>
+void Dictionary<Entry>::buildIndex(const WordArray & input) {
     if(input.size() == 0)
         THROW_ERROR("Cannot build dictionary for no input");
+    if(input[0].first.length() == 0)
+        THROW_ERROR("Cannot build dictionary with an empty word");
+    for(unsigned i = 1; i < input.size(); i++)
+        if(!(input[i-1].first < input[i].first))
+            THROW_ERROR("Words must be sorted and unique to build a dictionary");
     clearData();
-    states_.push_back(new DictionaryState());
-    buildGoto(input.begin(), input.end(), 0, 0);
+    // split the words into chunks that start with different characters,
+    // the tries of which can be built independently
+    std::vector<unsigned> bounds(1, 0);
+    const unsigned chunkSize = input.size()/DICTIONARY_BUILD_CHUNKS + 1;
+    for(unsigned i = 1; i < input.size(); i++)
+        if(i - bounds.back() >= chunkSize && input[i].first[0] != input[i-1].first[0])
+            bounds.push_back(i);
+    bounds.push_back(input.size());
+    const int numChunks = bounds.size()-1;
+    std::vector< std::vector<DictionaryState> > chunks(numChunks);
+    // only the library is built with OpenMP, so the pragma is hidden from
+    // other programs that include this header
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(input.size() >= DICTIONARY_PARALLEL_WORDS)
+#endif
+    for(int i = 0; i < numChunks; i++)
+        buildTrie(input, bounds[i], bounds[i+1], chunks[i]);
+    // the chunks are concatenated after the root, which keeps the states in
+    // depth-first order
+    std::vector<unsigned> offsets(numChunks+1, 1);
+    for(int i = 0; i < numChunks; i++)
+        offsets[i+1] = offsets[i] + chunks[i].size();
+    const unsigned numStates = offsets[numChunks];
+    failures_.assign(numStates, 0);
+    flags_.assign(numStates, 0);
+    gotoStarts_.assign(numStates+1, 0);
+    outputStarts_.assign(numStates+1, 0);
+    // count the gotos and outputs of each state
+    for(int i = 0; i < numChunks; i++) {
+        for(unsigned j = 0; j < chunks[i].size(); j++) {
+            const DictionaryState & state = chunks[i][j];
+            gotoStarts_[(state.parent ? state.parent+offsets[i]-1 : 0)+1]++;
+            if(state.entry >= 0) {
+                outputStarts_[offsets[i]+j+1]++;
+                flags_[offsets[i]+j] |= DICTIONARY_BRANCH;
+            }
+        }
+    }
+    for(unsigned i = 0; i < numStates; i++) {
+        gotoStarts_[i+1] += gotoStarts_[i];
+        outputStarts_[i+1] += outputStarts_[i];
+        if(gotoStarts_[i+1] - gotoStarts_[i] > DICTIONARY_DENSE_GOTOS)
+            flags_[i] |= DICTIONARY_DENSE;
+    }
+    // fill in the gotos, children of the same state are already in order
+    gotos_.resize(gotoStarts_[numStates]);
+    outputs_.resize(outputStarts_[numStates]);
+    std::vector<unsigned> nextGoto(gotoStarts_.begin(), gotoStarts_.end()-1);
+    for(int i = 0; i < numChunks; i++) {
+        for(unsigned j = 0; j < chunks[i].size(); j++) {
+            const DictionaryState & state = chunks[i][j];
+            const unsigned id = offsets[i]+j;
+            const unsigned parent = (state.parent ? state.parent+offsets[i]-1 : 0);
+            gotos_[nextGoto[parent]++] = std::pair<KyteaChar,unsigned>(state.label, id);
+            if(state.entry >= 0)
+                outputs_[outputStarts_[id]] = state.entry;
+        }
+        std::vector<DictionaryState>().swap(chunks[i]);
+    }
+    entries_.reserve(input.size());
+    for(unsigned i = 0; i < input.size(); i++)
+        entries_.push_back(input[i].second);
+    buildDenseTables();
     buildFailures();
+    buildOutputLinks();
+}
+
+template <class Entry>
+void Dictionary<Entry>::checkStates() const {
+    const unsigned numStates = failures_.size();
+    if(flags_.size() != numStates || gotoStarts_.size() != numStates+1 || outputStarts_.size() != numStates+1)
+        THROW_ERROR("Badly formed model (dictionary state arrays of different sizes)");
+    if(gotoStarts_[numStates] != gotos_.size() || outputStarts_[numStates] != outputs_.size())
+        THROW_ERROR("Badly formed model (dictionary offsets do not match the arrays)");
+    for(unsigned i = 0; i < numStates; i++)
+        if(gotoStarts_[i] > gotoStarts_[i+1] || outputStarts_[i] > outputStarts_[i+1] || failures_[i] >= numStates ||
+           (flags_[i] & ~(DICTIONARY_BRANCH | DICTIONARY_DENSE)) ||
+           ((flags_[i] & DICTIONARY_BRANCH) && outputStarts_[i] == outputStarts_[i+1]))
+            THROW_ERROR("Badly formed model (bad dictionary state "<<i<<")");
+    for(unsigned i = 0; i < gotos_.size(); i++)
+        if(gotos_[i].second >= numStates)
+            THROW_ERROR("Badly formed model (dictionary goto to a non-existent state)");
+    for(unsigned i = 0; i < outputs_.size(); i++)
+        if(outputs_[i] >= entries_.size())
+            THROW_ERROR("Badly formed model (dictionary output of a non-existent entry)");
 }
 
 template <class Entry>
 void Dictionary<Entry>::print() {
-    for(unsigned i = 0; i < states_.size(); i++) {
-        std::cout << "s="<<i<<", f="<<states_[i]->failure<<", o='";
-        for(unsigned j = 0; j < states_[i]->output.size(); j++) {
-            if(j!=0) std::cout << " ";
-            std::cout << util_->showString(entries_[states_[i]->output[j]]->word);
+    for(unsigned i = 0; i < failures_.size(); i++) {
+        std::cout << "s="<<i<<", f="<<failures_[i]<<(flags_[i] & DICTIONARY_DENSE ? " (dense)" : "")<<", o='";
+        for(unsigned j = outputStarts_[i]; j < outputStarts_[i+1]; j++) {
+            if(j!=outputStarts_[i]) std::cout << " ";
+            std::cout << util_->showString(entries_[outputs_[j]]->word);
         }
         std::cout << "' g='";
-        for(unsigned j = 0; j < states_[i]->gotos.size(); j++) {
-            if(j!=0) std::cout << " ";
-            std::cout << util_->showChar(states_[i]->gotos[j].first) << "->" << states_[i]->gotos[j].second;
+        for(unsigned j = gotoStarts_[i]; j < gotoStarts_[i+1]; j++) {
+            if(j!=gotoStarts_[i]) std::cout << " ";
+            std::cout << util_->showChar(gotos_[j].first) << "->" << gotos_[j].second;
         }
         std::cout << "'" << std::endl;
     }
 }
 
+template <class Entry>
+void Dictionary<Entry>::getWordMap(WordMap & ret) const {
+    if(failures_.size() == 0)
+        return;
+    // walk the goto tree, every branch state is the end of a word
+    std::vector< std::pair<unsigned, KyteaString> > stack;
+    stack.push_back(std::pair<unsigned, KyteaString>(0, KyteaString()));
+    while(stack.size() != 0) {
+        std::pair<unsigned, KyteaString> next = stack.back();
+        stack.pop_back();
+        const unsigned state = next.first;
+        if(flags_[state] & DICTIONARY_BRANCH)
+            ret.insert(typename WordMap::value_type(next.second, entries_[outputs_[outputStarts_[state]]]));
+        for(unsigned i = gotoStarts_[state]; i < gotoStarts_[state+1]; i++)
+            stack.push_back(std::pair<unsigned, KyteaString>(gotos_[i].second, next.second+gotos_[i].first));
+    }
+}
+
 template <class Entry>
 Entry * Dictionary<Entry>::findEntry(KyteaString str) {
-    if(str.length() == 0) return 0;
-    unsigned state = 0, lev = 0;
-    do {
-#ifdef KYTEA_SAFE
-        if(state >= states_.size())
-            THROW_ERROR("Accessing state "<<state<<" that is larger than states_ ("<<states_.size()<<")");
-        if(states_[state] == 0)
-            THROW_ERROR("Accessing null state "<<state);
-#endif
-        state = states_[state]->step(str[lev++]);
-    } while (state != 0 && lev < str.length());
-    if(states_[state]->output.size() == 0) return 0;
-    if(!states_[state]->isBranch) return 0;
-    return entries_[states_[state]->output[0]];
+    return const_cast<Entry*>(static_cast<const Dictionary<Entry>*>(this)->findEntry(str));
 }
 template <class Entry>
 const Entry * Dictionary<Entry>::findEntry(KyteaString str) const {
     if(str.length() == 0) return 0;
     unsigned state = 0, lev = 0;
     do {
-        state = states_[state]->step(str[lev++]);
+#ifdef KYTEA_SAFE
+        if(state >= failures_.size())
+            THROW_ERROR("Accessing state "<<state<<" that is larger than the number of states ("<<failures_.size()<<")");
+#endif
+        state = step(state, str[lev++]);
     } while (state != 0 && lev < str.length());
-    if(states_[state]->output.size() == 0) return 0;
-    if(!states_[state]->isBranch) return 0;
-    return entries_[states_[state]->output[0]];
+    if(outputStarts_[state] == outputStarts_[state+1]) return 0;
+    if(!(flags_[state] & DICTIONARY_BRANCH)) return 0;
+    return entries_[outputs_[outputStarts_[state]]];
 }
 
 template <class Entry>
@@ -356,12 +555,14 @@ typename Dictionary<Entry>::MatchResult Dictionary<Entry>::match( const KyteaStr
     MatchResult ret;
     for(unsigned i = 0; i < len; i++) {
         KyteaChar c = chars[i];
-        while((nextState = states_[currState]->step(c)) == 0 && currState != 0)
-            currState = states_[currState]->failure;
+        while((nextState = step(currState, c)) == 0 && currState != 0)
+            currState = failures_[currState];
         currState = nextState;
-        std::vector<unsigned> & output = states_[currState]->output;
-        for(unsigned j = 0; j < output.size(); j++) 
-            ret.push_back( std::pair<unsigned, Entry*>(i, entries_[output[j]]) );
+        for(unsigned j = outputStarts_[currState]; j < outputStarts_[currState+1]; j++) 
+            ret.push_back( std::pair<unsigned, Entry*>(i, entries_[outputs_[j]]) );
+        for(unsigned s = outputLinks_[currState]; s != 0; s = outputLinks_[s])
+            for(unsigned j = outputStarts_[s]; j < outputStarts_[s+1]; j++) 
+                ret.push_back( std::pair<unsigned, Entry*>(i, entries_[outputs_[j]]) );
     }
     return ret;
 }
@@ -59,6 +59,14 @@ public:
     void addTagDictWeights(const std::vector<std::pair<int,int> > & exists, 
                            std::vector<FeatSum> & scores);
 
+    // Add the largest absolute value of each entry in the n-gram and self
+    //  dictionaries to weights
+    void getEntryWeights(std::vector<double> & weights) const;
+
+    // Remove the entries of the n-gram and self dictionaries where no value
+    //  times mult is larger than cutoff, returning the number removed
+    unsigned prune(double cutoff, double mult, StringUtil * util);
+
     // Setters, these will all take control of the features they are passed
     //  (without making a copy)
     void setCharDict(Dictionary<FeatVec> * charDict) { charDict_ = charDict; }
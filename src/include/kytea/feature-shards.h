@@ -0,0 +1,81 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef FEATURE_SHARDS_H__
+#define FEATURE_SHARDS_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+struct feature_node;
+
+namespace kytea {
+
+// Training examples that are written to shards in a scratch directory
+// instead of being held in memory. Examples are buffered until they reach
+// the memory budget, then written out in the format used by liblinear, so
+// the shards can be mapped into memory and used by the solvers as-is
+class FeatureShards {
+
+public:
+
+    FeatureShards(const std::string & dir, size_t budget, double bias);
+    ~FeatureShards();
+
+    // Add a single example
+    void addExample(const std::vector<unsigned> & feat, int label);
+
+    // Map the shards into memory and return an array (allocated with malloc)
+    // of pointers to the examples, with biasId as the index of the bias
+    struct feature_node ** mapExamples(int biasId);
+
+    std::vector<int> & getLabels() { return labels_; }
+    size_t size() const { return labels_.size(); }
+    size_t getNumShards() const { return files_.size(); }
+
+protected:
+
+    // Write the buffered examples to a new shard
+    void writeShard();
+
+    std::string dir_;
+    size_t budget_;
+    double bias_;
+    std::vector<int> labels_;
+    std::vector<char> buffer_;
+    std::vector<std::string> files_;
+    // the memory that the shards are mapped to
+    std::vector< std::pair<void*,size_t> > maps_;
+
+};
+
+// Own a set of shards (or none), deleting them when it goes out of scope so
+// that their files are removed even if training throws
+class FeatureShardsHolder {
+public:
+    FeatureShardsHolder(FeatureShards * shards) : shards_(shards) { }
+    ~FeatureShardsHolder() { delete shards_; }
+    FeatureShards * get() const { return shards_; }
+private:
+    FeatureShardsHolder(const FeatureShardsHolder &);
+    FeatureShardsHolder & operator=(const FeatureShardsHolder &);
+    FeatureShards * shards_;
+};
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef KYTEA_C_H__
+#define KYTEA_C_H__
+
+/* A C interface to KyTea that can be called through a foreign function
+ * interface. Text is passed as UTF-8 byte buffers owned by the caller, and
+ * results are written to arrays owned by the caller.
+ *
+ * A model can be shared by any number of analyzers, but each analyzer must
+ * only be used by one thread at a time. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct kytea_model kytea_model;
+typedef struct kytea_analyzer kytea_analyzer;
+
+/* return values of kytea_analyze_batch */
+#define KYTEA_OK 0
+#define KYTEA_ERROR -1
+#define KYTEA_ERROR_SPACE -2
+
+/* the tag ID of words that have no tag */
+#define KYTEA_NO_TAG -1
+
+/* Read a UTF-8 model. On failure NULL is returned, and the reason is
+ * written to error (if it is not NULL) */
+kytea_model * kytea_model_load(const char * file, char * error, size_t error_size);
+
+/* Free a model, which must not be used by any analyzer */
+void kytea_model_free(kytea_model * model);
+
+/* The number of tag levels of the model, and the number of tags in a level
+ * that are known to the model (IDs 0 to num_tags-1) */
+int kytea_model_num_tag_levels(const kytea_model * model);
+int kytea_model_num_tags(const kytea_model * model, int level);
+
+kytea_analyzer * kytea_analyzer_new(kytea_model * model);
+void kytea_analyzer_free(kytea_analyzer * analyzer);
+
+/* Analyze num_texts texts, where text i is the lengths[i] bytes at
+ * texts[i] and is analyzed as a single sentence.
+ *
+ * The words of all texts are written one after another. num_words[i] is set
+ * to the number of words in text i, and word_ends[w] to the offset of the
+ * byte after word w in its text. If tag_ids is not NULL, the best tag of
+ * word w at each level is written to tag_ids[w*num_tag_levels+level].
+ * Otherwise no tagging is done.
+ *
+ * KYTEA_ERROR_SPACE is returned if there are more than max_words words,
+ * and KYTEA_ERROR on other errors (see kytea_analyzer_error) */
+int kytea_analyze_batch(kytea_analyzer * analyzer,
+                        const char * const * texts, const size_t * lengths, size_t num_texts,
+                        size_t * word_ends, int * tag_ids, size_t max_words,
+                        size_t * num_words);
+
+/* The name of a tag ID as a UTF-8 string, or NULL if the ID is unknown.
+ * Tags that the model does not know (such as the pronunciations of unknown
+ * words) are given IDs of num_tags and above, which are only valid for the
+ * analyzer that returned them. The string is valid as long as the
+ * analyzer */
+const char * kytea_analyzer_tag_name(const kytea_analyzer * analyzer, int level, int id);
+
+/* The message of the last error of the analyzer */
+const char * kytea_analyzer_error(const kytea_analyzer * analyzer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
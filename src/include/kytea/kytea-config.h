@@ -53,6 +53,7 @@ private:
     std::vector<std::string> subwordDicts_; // subword dictionaries to use for unknown estimation
 
     std::string model_;              // model file to write/read
+    std::string initModel_;          // model file to initialize training from
     char modelForm_;             // model format (ModelIO::Format)
 
     std::string input_, output_;     // the file to input/output
@@ -80,8 +81,21 @@ private:
     //  unkN: the n-gram length of the unknown word spelling model
     //  defTag: a default tag to use when no candidates were generated
     //  unkTag: a tag to append after every word with no tag in the dictionary
+    //  unkCache: the number of unknown words to cache the tags of
     char unkN_;
     unsigned unkBeam_;
+    unsigned unkCache_;
+
+    // the memory (in megabytes) to use for caching analyzed sentences
+    unsigned sentCache_;
+    // the bytes of a raw line to read at a time (0 for whole lines)
+    unsigned chunkSize_;
+    // whether to report the timings and counts of analysis
+    bool stats_;
+    // a user dictionary to match along with the model's dictionary, and the
+    // dictionary of the model whose weights its words use
+    std::string overlayFile_;
+    int overlaySlot_;
     std::string defTag_;
     std::string unkTag_;
 
@@ -90,13 +104,19 @@ private:
     double eps_;     // the termination epsilon
     double cost_;    // the cost for the SVM or LR training
     int solverType_; // the type of solver to be used
+    int numThreads_; // the number of threads to use in training (0=default)
+
+    // online training values
+    int onlineEpochs_;    // the number of passes over the corpora (0=use liblinear)
+    int onlineAlg_;       // the online learner (OnlineLearner::Algorithm)
+
+    // out-of-core training values
+    std::string scratchDir_; // the directory to write features to (empty=keep in memory)
+    double shardMem_;        // the memory used to buffer features for each shard (MB)
 
     // extra arguments, should be input/output for the analyzer
     std::vector<std::string> args_;
 
-    // set the type of the input corpus
-    void setIOFormat(const char* str, CorpForm & cf);
-    
     // formatting tags
     std::string wordBound_, tagBound_, elemBound_, unkBound_, noBound_, hasBound_, skipBound_, escape_;
 
@@ -117,9 +137,10 @@ public:
                     doWS_(true), doTags_(true), doUnk_(true),
                     addFeat_(false), confidence_(0.0), charW_(3), charN_(3), 
                     typeW_(3), typeN_(3), dictN_(4), 
-                    unkN_(3), unkBeam_(50), defTag_("UNK"), unkTag_(),
+                    unkN_(3), unkBeam_(50), unkCache_(10000), sentCache_(0), chunkSize_(0), stats_(false), overlayFile_(), overlaySlot_(0), defTag_("UNK"), unkTag_(),
                     bias_(1.0f), eps_(HUGE_VAL), cost_(1.0),
-                    solverType_(1/*SVM*/),
+                    solverType_(1/*SVM*/), numThreads_(0),
+                    onlineEpochs_(0), onlineAlg_(0), scratchDir_(), shardMem_(256),
                     wordBound_(" "), tagBound_("/"), elemBound_("&"), unkBound_(" "), 
                     noBound_("-"), hasBound_("|"), skipBound_("?"), escape_("\\"), 
                     numTags_(0), tagMax_(3) {
@@ -136,9 +157,15 @@ public:
                      charN_(rhs.charN_), typeW_(rhs.typeW_), 
                      typeN_(rhs.typeN_), dictN_(rhs.dictN_), 
                      unkN_(rhs.unkN_), unkBeam_(rhs.unkBeam_), 
+                     unkCache_(rhs.unkCache_), sentCache_(rhs.sentCache_),
+                     chunkSize_(rhs.chunkSize_), stats_(rhs.stats_),
+                     overlayFile_(rhs.overlayFile_), overlaySlot_(rhs.overlaySlot_),
                      defTag_(rhs.defTag_), unkTag_(rhs.unkTag_), 
                      bias_(rhs.bias_), eps_(rhs.eps_), cost_(rhs.cost_), 
-                     solverType_(rhs.solverType_), wordBound_(rhs.wordBound_), 
+                     solverType_(rhs.solverType_), numThreads_(rhs.numThreads_),
+                     onlineEpochs_(rhs.onlineEpochs_), onlineAlg_(rhs.onlineAlg_),
+                     scratchDir_(rhs.scratchDir_), shardMem_(rhs.shardMem_),
+                     wordBound_(rhs.wordBound_), 
                      tagBound_(rhs.tagBound_), elemBound_(rhs.elemBound_), 
                      unkBound_(rhs.unkBound_), noBound_(rhs.noBound_), 
                      hasBound_(rhs.hasBound_), skipBound_(rhs.skipBound_), 
@@ -185,6 +212,7 @@ public:
     const std::vector<std::string> & getDictionaryFiles() const { return dicts_; }
     const std::vector<std::string> & getSubwordDictFiles() const { return subwordDicts_; }
     const std::string & getModelFile() const { return model_; }
+    const std::string & getInitModelFile() const { return initModel_; }
     const char getModelFormat() const { return modelForm_; }
     const unsigned getDebug() const { return debug_; }
     StringUtil * getStringUtil() { return util_; }
@@ -203,6 +231,12 @@ public:
     const char getUnkN() const { return unkN_; }
     const unsigned getTagMax() const { return tagMax_; }
     const unsigned getUnkBeam() const { return unkBeam_; }
+    const unsigned getUnkCache() const { return unkCache_; }
+    const unsigned getSentenceCache() const { return sentCache_; }
+    const unsigned getChunkSize() const { return chunkSize_; }
+    const bool getStats() const { return stats_; }
+    const std::string & getOverlayFile() const { return overlayFile_; }
+    const int getOverlaySlot() const { return overlaySlot_; }
     const std::string & getUnkTag() const { return unkTag_; }
     const std::string & getDefaultTag() const { return defTag_; }
 
@@ -210,6 +244,11 @@ public:
     const double getEpsilon() const { return eps_; }
     const double getCost() const { return cost_; }
     const int getSolverType() const { return solverType_; }
+    const int getNumThreads() const { return numThreads_; }
+    const int getOnlineEpochs() const { return onlineEpochs_; }
+    const int getOnlineAlgorithm() const { return onlineAlg_; }
+    const std::string & getScratchDir() const { return scratchDir_; }
+    const double getShardMemory() const { return shardMem_; }
     const bool getDoWS() const { return doWS_; }
     const bool getDoUnk() const { return doUnk_; }
     const bool getDoTags() const { return doTags_; }
@@ -234,11 +273,18 @@ public:
     // setters
     void setDebug(unsigned debug) { debug_ = debug; }
     void setModelFile(const char* file) { model_ = file; }
+    void setInitModelFile(const char* file) { initModel_ = file; }
     void setModelFormat(char mf) { modelForm_ = mf; }
     void setEpsilon(double v) { eps_ = v; }
     void setCost(double v) { cost_ = v; }
     void setBias(bool v) { bias_ = (v?1.0f:-1.0f); }
     void setSolverType(int v) { solverType_ = v; }
+    void setNumThreads(int v) { numThreads_ = v; }
+    void setOnlineEpochs(int v) { onlineEpochs_ = v; }
+    void setOnlineAlgorithm(int v) { onlineAlg_ = v; }
+    void setScratchDir(const std::string & v) { scratchDir_ = v; }
+    void setShardMemory(double v) { shardMem_ = v; }
+    void setConfidence(double v) { confidence_ = v; }
     void setCharWindow(char v) { charW_ = v; }
     void setCharN(char v) { charN_ = v; }
     void setTypeWindow(char v) { typeW_ = v; }
@@ -247,6 +293,12 @@ public:
     void setUnkN(char v) { unkN_ = v; }
     void setTagMax(unsigned v) { tagMax_ = v; }
     void setUnkBeam(unsigned v) { unkBeam_ = v; }
+    void setUnkCache(unsigned v) { unkCache_ = v; }
+    void setSentenceCache(unsigned v) { sentCache_ = v; }
+    void setChunkSize(unsigned v) { chunkSize_ = v; }
+    void setStats(bool v) { stats_ = v; }
+    void setOverlayFile(const std::string & v) { overlayFile_ = v; }
+    void setOverlaySlot(int v) { overlaySlot_ = v; }
     void setUnkTag(const std::string & v) { unkTag_ = v; }
     void setUnkTag(const char* v) { unkTag_ = v; }
     void setDefaultTag(const std::string & v) { defTag_ = v; }
@@ -260,6 +312,8 @@ public:
         doTag_[i] = v;
     } 
     void setInputFormat(CorpForm v) { inputForm_ = v; }
+    // set the type of a corpus from its name (full, part, prob, raw)
+    void setIOFormat(const char* str, CorpForm & cf);
     void setWordBound(const char* v) { wordBound_ = v; } 
     void setTagBound(const char* v) { tagBound_ = v; } 
     void setElemBound(const char* v) { elemBound_ = v; } 
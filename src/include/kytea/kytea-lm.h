@@ -22,6 +22,27 @@
 
 namespace kytea {
 
+// a transition in the compiled language model
+class KyteaLMEdge {
+public:
+    KyteaChar next;
+    // the state reached by adding next to the context (-1 if none)
+    int state;
+    // whether the n-gram context+next has a probability, and its value
+    bool hasProb;
+    double prob;
+};
+
+// a context in the compiled language model
+class KyteaLMState {
+public:
+    // the first edge from this state
+    unsigned edges;
+    // the state for the longest suffix of this context (-1 for the root)
+    int back;
+    double fallback;
+};
+
 class KyteaLM {
 
 public:
@@ -30,17 +51,29 @@ public:
     KyteaDoubleMap probs_;
     KyteaDoubleMap fallbacks_;
 
-    KyteaLM(unsigned n) : n_(n), vocabSize_(10000) { }
+    KyteaLM(unsigned n) : n_(n), vocabSize_(10000), startState_(0) { }
     ~KyteaLM() { }
 
     // train a trigram model using Kneser-Ney smoothing
     void train(const std::vector<KyteaString> & corpus);
 
+    // compile probs_ and fallbacks_ into a trie of integer states. this must
+    // be called after the maps are changed, and before any scoring
+    void compile();
+
     // score a string with the language model
     double score(const KyteaString & str) const;
 
     // score a single position in the string
-    double scoreSingle(const KyteaString & val, int pos);
+    double scoreSingle(const KyteaString & val, int pos) const;
+
+    // the state before the first character of a string
+    unsigned getStartState() const { return startState_; }
+    // the state after adding next to the context of state
+    unsigned nextState(unsigned state, KyteaChar next) const;
+    // score the character next after the context of state (with next=0
+    // for the end of the string)
+    double scoreNext(unsigned state, KyteaChar next) const;
 
     const KyteaDoubleMap & getProbs() const { return probs_; }
     const KyteaDoubleMap & getFallbacks() const { return fallbacks_; }
@@ -54,6 +87,16 @@ public:
         checkMapEqual(fallbacks_, rhs.fallbacks_);
     }
 
+protected:
+
+    // find the edge for next from state, or return 0
+    const KyteaLMEdge * findEdge(unsigned state, KyteaChar next) const;
+
+    // the states (each context, and all of their prefixes) with a sentinel
+    // at the end, and the edges from each state sorted by character
+    std::vector<KyteaLMState> states_;
+    std::vector<KyteaLMEdge> edges_;
+    unsigned startState_;
 
 };
 
@@ -27,6 +27,9 @@ namespace kytea {
 #if DISABLE_QUANTIZE
     typedef double FeatVal;
     typedef double FeatSum;
+#elif QUANTIZE_8BIT
+    typedef int8_t FeatVal;
+    typedef int32_t FeatSum;
 #else
     typedef int16_t FeatVal;
     typedef int32_t FeatSum;
@@ -40,11 +43,24 @@ typedef std::vector<FeatVal> FeatVec;
 
 #define SIG_CUTOFF 1E-6
 
+struct feature_node;
+
 namespace kytea {
 
 typedef std::vector<KyteaString> FeatNameVec;
 
+// The weights of a trained model by feature name, used to warm-start
+// training. weights[name][k] is the weight for class labels[k] (models with
+// two classes have a single weight, for labels[0]), and the bias is stored
+// under the empty string
+class ModelWeights {
+public:
+    KyteaStringMap< std::vector<double> > weights;
+    std::vector<int> labels;
+};
+
 class FeatureLookup;
+class FeatureShards;
 template <class Entry>
 class Dictionary;
 
@@ -70,6 +86,12 @@ protected:
     bool addFeat_;
     FeatureLookup * featLookup_;
 
+    // Train the model with liblinear on examples in liblinear's format
+    void trainLiblinear(feature_node ** xs, std::vector<int> & ys, int solver, double epsilon, double cost, int numThreads, const ModelWeights * init);
+
+    // Build a starting point for liblinear from the weights of another model
+    double * makeInitialSolution(const std::vector<int> & ys, const ModelWeights & init);
+
 public:
     KyteaModel() : multiplier_(1.0f), bias_(1.0f), solver_(1), addFeat_(true), featLookup_(NULL) {
         KyteaString str;
@@ -115,8 +137,12 @@ public:
     // std::pair<int,double> runClassifier(const std::vector<unsigned> & feat);
     void printClassifier(const std::vector<unsigned> & feat, StringUtil * util, std::ostream & out = std::cerr);
 
-    void trainModel(const std::vector< std::vector<unsigned> > & xs, std::vector<int> & ys, double bias, int solver, double epsilon, double cost);
+    void trainModel(const std::vector< std::vector<unsigned> > & xs, std::vector<int> & ys, double bias, int solver, double epsilon, double cost, int numThreads = 0, const ModelWeights * init = 0);
+    void trainModel(FeatureShards & shards, double bias, int solver, double epsilon, double cost, int numThreads = 0, const ModelWeights * init = 0);
     void trimModel();
+    // Trim and quantize a trained liblinear-style weight vector (w[i*nr_class+j],
+    // or a single vector for two classes) and use it as the model's weights
+    void setTrainedWeights(const double * w, const std::vector<int> & labels);
 
     inline const KyteaUnsignedMap & getIds() const { return ids_; }
     inline const unsigned getNumFeatures() const { return names_.size()-1; }
@@ -160,6 +186,9 @@ public:
     void setMultiplier(double m) { multiplier_ = m; }
 
     void buildFeatureLookup(StringUtil * util, int charw, int typew, int numDicts, int maxLen);
+    // Recover the weights by feature name from the feature lookup, with names
+    // mapped from the string util of this model to that of another
+    void getModelWeights(StringUtil * from, StringUtil * to, int maxLen, ModelWeights & ret) const;
     Dictionary<std::vector<FeatVal> > * 
         makeDictionaryFromPrefixes(const std::vector<KyteaString> & prefs, StringUtil* util, bool adjustPos);
     
@@ -0,0 +1,94 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef KYTEA_SERVER_H__
+#define KYTEA_SERVER_H__
+
+#include <string>
+
+namespace kytea {
+
+class Kytea;
+class ModelHandle;
+struct ServerState;
+
+// A server that keeps a model in memory and analyzes requests sent over a
+// Unix domain socket or a localhost TCP port.
+//
+// Every message is a 4-byte big-endian length followed by that many bytes.
+// The first line of a request holds its options (-out FORMAT, -notags,
+// -notag N, which may be empty), and the rest is raw text with one sentence
+// per line. The response is "OK" and a newline followed by the analysis, or
+// "ERROR" and a message. The option -stats returns the statistics of the
+// server (see KyteaStats) instead.
+//
+// Requests are put in a queue of at most queueSize requests (connections
+// wait when it is full). Each worker takes up to batchSize requests at a
+// time, waiting at most deadline milliseconds for a batch to fill, and
+// analyzes the whole batch with one lease on the model
+class KyteaServer {
+
+public:
+
+    KyteaServer(ModelHandle & handle, int threads = 4, int batchSize = 16, int deadline = 2, int queueSize = 256);
+    ~KyteaServer();
+
+    // Listen on a Unix domain socket, or on a TCP port of localhost
+    void listenSocket(const std::string & file);
+    void listenPort(int port);
+
+    // Accept connections until stop() is called
+    void serve();
+    void stop();
+
+    // Analyze a single request with a model and return the response
+    static std::string processRequest(Kytea & kytea, const std::string & request);
+
+    // Read or write one message, returning false if the connection closed
+    static bool readMessage(int fd, std::string & message);
+    static bool writeMessage(int fd, const std::string & message);
+
+    // Connect to a server listening on a socket file or a localhost port
+    static int connectSocket(const std::string & file);
+    static int connectPort(int port);
+
+    // The number of requests and batches analyzed so far
+    unsigned long getNumRequests() const;
+    unsigned long getNumBatches() const;
+
+protected:
+
+    ModelHandle & handle_;
+    int threads_, batchSize_, deadline_, queueSize_;
+    int listenFd_;
+    std::string socketFile_;
+    ServerState * state_;
+
+    // The threads that read requests from a connection and analyze them
+    static void * connectionThread(void * arg);
+    static void * workerThread(void * arg);
+    void handleConnection(int fd);
+    void work();
+
+private:
+    KyteaServer(const KyteaServer & rhs);
+    KyteaServer & operator=(const KyteaServer & rhs);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef KYTEA_STATS_H__
+#define KYTEA_STATS_H__
+
+#include <iostream>
+
+namespace kytea {
+
+// Timings and counts of the stages of analysis, shared by the whole process.
+// They are only collected if KyTea was configured with --enable-stats, and
+// otherwise the KYTEA_STATS_* macros below do nothing
+class KyteaStats {
+
+public:
+
+    typedef enum {
+        TIME_READ, TIME_DECODE, TIME_WS_NGRAM, TIME_WS_DICT, TIME_WS_REFRESH,
+        TIME_TAG_KNOWN, TIME_TAG_UNKNOWN, TIME_WRITE, NUM_TIMERS
+    } Timer;
+    typedef enum {
+        COUNT_SENTENCES, COUNT_CHARS, COUNT_WORDS, COUNT_UNKNOWN_WORDS,
+        COUNT_DICT_MATCHES, COUNT_BEAM_TRUNCATIONS, NUM_COUNTERS
+    } Counter;
+
+    // Whether the library was built to collect statistics
+    static bool isEnabled();
+
+    // The current time in nanoseconds, and adding the time since start to
+    //  a timer
+    static unsigned long long now();
+    static void addTime(Timer timer, unsigned long long start);
+    static void count(Counter counter, unsigned long long n);
+
+    // Write one statistic per line as its name and value separated by a
+    //  tab, with times in seconds
+    static void write(std::ostream & out);
+    static void reset();
+
+};
+
+}
+
+// these need kytea/config.h to be included first
+#if ENABLE_STATS
+#define KYTEA_STATS_START(timer) const unsigned long long kyteaStats_##timer = kytea::KyteaStats::now()
+#define KYTEA_STATS_STOP(timer) kytea::KyteaStats::addTime(kytea::KyteaStats::timer, kyteaStats_##timer)
+#define KYTEA_STATS_COUNT(counter, n) kytea::KyteaStats::count(kytea::KyteaStats::counter, n)
+#else
+#define KYTEA_STATS_START(timer)
+#define KYTEA_STATS_STOP(timer)
+// the count is not evaluated, but local variables it uses are not unused
+#define KYTEA_STATS_COUNT(counter, n) ((void)sizeof(n))
+#endif
+
+#endif
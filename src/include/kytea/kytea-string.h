@@ -53,8 +53,10 @@ public:
             delete [] chars_;
     }
 
-    unsigned dec() { return --count_; }
-    unsigned inc() { return ++count_; }
+    // the count is shared by threads that copy the same string (such as
+    // the tags of a model), so it is changed atomically
+    unsigned dec() { return __sync_sub_and_fetch(&count_, 1); }
+    unsigned inc() { return __sync_add_and_fetch(&count_, 1); }
 
 };
 
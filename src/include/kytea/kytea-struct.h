@@ -55,6 +55,9 @@
 
 namespace kytea  {
 
+class ModelTagEntry;
+template <class Entry> class Dictionary;
+
 // Map equality checking function
 template <class T>
 void checkMapEqual(const KyteaStringMap<T> & a, const KyteaStringMap<T> & b) {
@@ -120,6 +123,22 @@ public:
 
 };
 
+// KyteaOffsets
+//  the words of a sentence as byte offsets into the line that was read,
+//  and the IDs of their best tags (see Kytea::getTagId)
+class KyteaOffsets {
+
+public:
+
+    std::vector<unsigned> begins, ends;
+    // numLevels IDs for each word, -1 if the word has no tag at a level
+    std::vector<int> tagIds;
+    int numLevels;
+
+    KyteaOffsets() : numLevels(0) { }
+
+};
+
 // KyteaSentence
 //  contains a single sentence with multiple words
 class KyteaSentence {
@@ -136,10 +155,30 @@ public:
     // the string of words
     Words words;
 
+    // dictionary words found in chars, as pairs of the position of their
+    // last character and their entry, the generation of the dictionary
+    // that was used (0 if none), and a copy of the characters they were
+    // found in (chars may be changed in place after the matches are found)
+    std::vector< std::pair<unsigned,ModelTagEntry*> > dictMatches;
+    unsigned dictMatchGeneration;
+    KyteaString dictMatchChars;
+    // the generation of the overlay dictionary that the word boundaries
+    // were calculated with (0 if none)
+    unsigned overlayGeneration;
+    // words of the overlay dictionary found in chars, kept in the same way
+    // as dictMatches
+    std::vector< std::pair<unsigned,ModelTagEntry*> > overlayMatches;
+    unsigned overlayMatchGeneration;
+    KyteaString overlayMatchChars;
+
+    // the byte after each character in the line that was read (only for
+    // raw input)
+    std::vector<unsigned> byteEnds;
+
     // constructors
-    KyteaSentence() : chars(), wsConfs(0) {
+    KyteaSentence() : chars(), wsConfs(0), dictMatchGeneration(0), overlayGeneration(0), overlayMatchGeneration(0) {
     }
-    KyteaSentence(const KyteaString & str) : chars(str), wsConfs(std::max(str.length(),(unsigned)1)-1,0) {
+    KyteaSentence(const KyteaString & str) : chars(str), wsConfs(std::max(str.length(),(unsigned)1)-1,0), dictMatchGeneration(0), overlayGeneration(0), overlayMatchGeneration(0) {
     }
 
     void refreshWS(double confidence) {
@@ -24,10 +24,30 @@
 #include "kytea/dictionary.h"
 #include "kytea/feature-io.h"
 #include "kytea/feature-lookup.h"
+#include "kytea/tag-cache.h"
+#include "kytea/lru-cache.h"
 
 namespace kytea  {
 
 class KyteaTest;
+class FeatureShards;
+
+// A user dictionary that is matched along with the model's dictionary. Its
+// words are in dictionary slot, and it is shared by the analyses that are
+// running when it is replaced, so it is deleted when the last one releases it
+class OverlayDictionary {
+public:
+    OverlayDictionary(Dictionary<ModelTagEntry> * d, int s, unsigned g) : dict(d), slot(s), generation(g), refs(1), maxLength(d->getMaxLength()) { }
+    ~OverlayDictionary() { delete dict; }
+
+    Dictionary<ModelTagEntry> * dict;
+    int slot;
+    // a new dictionary generation each time the overlay is replaced
+    unsigned generation;
+    int refs;
+    // the length of the longest word
+    unsigned maxLength;
+};
 
 // a class representing the main analyzer
 class Kytea {
@@ -35,28 +55,57 @@ class Kytea {
 private:
     friend class KyteaTest;
     typedef unsigned FeatureId;
-    typedef std::vector<KyteaSentence*> Sentences;
     typedef std::vector< std::vector< FeatureId > > SentenceFeatures;
 
     StringUtil* util_;
     KyteaConfig* config_;
     Dictionary<ModelTagEntry> * dict_;
-    Sentences sentences_;
+    // A number that is different for every dictionary built or read by the
+    // process, which marks the matches stored in sentences (a new dictionary
+    // can be allocated where a freed one was, so the pointer cannot be used)
+    unsigned dictGeneration_;
+
+    // The corpus that training sentences are currently being read from
+    unsigned corpusPos_;
+    CorpusIO * corpusIO_;
+    KyteaSentence * streamSent_;
+    // The annotated sentences of corpora that cannot be read twice (such as
+    // pipes), which are kept in memory instead, and the next one to use
+    std::vector<bool> keptCorpora_;
+    std::vector< std::vector<KyteaSentence*> > keptSents_;
+    unsigned keptPos_;
+    // The number of annotated sentences found by buildVocabulary, and the
+    // number read since the last call to resetSentences
+    unsigned numSents_, passSents_;
 
     // Values for the word segmentation models
     KyteaModel* wsModel_;
 
     Dictionary<ProbTagEntry>* subwordDict_;
     std::vector<KyteaLM*> subwordModels_;
+    // Tags that were already estimated for unknown words
+    TagCache * unkCache_;
+    // Sentences that were already analyzed
+    SentenceCache * sentCache_;
+    // The user dictionary, which is only accessed while holding overlayMutex_
+    OverlayDictionary * overlay_;
+    CacheMutex overlayMutex_;
 
     std::vector<KyteaModel*> globalMods_;
     std::vector< std::vector<KyteaString> > globalTags_;
+    // The IDs of the tags known to the model at each level
+    std::vector< KyteaStringMap<int> > tagIds_;
+    // The length of the longest word in the dictionary
+    unsigned maxWordLength_;
 
     std::vector<unsigned> dictFeats_;
     std::vector<KyteaString> charPrefixes_, typePrefixes_;
 
     FeatureIO fio_;
 
+    // A previously trained model to warm-start training from
+    Kytea * initModel_;
+
 public:
 
 ///////////////////////////////////////////////////////////////////
@@ -65,6 +114,8 @@ public:
 
     // Read a model from the file fileName. Character encoding,
     // settings, and other information will be read automatically.
+    // This replaces the model in place, so it must not be called while
+    // other threads are analyzing (use a ModelHandle to swap models)
     void readModel(const char* fileName);
 
     // Writes a model representing the current instance to the
@@ -81,6 +132,57 @@ public:
     // Calculate the unknown pronunciation for a single unknown word
     void calculateUnknownTag(KyteaWord & str, int lev);
 
+    // Calculate the word segmentation and all tags that are turned on for
+    //  a sentence. Results for raw sentences are cached if -sentcache is set
+    void analyzeSentence(KyteaSentence & sent);
+
+    // Analyze a sentence with the tag levels where doTags is true, instead
+    //  of the ones that are turned on in the configuration
+    void analyzeSentence(KyteaSentence & sent, const std::vector<bool> & doTags);
+
+    // Analyze a sentence that was read as raw text, giving the byte offsets
+    //  of its words and the IDs of their tags at levels where doTags is
+    //  true. If no tags are needed, no word objects are built
+    void analyzeOffsets(KyteaSentence & sent, const std::vector<bool> & doTags, KyteaOffsets & offsets);
+
+    // Update an analyzed sentence after deleting deleted characters at
+    //  offset and inserting inserted there. Only the boundaries whose
+    //  features changed are calculated again, and only the words near the
+    //  edit are tagged again
+    void reanalyzeSentence(KyteaSentence & sent, unsigned offset, unsigned deleted, const KyteaString & inserted);
+
+    // Analyze raw text read chunk bytes at a time, writing words as soon as
+    //  no more characters can change them, so very long lines are analyzed
+    //  in memory that depends on chunk and the longest word (a word must be
+    //  whole to be written). Each boundary is only scored again while new
+    //  characters can change it. The output is the same as analyzing whole
+    //  lines
+    void analyzeStream(RawCorpusIO & in, FullCorpusIO & out, unsigned chunk);
+
+    // Find only the word boundaries of a raw sentence, which are left in
+    //  wsConfs without building its words. If unknown is not null, whether
+    //  each word is unknown is written to it
+    void segmentSentence(KyteaSentence & sent, std::vector<char> * unknown = 0);
+
+    // The ID of a tag at level lev, its index in getTagCandidates after a
+    //  model is read (-1 for tags that the model does not know)
+    int getTagId(int lev, const KyteaString & tag) const;
+
+    // Load a user dictionary (in the same format as -dict) that is matched
+    //  in addition to the model's dictionary, where its words use the
+    //  weights of dictionary slot (starting at 0). This replaces any earlier
+    //  overlay, and may be called while other threads are analyzing
+    void loadOverlayDictionary(const std::string & file, int slot);
+    void clearOverlayDictionary();
+
+    // Get the weight (multiplied back to its unquantized value) of the most
+    //  important feature in each entry of the feature lookups of all models
+    void getFeatureWeights(std::vector<double> & weights);
+
+    // Remove every feature lookup entry where no weight is larger than
+    //  cutoff (after multiplying back), returning the number removed
+    unsigned pruneFeatures(double cutoff);
+
     // Get the string utility class that allows you to map to/from
     //  Kyteas internal string representation (using 
     //  mapString/showString)
@@ -104,7 +206,10 @@ public:
     void init() { 
         util_ = config_->getStringUtil();
         // dict_ = new Dictionary(util_);
-        dict_ = 0; wsModel_ = 0; subwordDict_ = 0;
+        dict_ = 0; dictGeneration_ = 0; wsModel_ = 0; subwordDict_ = 0; initModel_ = 0; unkCache_ = 0; sentCache_ = 0;
+        overlay_ = 0; maxWordLength_ = 0;
+        corpusPos_ = 0; corpusIO_ = 0; streamSent_ = 0;
+        keptPos_ = 0; numSents_ = 0; passSents_ = 0;
     }
 
     Kytea() : config_(new KyteaConfig()) { init(); }
@@ -115,17 +220,31 @@ public:
         if(subwordDict_) delete subwordDict_;
         if(wsModel_) delete wsModel_;
         if(config_) delete config_;
+        if(initModel_) delete initModel_;
+        if(unkCache_) delete unkCache_;
+        if(sentCache_) delete sentCache_;
+        if(overlay_) delete overlay_;
         for(int i = 0; i < (int)subwordModels_.size(); i++) {
             if(subwordModels_[i] != 0) delete subwordModels_[i];
         }
         for(int i = 0; i < (int)globalMods_.size(); i++)
             if(globalMods_[i] != 0) delete globalMods_[i];
-        for(Sentences::iterator it = sentences_.begin(); it != sentences_.end(); it++)
-            delete *it;
-        
+        if(corpusIO_) delete corpusIO_;
+        if(streamSent_) delete streamSent_;
+        clearKeptSentences();
     }
 
     KyteaModel* getWSModel() { return wsModel_; }
+    KyteaModel* getGlobalModel(int lev) { return (lev < (int)globalMods_.size() ? globalMods_[lev] : 0); }
+
+    // Get every tag at level lev that is known to the model (the tags of
+    //  the global model and the dictionary), in the order first found
+    void getTagCandidates(int lev, std::vector<KyteaString> & tags) const;
+
+    // The caches of unknown word tags and analyzed sentences (0 if no
+    //  model has been read, or the sentence cache is disabled)
+    const TagCache* getUnkCache() const { return unkCache_; }
+    const SentenceCache* getSentenceCache() const { return sentCache_; }
 
     // Set the word segmentation model and take control of it
     void setWSModel(KyteaModel* model) { wsModel_ = model; }
@@ -149,6 +268,14 @@ private:
 
     // functions to create dictionaries
     void buildVocabulary();
+
+    // functions to read the training sentences from the corpora again for
+    // each training stage. nextSentence() returns 0 at the end, and the
+    // sentence it returns is deleted on the next call
+    void resetSentences();
+    KyteaSentence * nextSentence();
+    void clearKeptSentences();
+    FeatureShards * makeShards();
     
     // a function that checks to make sure that configuration is correct before
     //  training
@@ -171,6 +298,56 @@ private:
     // { <x_1, y_1>, <x_2, y_2> }
     // where x is the dictionary and y is the tag that exists in the dicitonary
     std::vector<std::pair<int,int> > getDictionaryMatches(const KyteaString & str, int lev);
+    std::vector<std::pair<int,int> > getDictionaryMatches(const ModelTagEntry * ent, int lev);
+
+    // Match the dictionary against the sentence, reusing the matches that
+    // are already stored in the sentence if they came from this dictionary
+    const Dictionary<ModelTagEntry>::MatchResult & getSentenceMatches(KyteaSentence & sent);
+    // Match the overlay dictionary (or none) against the sentence in the
+    // same way
+    const Dictionary<ModelTagEntry>::MatchResult & getOverlayMatches(KyteaSentence & sent, const OverlayDictionary * overlay);
+    // Find the entry for the word of length len whose last character is at
+    // position end, using the matches stored in the sentence
+    ModelTagEntry * findMatchedEntry(const Dictionary<ModelTagEntry>::MatchResult & matches, unsigned end, unsigned len);
+
+    // Get a reference to the overlay dictionary (or 0), which must be
+    // released after the analysis that uses it
+    OverlayDictionary * acquireOverlay();
+    void releaseOverlay(OverlayDictionary * overlay);
+
+    // Hold a reference to the overlay dictionary until release() is called
+    // or the holder goes out of scope, so that it is also released when an
+    // analysis throws an error
+    class OverlayHolder {
+    public:
+        OverlayHolder(Kytea & kytea) : kytea_(kytea), overlay_(kytea.acquireOverlay()), held_(true) { }
+        ~OverlayHolder() { release(); }
+
+        // Take a reference to the current overlay if none is held
+        void acquire() {
+            if(!held_) { overlay_ = kytea_.acquireOverlay(); held_ = true; }
+        }
+        void release() {
+            if(held_) { kytea_.releaseOverlay(overlay_); overlay_ = 0; held_ = false; }
+        }
+        const OverlayDictionary * get() const { return overlay_; }
+
+    private:
+        OverlayHolder(const OverlayHolder & rhs);
+        OverlayHolder & operator=(const OverlayHolder & rhs);
+        Kytea & kytea_;
+        OverlayDictionary * overlay_;
+        bool held_;
+    };
+
+    void calculateWS(KyteaSentence & sent, const OverlayDictionary * overlay);
+    // Tag the words from firstWord up to (but not including) endWord
+    void calculateTags(KyteaSentence & sent, int lev, const OverlayDictionary * overlay, unsigned firstWord = 0, unsigned endWord = (unsigned)-1);
+    // Calculate the word boundary confidences without building the words,
+    //  leaving the matches of the overlay in the sentence
+    void calculateWSConfs(KyteaSentence & sent, const OverlayDictionary * overlay);
+    // Give IDs to the tags known to the model
+    void buildTagIds();
 
 
     template <class Entry>
@@ -178,11 +355,17 @@ private:
     template <class Entry>
     void addTag(typename Dictionary<Entry>::WordMap& allWords, const KyteaString & word, const KyteaTag * tag, int dict);
     template <class Entry>
-    void scanDictionaries(const std::vector<std::string> & dict, typename Dictionary<Entry>::WordMap & wordMap, KyteaConfig * config, StringUtil * util, bool saveIds = true);
+    void scanDictionaries(const std::vector<std::string> & dict, typename Dictionary<Entry>::WordMap & wordMap, KyteaConfig * config, StringUtil * util, bool saveIds = true, int firstDict = 0);
+
+    // functions for warm-starting training from an existing model
+    void loadInitModel();
+    const ModelWeights * getInitWeights(const KyteaModel * oldMod, const std::vector<KyteaString> * oldTags, const std::vector<KyteaString> * newTags, ModelWeights & ret);
 
     // functions for unknown word PE
     void trainUnk(int lev);
     void buildFeatureLookups();
+    // Get all the models that have a feature lookup
+    std::vector<KyteaModel*> getLookupModels();
 
     void analyzeInput();
     
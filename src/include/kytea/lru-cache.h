@@ -0,0 +1,133 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef LRU_CACHE_H__
+#define LRU_CACHE_H__
+
+#include "kytea/kytea-struct.h"
+#include <list>
+#include <vector>
+#include <cstddef>
+
+namespace kytea {
+
+// Copy values so they do not share memory with the originals (all of the
+// fields of a sentence are copied)
+void copyCacheValue(const KyteaString & from, KyteaString & to);
+void copyCacheValue(const std::vector<KyteaTag> & from, std::vector<KyteaTag> & to);
+void copyCacheValue(const KyteaSentence & from, KyteaSentence & to);
+
+// The approximate number of bytes used by a value
+size_t cacheValueSize(const KyteaString & val);
+size_t cacheValueSize(const std::vector<KyteaTag> & val);
+size_t cacheValueSize(const KyteaSentence & val);
+
+// A mutex that is used when threads are supported
+class CacheMutex {
+public:
+    CacheMutex();
+    ~CacheMutex();
+    void lock();
+    void unlock();
+private:
+    void * mutex_;
+};
+
+// A cache of values keyed by strings, which drops the least recently used
+// entries when it has more than maxEntries entries or uses more than
+// maxBytes bytes (0 for no limit on the size). The cache is locked so it
+// can be shared between threads, and keys and values are copied in and out
+// so that callers changing their strings in place do not change it
+template <class Value>
+class LruCache {
+
+public:
+
+    LruCache(unsigned maxEntries, size_t maxBytes = 0) : 
+        maxEntries_(maxEntries), maxBytes_(maxBytes), bytes_(0), hits_(0), misses_(0) { }
+
+    // Find the value for a key, returning false if it is not cached
+    bool find(const KyteaString & key, Value & val) {
+        mutex_.lock();
+        typename Index::iterator it = index_.find(key);
+        bool found = (it != index_.end());
+        if(found) {
+            hits_++;
+            // move the entry to the front
+            entries_.splice(entries_.begin(), entries_, it->second);
+            copyCacheValue(it->second->val, val);
+        } else
+            misses_++;
+        mutex_.unlock();
+        return found;
+    }
+
+    // Add the value for a key
+    void add(const KyteaString & key, const Value & val) {
+        if(maxEntries_ == 0)
+            return;
+        mutex_.lock();
+        if(index_.find(key) == index_.end()) {
+            entries_.push_front(Entry());
+            Entry & entry = entries_.front();
+            copyCacheValue(key, entry.key);
+            copyCacheValue(val, entry.val);
+            entry.bytes = cacheValueSize(entry.key)+cacheValueSize(entry.val);
+            bytes_ += entry.bytes;
+            index_.insert(std::pair<KyteaString,typename EntryList::iterator>(entry.key, entries_.begin()));
+            // remove the least recently used entries
+            while(entries_.size() > maxEntries_ || (maxBytes_ && bytes_ > maxBytes_)) {
+                bytes_ -= entries_.back().bytes;
+                index_.erase(entries_.back().key);
+                entries_.pop_back();
+            }
+        }
+        mutex_.unlock();
+    }
+
+    unsigned getMaxEntries() const { return maxEntries_; }
+    size_t getMaxBytes() const { return maxBytes_; }
+    size_t getBytes() const { return bytes_; }
+    size_t size() const { return entries_.size(); }
+    unsigned long getHits() const { return hits_; }
+    unsigned long getMisses() const { return misses_; }
+
+protected:
+
+    class Entry {
+    public:
+        KyteaString key;
+        Value val;
+        size_t bytes;
+    };
+    typedef std::list<Entry> EntryList;
+    typedef KyteaStringMap<typename EntryList::iterator> Index;
+
+    unsigned maxEntries_;
+    size_t maxBytes_, bytes_;
+    unsigned long hits_, misses_;
+    // the entries in order of use, most recent first
+    EntryList entries_;
+    Index index_;
+    CacheMutex mutex_;
+
+};
+
+typedef LruCache<KyteaSentence> SentenceCache;
+
+}
+
+#endif
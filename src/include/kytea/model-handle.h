@@ -0,0 +1,102 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef MODEL_HANDLE_H__
+#define MODEL_HANDLE_H__
+
+#include "kytea/lru-cache.h"
+#include <string>
+
+namespace kytea {
+
+class Kytea;
+class KyteaConfig;
+
+// An analyzer that is published by a ModelHandle, along with the number of
+// leases that are still using it
+class PublishedModel {
+public:
+    PublishedModel(Kytea * k, unsigned g) : kytea(k), generation(g), refs(1) { }
+    ~PublishedModel();
+
+    Kytea * kytea;
+    // the number of models published by the handle, including this one
+    unsigned generation;
+    int refs;
+};
+
+// A handle to the model that is currently being used for analysis by a
+// long-running program. A new model can be read while other threads are
+// analyzing, then swapped in without stopping them. Analyses that started
+// before the swap keep using the old model, which is freed when the last of
+// them finishes
+class ModelHandle {
+
+public:
+
+    // Hold on to the current model for as long as the lease exists. Strings
+    // must be mapped with the lease's own StringUtil, as each model has one.
+    // Threads holding leases on the same model can analyze with it at the
+    // same time, but must not train it or change its settings
+    class Lease {
+    public:
+        Lease(ModelHandle & handle) : handle_(handle), model_(handle.acquire()) { }
+        ~Lease() { handle_.release(model_); }
+
+        Kytea * get() const { return (model_ ? model_->kytea : 0); }
+        Kytea * operator->() const { return get(); }
+        unsigned getGeneration() const { return (model_ ? model_->generation : 0); }
+
+    private:
+        Lease(const Lease & rhs);
+        Lease & operator=(const Lease & rhs);
+        ModelHandle & handle_;
+        PublishedModel * model_;
+    };
+
+    ModelHandle() : model_(0), generation_(0) { }
+    ~ModelHandle();
+
+    // Read a model from file in the calling thread and publish it. The new
+    //  analyzer takes ownership of config, and a default configuration is
+    //  used if it is null. If the configuration has an overlay dictionary,
+    //  it is loaded into the new model before it is published
+    void loadModel(const std::string & file, KyteaConfig * config = 0);
+
+    // Publish an analyzer that has already been read, taking ownership of it
+    void publish(Kytea * kytea);
+
+    // The number of models that have been published
+    unsigned getGeneration();
+
+protected:
+
+    PublishedModel * acquire();
+    void release(PublishedModel * model);
+
+    PublishedModel * model_;
+    unsigned generation_;
+    CacheMutex mutex_;
+
+private:
+    ModelHandle(const ModelHandle & rhs);
+    ModelHandle & operator=(const ModelHandle & rhs);
+
+};
+
+}
+
+#endif
@@ -31,9 +31,11 @@
 
 
 #if DISABLE_QUANTIZE
-#   define MODEL_IO_VERSION "0.4.0NQ"
+#   define MODEL_IO_VERSION "0.4.3NQ"
+#elif QUANTIZE_8BIT
+#   define MODEL_IO_VERSION "0.4.3Q8"
 #else
-#   define MODEL_IO_VERSION "0.4.0"
+#   define MODEL_IO_VERSION "0.4.3"
 #endif
 
 namespace kytea {
@@ -116,21 +118,28 @@ public:
         }
         // write the states
         *str_ << (unsigned)dict->getNumDicts() << std::endl;
-        const std::vector<DictionaryState*> & states = dict->getStates();
-        *str_ << states.size() << std::endl;
-        if(states.size() == 0)
+        const unsigned numStates = dict->getNumStates();
+        *str_ << numStates << std::endl;
+        if(numStates == 0)
             return;
-        for(unsigned i = 0; i < states.size(); i++) {
-            *str_ << states[i]->failure;
-            for(unsigned j = 0; j < states[i]->gotos.size(); j++)
-                *str_ << " " << util_->showChar(states[i]->gotos[j].first) << " " << states[i]->gotos[j].second;
+        const std::vector<unsigned> & gotoStarts = dict->getGotoStarts(), & outputStarts = dict->getOutputStarts(), & outputs = dict->getOutputs();
+        const typename Dictionary<Entry>::Gotos & gotos = dict->getGotos();
+        for(unsigned i = 0; i < numStates; i++) {
+            *str_ << dict->getFailures()[i];
+            for(unsigned j = gotoStarts[i]; j < gotoStarts[i+1]; j++)
+                *str_ << " " << util_->showChar(gotos[j].first) << " " << gotos[j].second;
             *str_ << std::endl;
-            for(unsigned j = 0; j < states[i]->output.size(); j++) {
-                if(j!=0) *str_ << " ";
-                *str_ << states[i]->output[j];
+            for(unsigned j = outputStarts[i]; j < outputStarts[i+1]; j++) {
+                if(j!=outputStarts[i]) *str_ << " ";
+                *str_ << outputs[j];
             }
             *str_ << std::endl;
-            *str_ << (states[i]->isBranch?'b':'n') << std::endl;
+            // dense states are marked in upper case
+            const unsigned char flags = dict->getFlags()[i];
+            if(flags & DICTIONARY_DENSE)
+                *str_ << (flags & DICTIONARY_BRANCH?'B':'N') << std::endl;
+            else
+                *str_ << (flags & DICTIONARY_BRANCH?'b':'n') << std::endl;
         }
         // write the entries
         const std::vector<Entry*> & entries = dict->getEntries();
@@ -164,38 +173,50 @@ public:
         std::getline(*str_, line);
         dict->setNumDicts(util_->parseInt(line.c_str()));
         // get the states
-        std::vector<DictionaryState*> & states = dict->getStates();
         getline(*str_, line);
-        states.resize(util_->parseInt(line.c_str()));
-        if(states.size() == 0) {
+        const unsigned numStates = util_->parseInt(line.c_str());
+        if(numStates == 0) {
             delete dict;
             return 0;
         }
-        for(unsigned i = 0; i < states.size(); i++) {
-            DictionaryState * state = new DictionaryState();
+        std::vector<unsigned> & failures = dict->getFailures(), & gotoStarts = dict->getGotoStarts(),
+                              & outputStarts = dict->getOutputStarts(), & outputs = dict->getOutputs();
+        std::vector<unsigned char> & flags = dict->getFlags();
+        typename Dictionary<Entry>::Gotos & gotos = dict->getGotos();
+        failures.reserve(numStates);
+        flags.reserve(numStates);
+        gotoStarts.reserve(numStates+1);
+        outputStarts.reserve(numStates+1);
+        for(unsigned i = 0; i < numStates; i++) {
             getline(*str_, line);
             std::istringstream iss(line);
             iss >> buff;
-            state->failure = util_->parseInt(buff.c_str());
+            failures.push_back(util_->parseInt(buff.c_str()));
+            gotoStarts.push_back(gotos.size());
             while(iss >> buff) {
                 std::pair<KyteaChar,unsigned> p;
                 p.first = util_->mapChar(buff.c_str());
                 if(!(iss >> buff))
                     THROW_ERROR("Badly formed model (goto character without a destination)");
                 p.second = util_->parseInt(buff.c_str());
-                state->gotos.push_back(p);
+                gotos.push_back(p);
             }
-            sort(state->gotos.begin(), state->gotos.end());
+            sort(gotos.begin()+gotoStarts.back(), gotos.end());
             getline(*str_, line);
             std::istringstream iss2(line);
+            outputStarts.push_back(outputs.size());
             while(iss2 >> buff)
-                state->output.push_back(util_->parseInt(buff.c_str()));
+                outputs.push_back(util_->parseInt(buff.c_str()));
             getline(*str_, line);
             if(line.length() != 1)
                 THROW_ERROR("Badly formed model (branch indicator not found)");
-            state->isBranch = (line[0] == 'b');
-            states[i] = state;
+            if(line[0] != 'b' && line[0] != 'n' && line[0] != 'B' && line[0] != 'N')
+                THROW_ERROR("Badly formed model (unknown branch indicator '"<<line<<"')");
+            flags.push_back((line[0] == 'b' || line[0] == 'B' ? DICTIONARY_BRANCH : 0) |
+                            (line[0] == 'B' || line[0] == 'N' ? DICTIONARY_DENSE : 0));
         }
+        gotoStarts.push_back(gotos.size());
+        outputStarts.push_back(outputs.size());
         // get the entries
         std::vector<Entry*> & entries = dict->getEntries();
         getline(*str_, line);
@@ -203,6 +224,8 @@ public:
         for(unsigned i = 0; i < entries.size(); i++) {
             entries[i] = readEntry<Entry>();
         }
+        dict->checkStates();
+        dict->buildLookupTables();
         return dict;
     }
 
@@ -242,22 +265,29 @@ public:
         if(dict->getNumDicts() > 8)
             THROW_ERROR("Only 8 dictionaries may be stored in a binary file.");
         writeBinary(dict->getNumDicts());
-        // write the states
-        const std::vector<DictionaryState*> & states = dict->getStates();
-        writeBinary((uint32_t)states.size());
-        for(unsigned i = 0; i < states.size(); i++) {
-            const DictionaryState * state = states[i];
-            writeBinary((uint32_t)state->failure);
-            writeBinary((uint32_t)state->gotos.size());
-            for(unsigned j = 0; j < state->gotos.size(); j++) {
-                writeBinary((KyteaChar)state->gotos[j].first);
-                writeBinary((uint32_t)state->gotos[j].second);
-            }
-            writeBinary((uint32_t)state->output.size());
-            for(unsigned j = 0; j < state->output.size(); j++) 
-                writeBinary((uint32_t)state->output[j]);
-            writeBinary(state->isBranch);
+        // write the states, each array as a whole
+        const unsigned numStates = dict->getNumStates();
+        writeBinary((uint32_t)numStates);
+        if(numStates == 0)
+            return;
+        const std::vector<unsigned> & failures = dict->getFailures(), & gotoStarts = dict->getGotoStarts(),
+                                    & outputStarts = dict->getOutputStarts(), & outputs = dict->getOutputs();
+        const std::vector<unsigned char> & flags = dict->getFlags();
+        const typename Dictionary<Entry>::Gotos & gotos = dict->getGotos();
+        for(unsigned i = 0; i < numStates; i++)
+            writeBinary((uint32_t)failures[i]);
+        for(unsigned i = 0; i < numStates; i++)
+            writeBinary(flags[i]);
+        for(unsigned i = 0; i <= numStates; i++)
+            writeBinary((uint32_t)gotoStarts[i]);
+        for(unsigned i = 0; i < gotos.size(); i++) {
+            writeBinary((KyteaChar)gotos[i].first);
+            writeBinary((uint32_t)gotos[i].second);
         }
+        for(unsigned i = 0; i <= numStates; i++)
+            writeBinary((uint32_t)outputStarts[i]);
+        for(unsigned i = 0; i < outputs.size(); i++)
+            writeBinary((uint32_t)outputs[i]);
         // write the entries
         const std::vector<Entry*> & entries = dict->getEntries();
         writeBinary((uint32_t)entries.size());
@@ -281,6 +311,21 @@ public:
     template <class Entry>
     Entry * readEntry();
 
+    // Check that the rest of the stream can hold count items of at least
+    // itemSize bytes before space is allocated for them
+    void checkCount(uint64_t count, unsigned itemSize) {
+        if(!*str_)
+            THROW_ERROR("Badly formed model (unexpected end of file)");
+        const std::streampos pos = str_->tellg();
+        if(pos == std::streampos(-1))
+            return;
+        str_->seekg(0, std::ios::end);
+        const std::streampos end = str_->tellg();
+        str_->seekg(pos);
+        if(count*itemSize > (uint64_t)(end-pos))
+            THROW_ERROR("Badly formed model (count of "<<count<<" is larger than the rest of the file)");
+    }
+
     template <class Entry>
     Dictionary<Entry> * readDictionary() {
         Dictionary<Entry> * dict = new Dictionary<Entry>(util_);
@@ -289,31 +334,48 @@ public:
         unsigned numDicts = readBinary<unsigned char>();
         dict->setNumDicts(numDicts);
         // get the states
-        std::vector<DictionaryState*> & states = dict->getStates();
-        states.resize(readBinary<uint32_t>());
-        if(states.size() == 0) {
+        const unsigned numStates = readBinary<uint32_t>();
+        if(numStates == 0) {
             delete dict;
             return 0;
         }
-        for(unsigned i = 0; i < states.size(); i++) {
-            DictionaryState * state = new DictionaryState();
-            state->failure = readBinary<uint32_t>();
-            state->gotos.resize(readBinary<uint32_t>());
-            for(unsigned j = 0; j < state->gotos.size(); j++) {
-                state->gotos[j].first = readBinary<KyteaChar>();
-                state->gotos[j].second = readBinary<uint32_t>();
-            }
-            state->output.resize(readBinary<uint32_t>());
-            for(unsigned j = 0; j < state->output.size(); j++) 
-                state->output[j] = readBinary<uint32_t>();
-            state->isBranch = readBinary<bool>();
-            states[i] = state;
+        // each state takes a failure, a flag, and two offsets
+        checkCount(numStates, 2*sizeof(uint32_t)+1+2*sizeof(uint32_t));
+        std::vector<unsigned> & failures = dict->getFailures(), & gotoStarts = dict->getGotoStarts(),
+                              & outputStarts = dict->getOutputStarts(), & outputs = dict->getOutputs();
+        std::vector<unsigned char> & flags = dict->getFlags();
+        typename Dictionary<Entry>::Gotos & gotos = dict->getGotos();
+        failures.resize(numStates);
+        for(unsigned i = 0; i < numStates; i++)
+            failures[i] = readBinary<uint32_t>();
+        flags.resize(numStates);
+        for(unsigned i = 0; i < numStates; i++)
+            flags[i] = readBinary<unsigned char>();
+        gotoStarts.resize(numStates+1);
+        for(unsigned i = 0; i <= numStates; i++)
+            gotoStarts[i] = readBinary<uint32_t>();
+        checkCount(gotoStarts[numStates], sizeof(KyteaChar)+sizeof(uint32_t));
+        gotos.resize(gotoStarts[numStates]);
+        for(unsigned i = 0; i < gotos.size(); i++) {
+            gotos[i].first = readBinary<KyteaChar>();
+            gotos[i].second = readBinary<uint32_t>();
         }
+        outputStarts.resize(numStates+1);
+        for(unsigned i = 0; i <= numStates; i++)
+            outputStarts[i] = readBinary<uint32_t>();
+        checkCount(outputStarts[numStates], sizeof(uint32_t));
+        outputs.resize(outputStarts[numStates]);
+        for(unsigned i = 0; i < outputs.size(); i++)
+            outputs[i] = readBinary<uint32_t>();
         // get the entries
         std::vector<Entry*> & entries = dict->getEntries();
-        entries.resize(readBinary<uint32_t>());
-        for(unsigned i = 0; i < entries.size(); i++) 
+        const unsigned numEntries = readBinary<uint32_t>();
+        checkCount(numEntries, 1);
+        entries.resize(numEntries);
+        for(unsigned i = 0; i < entries.size(); i++)
             entries[i] = readEntry<Entry>();
+        dict->checkStates();
+        dict->buildLookupTables();
         return dict;
     }
 
@@ -0,0 +1,69 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef ONLINE_LEARNER_H__
+#define ONLINE_LEARNER_H__
+
+#include "kytea/kytea-model.h"
+#include <vector>
+
+namespace kytea {
+
+// A classifier that is trained one example at a time, so the training data
+// never has to be held in memory. The learned weights are stored in a
+// KyteaModel, which must be the model that the feature ids came from
+class OnlineLearner {
+
+public:
+
+    typedef enum { PERCEPTRON = 0, ADAGRAD = 1 } Algorithm;
+
+    OnlineLearner(int alg, double bias) : alg_(alg), bias_(bias), count_(1) { }
+
+    // Update the weights using a single example
+    void update(const std::vector<unsigned> & feat, int label);
+
+    // Set the learned weights in the model (nothing is done if no examples
+    // have been seen)
+    void finish(KyteaModel & model) const;
+
+    const std::vector<int> & getLabels() const { return labels_; }
+
+protected:
+
+    // Calculate the score of class k
+    double score(int k, const std::vector<unsigned> & feat) const;
+    // Add val*feat to the weights of class k
+    void addWeights(int k, const std::vector<unsigned> & feat, double val);
+
+    int alg_;
+    double bias_;
+    // the number of examples seen so far (+1)
+    double count_;
+    // labels in the order they were first seen
+    std::vector<int> labels_;
+    // the weights for each class, indexed by feature id (0 is the bias)
+    std::vector< std::vector<double> > weights_;
+    // for the perceptron, the sum of updates times the example count, which
+    // is used to calculate the averaged weights. for AdaGrad, the sum of
+    // squared gradients
+    std::vector< std::vector<double> > sums_;
+
+};
+
+}
+
+#endif
@@ -26,6 +26,8 @@
 
 namespace kytea {
 
+class CacheMutex;
+
 // a class for turning std::strings into internal representation
 class StringUtil {
 
@@ -63,8 +65,13 @@ public:
         return buff.str();
     }
 
-    // map an unparsed std::string to a KyteaString
-    virtual KyteaString mapString(const std::string & str) = 0;
+    // map an unparsed std::string to a KyteaString, also finding the byte
+    // after each character if byteEnds is not null
+    virtual KyteaString mapString(const std::string & str, std::vector<unsigned> * byteEnds) = 0;
+    KyteaString mapString(const std::string & str) { return mapString(str, 0); }
+
+    // the number of bytes in a character that starts with the byte first
+    virtual unsigned getCharLength(char first) = 0;
 
     // get the type of a character
     virtual CharType findType(const std::string & str) = 0;
@@ -127,21 +134,26 @@ private:
 
     // variables
     StringCharMap charIds_;
-    std::vector<std::string> charNames_;
-    std::vector<CharType> charTypes_;
+    // the names and types of characters, in pages that are allocated when
+    // they are first needed and never move
+    std::vector<std::string*> charNames_;
+    std::vector<CharType*> charTypes_;
+    unsigned numChars_;
+    // the IDs of characters by code point, which are read without locking
+    // (0 if the character has not been seen)
+    std::vector<KyteaChar> codeIds_;
+    // new characters are added while locked, and existing characters can
+    // be read at the same time, so threads can analyze with the same model
+    CacheMutex * mutex_;
+
+    // add a character with the next ID, and remove all characters
+    KyteaChar addChar(const std::string & str, CharType type);
+    void clearChars();
 
 public:
 
-    StringUtilUtf8() : charIds_(), charNames_(), charTypes_() {
-        const char * initial[7] = { "", "K", "T", "H", "R", "D", "O" };
-        for(unsigned i = 0; i < 7; i++) {
-            charIds_.insert(std::pair<std::string,KyteaChar>(initial[i], i));
-            charTypes_.push_back(i==0?6:4); // first is other, rest romaji
-            charNames_.push_back(initial[i]);
-        }
-    }
-
-    ~StringUtilUtf8() { }
+    StringUtilUtf8();
+    ~StringUtilUtf8();
     
     // map a std::string to a character
     KyteaChar mapChar(const std::string & str, bool add = true);
@@ -150,7 +162,9 @@ public:
     CharType findType(KyteaChar c);
 
     bool badu(char val) { return ((val ^ maskl1) & maskl2); }
-    KyteaString mapString(const std::string & str);
+    KyteaString mapString(const std::string & str, std::vector<unsigned> * byteEnds);
+    using StringUtil::mapString;
+    unsigned getCharLength(char first);
 
     // find the type of a unicode character
     CharType findType(const std::string & str);
@@ -158,7 +172,7 @@ public:
     Encoding getEncoding() { return ENCODING_UTF8; }
     const char* getEncodingString() { return "utf8"; }
 
-    const std::vector<std::string> & getCharNames() { return charNames_; }
+    std::vector<std::string> getCharNames() const;
 
     // transform to or from a character std::string
     void unserialize(const std::string & str);
@@ -181,7 +195,9 @@ public:
     std::string showChar(KyteaChar c);
     
     // map an unparsed std::string to a KyteaString
-    KyteaString mapString(const std::string & str);
+    KyteaString mapString(const std::string & str, std::vector<unsigned> * byteEnds);
+    using StringUtil::mapString;
+    unsigned getCharLength(char first);
 
     // get the type of a character
     CharType findType(const std::string & str);
@@ -212,7 +228,9 @@ public:
     std::string showChar(KyteaChar c);
     
     // map an unparsed std::string to a KyteaString
-    KyteaString mapString(const std::string & str);
+    KyteaString mapString(const std::string & str, std::vector<unsigned> * byteEnds);
+    using StringUtil::mapString;
+    unsigned getCharLength(char first);
 
     // get the type of a character
     CharType findType(const std::string & str);
@@ -0,0 +1,52 @@
+/*
+* Copyright 2009, KyTea Development Team
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef TAG_CACHE_H__
+#define TAG_CACHE_H__
+
+#include "kytea/lru-cache.h"
+#include <vector>
+
+namespace kytea {
+
+// A bounded cache of the tag candidates estimated for unknown words, keyed
+// by the surface form and tag level. The least recently used entries are
+// dropped when the cache is full
+class TagCache {
+
+public:
+
+    TagCache(unsigned maxSize) : cache_(maxSize) { }
+
+    // Find the tags for a word, returning false if they are not cached
+    bool find(const KyteaString & surf, int lev, std::vector<KyteaTag> & tags);
+
+    // Add the tags for a word
+    void add(const KyteaString & surf, int lev, const std::vector<KyteaTag> & tags);
+
+    unsigned getMaxSize() const { return cache_.getMaxEntries(); }
+    unsigned long getHits() const { return cache_.getHits(); }
+    unsigned long getMisses() const { return cache_.getMisses(); }
+
+protected:
+
+    LruCache< std::vector<KyteaTag> > cache_;
+
+};
+
+}
+
+#endif
@@ -17,6 +17,7 @@
 #include <kytea/corpus-io.h>
 #include <cmath>
 #include "config.h"
+#include <kytea/kytea-stats.h>
 
 #define PROB_TRUE    100.0
 #define PROB_FALSE   -100.0
@@ -30,6 +31,7 @@ CorpusIO * CorpusIO::createIO(const char* file, Format form, const KyteaConfig &
     else if(form == CORP_FORMAT_PART) { return new PartCorpusIO(util,file,output,conf.getUnkBound(),conf.getSkipBound(),conf.getNoBound(),conf.getHasBound(),conf.getTagBound(),conf.getElemBound(),conf.getEscape()); }
     else if(form == CORP_FORMAT_PROB) { return new ProbCorpusIO(util,file,output,conf.getWordBound(),conf.getTagBound(),conf.getElemBound(),conf.getEscape()); }
     else if(form == CORP_FORMAT_RAW)  { return new RawCorpusIO(util,file,output);  }
+    else if(form == CORP_FORMAT_OFFSET) { return new OffsetCorpusIO(util,file,output,conf.getWordBound(),conf.getTagBound()); }
     else
         THROW_ERROR("Illegal Output Format");
 }
@@ -39,6 +41,7 @@ CorpusIO * CorpusIO::createIO(iostream & file, Format form, const KyteaConfig &
     else if(form == CORP_FORMAT_PART) { return new PartCorpusIO(util,file,output,conf.getUnkBound(),conf.getSkipBound(),conf.getNoBound(),conf.getHasBound(),conf.getTagBound(),conf.getElemBound(),conf.getEscape()); }
     else if(form == CORP_FORMAT_PROB) { return new ProbCorpusIO(util,file,output,conf.getWordBound(),conf.getTagBound(),conf.getElemBound(),conf.getEscape()); }
     else if(form == CORP_FORMAT_RAW)  { return new RawCorpusIO(util,file,output);  }
+    else if(form == CORP_FORMAT_OFFSET) { return new OffsetCorpusIO(util,file,output,conf.getWordBound(),conf.getTagBound()); }
     else 
         THROW_ERROR("Illegal Output Format");
 }
@@ -50,12 +53,16 @@ KyteaSentence * FullCorpusIO::readSentence() {
         THROW_ERROR("Attempted to read a sentence from an closed or output object");
 #endif
     string s;
+    KYTEA_STATS_START(TIME_READ);
     getline(*str_, s);
+    KYTEA_STATS_STOP(TIME_READ);
     if(str_->eof())
         return 0;
 
     KyteaChar spaceChar = bounds_[0], slashChar = bounds_[1], ampChar = bounds_[2], bsChar = bounds_[3];
+    KYTEA_STATS_START(TIME_DECODE);
     KyteaString ks = util_->mapString(s), buff(ks.length());
+    KYTEA_STATS_STOP(TIME_DECODE);
     int len = ks.length();
     KyteaSentence * ret = new KyteaSentence();
     int charLen = 0;
@@ -121,9 +128,13 @@ KyteaSentence * FullCorpusIO::readSentence() {
 }
 
 void FullCorpusIO::writeSentence(const KyteaSentence * sent, double conf) {
+    writeWords(sent, 0, false, true);
+}
+
+void FullCorpusIO::writeWords(const KyteaSentence * sent, unsigned firstWord, bool continued, bool lineEnd) {
     const string & wb = util_->showChar(bounds_[0]), tb = util_->showChar(bounds_[1]), eb = util_->showChar(bounds_[2]);
-    for(unsigned i = 0; i < sent->words.size(); i++) {
-        if(i != 0) *str_ << wb;
+    for(unsigned i = firstWord; i < sent->words.size(); i++) {
+        if(i != firstWord || continued) *str_ << wb;
         const KyteaWord & w = sent->words[i];
         *str_ << util_->showString(w.surf);
         for(int j = 0; j < w.getNumTags(); j++) {
@@ -138,6 +149,24 @@ void FullCorpusIO::writeSentence(const KyteaSentence * sent, double conf) {
         if(w.getUnknown())
             *str_ << unkTag_;
     }
+    if(lineEnd)
+        *str_ << endl;
+}
+
+void FullCorpusIO::writeBoundaries(const KyteaSentence * sent, double conf, const vector<char> * unknown) {
+    const string & wb = util_->showChar(bounds_[0]);
+    const KyteaString & chars = sent->chars;
+    const vector<double> & wsConfs = sent->wsConfs;
+    unsigned word = 0;
+    for(unsigned i = 0; i < chars.length(); i++) {
+        *str_ << util_->showChar(chars[i]);
+        if(i == wsConfs.size() || wsConfs[i] > conf) {
+            if(unknown && (*unknown)[word++])
+                *str_ << unkTag_;
+            if(i != wsConfs.size())
+                *str_ << wb;
+        }
+    }
     *str_ << endl;
 }
 
@@ -154,10 +183,14 @@ KyteaSentence * PartCorpusIO::readSentence() {
         THROW_ERROR("Attempted to read a sentence from an closed or output object");
 #endif
     string s;
+    KYTEA_STATS_START(TIME_READ);
     getline(*str_, s);
+    KYTEA_STATS_STOP(TIME_READ);
     if(str_->eof())
         return 0;
+    KYTEA_STATS_START(TIME_DECODE);
     KyteaString ks = util_->mapString(s), buff(ks.length());
+    KYTEA_STATS_STOP(TIME_DECODE);
     KyteaChar ukBound = bounds_[0], skipBound = bounds_[1], noBound = bounds_[2], 
         hasBound = bounds_[3], slashChar = bounds_[4], elemChar = bounds_[5], 
         escapeChar = bounds_[6];
@@ -325,16 +358,83 @@ KyteaSentence * RawCorpusIO::readSentence() {
         THROW_ERROR("Attempted to read a sentence from an closed or output object");
 #endif
     string s;
+    KYTEA_STATS_START(TIME_READ);
     getline(*str_, s);
+    KYTEA_STATS_STOP(TIME_READ);
     if(str_->eof())
         return 0;
     KyteaSentence * ret = new KyteaSentence();
+    KYTEA_STATS_START(TIME_DECODE);
+    ret->chars = util_->mapString(s, &ret->byteEnds);
+    KYTEA_STATS_STOP(TIME_DECODE);
+    if(ret->chars.length() != 0)
+        ret->wsConfs.resize(ret->chars.length()-1,0);
+    return ret;
+}
+
+KyteaSentence * RawCorpusIO::readSentencePart(unsigned maxBytes, bool & lineEnd) {
+#ifdef KYTEA_SAFE
+    if(out_ || !str_) 
+        THROW_ERROR("Attempted to read a sentence from an closed or output object");
+#endif
+    string s;
+    s.swap(partRest_);
+    vector<char> buff(maxBytes+1);
+    KYTEA_STATS_START(TIME_READ);
+    str_->get(&buff[0], maxBytes+1, '\n');
+    KYTEA_STATS_STOP(TIME_READ);
+    s.append(&buff[0], str_->gcount());
+    // nothing being read before the newline is not an error
+    if(str_->fail() && !str_->eof())
+        str_->clear();
+    const int next = str_->peek();
+    lineEnd = (next == '\n' || next == EOF);
+    if(next == '\n')
+        str_->ignore();
+    else if(next == EOF && s.length() == 0 && !inLine_)
+        return 0;
+    inLine_ = !lineEnd;
+    // leave an incomplete character at the end for the next part
+    if(!lineEnd) {
+        unsigned pos = 0;
+        while(pos < s.length() && pos+util_->getCharLength(s[pos]) <= s.length())
+            pos += util_->getCharLength(s[pos]);
+        partRest_ = s.substr(pos);
+        s.resize(pos);
+    }
+    KyteaSentence * ret = new KyteaSentence();
+    KYTEA_STATS_START(TIME_DECODE);
     ret->chars = util_->mapString(s);
+    KYTEA_STATS_STOP(TIME_DECODE);
     if(ret->chars.length() != 0)
         ret->wsConfs.resize(ret->chars.length()-1,0);
     return ret;
 }
 
+KyteaSentence * OffsetCorpusIO::readSentence() {
+    THROW_ERROR("Byte offsets can only be used for output");
+}
+
+void OffsetCorpusIO::writeSentence(const KyteaSentence * sent, double conf) {
+    if(sent->byteEnds.size() != sent->chars.length())
+        THROW_ERROR("Byte offsets can only be written for sentences that were read as raw text");
+    unsigned begin = 0, charPos = 0;
+    for(unsigned i = 0; i < sent->words.size(); i++) {
+        if(i != 0) *str_ << wordBound_;
+        const KyteaWord & w = sent->words[i];
+        charPos += w.surf.length();
+        const unsigned end = sent->byteEnds[charPos-1];
+        *str_ << begin << '-' << end;
+        for(int j = 0; j < w.getNumTags(); j++)
+            if(w.hasTag(j))
+                *str_ << tagBound_ << util_->showString(w.getTagSurf(j));
+        if(w.getUnknown())
+            *str_ << unkTag_;
+        begin = end;
+    }
+    *str_ << endl;
+}
+
 void RawCorpusIO::writeSentence(const KyteaSentence * sent, double conf)  {
     *str_ << util_->showString(sent->chars) << endl;
 }
@@ -1,6 +1,7 @@
 
 #include "kytea/feature-lookup.h"
 #include <algorithm>
+#include <cmath>
 
 using namespace kytea;
 using namespace std;
@@ -148,3 +149,54 @@ void FeatureLookup::addTagDictWeights(const std::vector<pair<int,int> > & exists
         }
     }
 }
+
+// the largest absolute value in a feature vector, which is found as a
+// double because the negative of the smallest FeatVal does not fit in one
+static double maxAbsValue(const FeatVec & vec) {
+    double ret = 0;
+    for(unsigned i = 0; i < vec.size(); i++)
+        ret = max(ret, fabs((double)vec[i]));
+    return ret;
+}
+
+static void addEntryWeights(const Dictionary<FeatVec> * dict, vector<double> & weights) {
+    if(!dict) return;
+    const vector<FeatVec*> & entries = dict->getEntries();
+    for(unsigned i = 0; i < entries.size(); i++)
+        weights.push_back(maxAbsValue(*entries[i]));
+}
+
+void FeatureLookup::getEntryWeights(vector<double> & weights) const {
+    addEntryWeights(charDict_, weights);
+    addEntryWeights(typeDict_, weights);
+    addEntryWeights(selfDict_, weights);
+}
+
+// build a new dictionary with only the entries above the cutoff, deleting
+// the old one. if no entries remain, return NULL
+static Dictionary<FeatVec> * pruneDictionary(Dictionary<FeatVec> * dict, double cutoff, double mult,
+                                             StringUtil * util, unsigned & removed) {
+    if(!dict) return NULL;
+    Dictionary<FeatVec>::WordMap wm, kept;
+    dict->getWordMap(wm);
+    for(Dictionary<FeatVec>::WordMap::const_iterator it = wm.begin(); it != wm.end(); it++) {
+        if(maxAbsValue(*it->second)*mult > cutoff)
+            kept.insert(Dictionary<FeatVec>::WordMap::value_type(it->first, new FeatVec(*it->second)));
+        else
+            removed++;
+    }
+    delete dict;
+    if(kept.size() == 0)
+        return NULL;
+    Dictionary<FeatVec> * ret = new Dictionary<FeatVec>(util);
+    ret->buildIndex(kept);
+    return ret;
+}
+
+unsigned FeatureLookup::prune(double cutoff, double mult, StringUtil * util) {
+    unsigned removed = 0;
+    charDict_ = pruneDictionary(charDict_, cutoff, mult, util, removed);
+    typeDict_ = pruneDictionary(typeDict_, cutoff, mult, util, removed);
+    selfDict_ = pruneDictionary(selfDict_, cutoff, mult, util, removed);
+    return removed;
+}
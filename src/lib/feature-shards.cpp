@@ -0,0 +1,120 @@
+#include <kytea/config.h>
+#include <kytea/feature-shards.h>
+#include <kytea/kytea-util.h>
+#include "liblinear/linear.h"
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace kytea;
+using namespace std;
+
+// the index given to the bias until the number of features is known
+#define SHARD_BIAS_INDEX -2
+
+FeatureShards::FeatureShards(const string & dir, size_t budget, double bias) : dir_(dir), budget_(budget), bias_(bias) {
+#if !HAVE_MMAP
+    THROW_ERROR("Writing features to disk is not supported on this system (no mmap)");
+#endif
+}
+
+FeatureShards::~FeatureShards() {
+#if HAVE_MMAP
+    for(unsigned i = 0; i < maps_.size(); i++)
+        munmap(maps_[i].first, maps_[i].second);
+#endif
+    for(unsigned i = 0; i < files_.size(); i++)
+        remove(files_[i].c_str());
+}
+
+void FeatureShards::addExample(const vector<unsigned> & feat, int label) {
+    const size_t pos = buffer_.size();
+    buffer_.resize(pos + (feat.size()+(bias_>=0?2:1))*sizeof(feature_node));
+    feature_node * nodes = (feature_node*)&buffer_[pos];
+    unsigned i;
+    for(i = 0; i < feat.size(); i++) {
+        nodes[i].index = feat[i];
+        nodes[i].value = 1;
+    }
+    if(bias_ >= 0) {
+        nodes[i].index = SHARD_BIAS_INDEX;
+        nodes[i++].value = bias_;
+    }
+    nodes[i].index = -1;
+    nodes[i].value = 0;
+    labels_.push_back(label);
+    if(buffer_.size() >= budget_)
+        writeShard();
+}
+
+void FeatureShards::writeShard() {
+    if(buffer_.size() == 0)
+        return;
+#if HAVE_MMAP
+    string name = dir_ + "/kytea-shard-XXXXXX";
+    vector<char> templ(name.begin(), name.end());
+    templ.push_back(0);
+    int fd = mkstemp(&templ[0]);
+    if(fd < 0)
+        THROW_ERROR("Could not create a feature shard in " << dir_);
+    files_.push_back(&templ[0]);
+    size_t done = 0;
+    while(done < buffer_.size()) {
+        ssize_t written = write(fd, &buffer_[done], buffer_.size()-done);
+        if(written <= 0) {
+            close(fd);
+            THROW_ERROR("Could not write to the feature shard " << files_.back());
+        }
+        done += written;
+    }
+    close(fd);
+#endif
+    buffer_.clear();
+}
+
+feature_node ** FeatureShards::mapExamples(int biasId) {
+    writeShard();
+    feature_node ** ret = (feature_node**)malloc(sizeof(feature_node*)*labels_.size());
+    size_t pos = 0;
+#if HAVE_MMAP
+    for(unsigned i = 0; i < files_.size(); i++) {
+        int fd = open(files_[i].c_str(), O_RDWR);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0) {
+            free(ret);
+            THROW_ERROR("Could not open the feature shard " << files_[i]);
+        }
+        void * mem = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(mem == MAP_FAILED) {
+            free(ret);
+            THROW_ERROR("Could not map the feature shard " << files_[i]);
+        }
+        maps_.push_back(pair<void*,size_t>(mem, st.st_size));
+        // the file itself will be removed when it is unmapped
+        unlink(files_[i].c_str());
+        // find the start of each example and set the bias index
+        feature_node * node = (feature_node*)mem;
+        feature_node * end = (feature_node*)((char*)mem + st.st_size);
+        while(node < end && pos < labels_.size()) {
+            ret[pos++] = node;
+            for( ; node->index != -1; node++)
+                if(node->index == SHARD_BIAS_INDEX)
+                    node->index = biasId;
+            node++;
+        }
+    }
+    files_.clear();
+#endif
+    if(pos != labels_.size()) {
+        free(ret);
+        THROW_ERROR("The feature shards contain "<<pos<<" examples, but "<<labels_.size()<<" were written");
+    }
+    return ret;
+}
@@ -0,0 +1,173 @@
+#include <kytea/kytea-c.h>
+#include <kytea/kytea.h>
+#include <kytea/kytea-config.h>
+#include <kytea/string-util.h>
+#include <deque>
+#include <cstring>
+
+using namespace kytea;
+using namespace std;
+
+struct kytea_model {
+    Kytea * kytea;
+    // the names of the tags known to the model at each level, by ID
+    vector< vector<string> > tagNames;
+};
+
+struct kytea_analyzer {
+    kytea_model * model;
+    // tags that were not known to the model, with IDs after the model's
+    // (a deque, so the names stay in place as it grows)
+    vector< deque<string> > extraNames;
+    vector< KyteaStringMap<int> > extraIds;
+    // the words of the current text, when it is not tagged
+    KyteaOffsets offsets;
+    string error;
+};
+
+// copy a message into a buffer owned by the caller
+static void copyError(const char * message, char * error, size_t error_size) {
+    if(error == NULL || error_size == 0)
+        return;
+    strncpy(error, message, error_size-1);
+    error[error_size-1] = 0;
+}
+
+// find the ID of a tag, giving it a new one if it is not known
+static int findTagId(kytea_analyzer * analyzer, int lev, const KyteaString & tag) {
+    const kytea_model * model = analyzer->model;
+    int id = model->kytea->getTagId(lev, tag);
+    if(id >= 0)
+        return id;
+    KyteaStringMap<int>::const_iterator it = analyzer->extraIds[lev].find(tag);
+    if(it != analyzer->extraIds[lev].end())
+        return it->second;
+    id = model->tagNames[lev].size() + analyzer->extraNames[lev].size();
+    analyzer->extraIds[lev].insert(pair<KyteaString,int>(tag, id));
+    analyzer->extraNames[lev].push_back(model->kytea->getStringUtil()->showString(tag));
+    return id;
+}
+
+kytea_model * kytea_model_load(const char * file, char * error, size_t error_size) {
+    KyteaConfig * config = new KyteaConfig;
+    config->setDebug(0);
+    config->setOnTraining(false);
+    kytea_model * model = new kytea_model;
+    model->kytea = new Kytea(config);
+    try {
+        model->kytea->readModel(file);
+        StringUtil * util = model->kytea->getStringUtil();
+        if(util->getEncoding() != StringUtil::ENCODING_UTF8)
+            THROW_ERROR("The C interface only supports UTF-8 models, but "<<file<<" is "<<util->getEncodingString());
+        const int levels = config->getNumTags();
+        model->tagNames.resize(levels);
+        vector<KyteaString> tags;
+        for(int i = 0; i < levels; i++) {
+            model->kytea->getTagCandidates(i, tags);
+            for(unsigned j = 0; j < tags.size(); j++)
+                model->tagNames[i].push_back(util->showString(tags[j]));
+        }
+    } catch(exception & e) {
+        copyError(e.what(), error, error_size);
+        kytea_model_free(model);
+        return NULL;
+    }
+    return model;
+}
+
+void kytea_model_free(kytea_model * model) {
+    if(model == NULL)
+        return;
+    delete model->kytea;
+    delete model;
+}
+
+int kytea_model_num_tag_levels(const kytea_model * model) {
+    return model->tagNames.size();
+}
+
+int kytea_model_num_tags(const kytea_model * model, int level) {
+    if(level < 0 || level >= (int)model->tagNames.size())
+        return 0;
+    return model->tagNames[level].size();
+}
+
+kytea_analyzer * kytea_analyzer_new(kytea_model * model) {
+    kytea_analyzer * analyzer = new kytea_analyzer;
+    analyzer->model = model;
+    analyzer->extraNames.resize(model->tagNames.size());
+    analyzer->extraIds.resize(model->tagNames.size());
+    return analyzer;
+}
+
+void kytea_analyzer_free(kytea_analyzer * analyzer) {
+    delete analyzer;
+}
+
+int kytea_analyze_batch(kytea_analyzer * analyzer,
+                        const char * const * texts, const size_t * lengths, size_t num_texts,
+                        size_t * word_ends, int * tag_ids, size_t max_words,
+                        size_t * num_words) {
+    Kytea * kytea = analyzer->model->kytea;
+    KyteaConfig * config = kytea->getConfig();
+    StringUtil * util = kytea->getStringUtil();
+    const int levels = analyzer->model->tagNames.size();
+    vector<bool> doTags(levels, false);
+    for(int i = 0; tag_ids != NULL && i < levels; i++)
+        doTags[i] = (config->getDoTags() && config->getDoTag(i));
+    KyteaOffsets & offsets = analyzer->offsets;
+    size_t w = 0;
+    try {
+        for(size_t i = 0; i < num_texts; i++) {
+            KyteaSentence sent;
+            sent.chars = util->mapString(string(texts[i], lengths[i]), &sent.byteEnds);
+            if(sent.chars.length() != 0)
+                sent.wsConfs.resize(sent.chars.length()-1, 0);
+            // without tags, the words are found directly from the boundaries
+            if(tag_ids == NULL) {
+                kytea->analyzeOffsets(sent, doTags, offsets);
+                num_words[i] = offsets.ends.size();
+            } else {
+                kytea->analyzeSentence(sent, doTags);
+                num_words[i] = sent.words.size();
+            }
+            if(w + num_words[i] > max_words) {
+                analyzer->error = "There is not enough space for the words of the texts";
+                return KYTEA_ERROR_SPACE;
+            }
+            if(tag_ids == NULL) {
+                for(unsigned j = 0; j < offsets.ends.size(); j++)
+                    word_ends[w++] = offsets.ends[j];
+                continue;
+            }
+            unsigned charPos = 0;
+            for(unsigned j = 0; j < sent.words.size(); j++, w++) {
+                const KyteaWord & word = sent.words[j];
+                charPos += word.surf.length();
+                word_ends[w] = sent.byteEnds[charPos-1];
+                for(int lev = 0; lev < levels; lev++)
+                    tag_ids[w*levels+lev] = (word.hasTag(lev) ? findTagId(analyzer, lev, word.getTagSurf(lev)) : KYTEA_NO_TAG);
+            }
+        }
+    } catch(exception & e) {
+        analyzer->error = e.what();
+        return KYTEA_ERROR;
+    }
+    return KYTEA_OK;
+}
+
+const char * kytea_analyzer_tag_name(const kytea_analyzer * analyzer, int level, int id) {
+    const kytea_model * model = analyzer->model;
+    if(level < 0 || level >= (int)model->tagNames.size() || id < 0)
+        return NULL;
+    if(id < (int)model->tagNames[level].size())
+        return model->tagNames[level][id].c_str();
+    id -= model->tagNames[level].size();
+    if(id < (int)analyzer->extraNames[level].size())
+        return analyzer->extraNames[level][id].c_str();
+    return NULL;
+}
+
+const char * kytea_analyzer_error(const kytea_analyzer * analyzer) {
+    return analyzer->error.c_str();
+}
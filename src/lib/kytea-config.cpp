@@ -27,6 +27,7 @@ void KyteaConfig::setIOFormat(const char* str, CorpForm & cf) {
     else if(!strcmp(str, "conf")) { cf = CORP_FORMAT_PROB; }
     else if(!strcmp(str, "prob")) { cf = CORP_FORMAT_PROB; }
     else if(!strcmp(str, "raw"))  { cf = CORP_FORMAT_RAW;  }
+    else if(!strcmp(str, "offset")) { cf = CORP_FORMAT_OFFSET; }
     else
         THROW_ERROR("Unsupported corpus IO format '" << str << "'");
 }
@@ -71,6 +72,8 @@ void KyteaConfig::printUsage() {
 "  -model   The file to write the trained model to" << endl <<
 "  -modtext Print a text model (instead of the default binary)" << endl <<
 "  -featout Write the features used in training the model to this file" << endl <<
+"  -init    Start training from the weights of this existing model" << endl <<
+"           (only effective with solvers 0 and 2)" << endl <<
 "Model Training Options (basic)" << endl <<
 "  -nows    Don't train a word segmentation model" << endl <<
 "  -notags  Skip the training of tagging, do only word segmentation" << endl <<
@@ -88,6 +91,16 @@ void KyteaConfig::printUsage() {
 "  -nobias  Don't use a bias value in classifier training" << endl <<
 "  -solver  The solver (1=SVM, 7=logistic regression, etc.; default 1,"<<endl<<
 "           see LIBLINEAR documentation for more details)" << endl <<
+"  -threads The number of threads to use in training (default: all; with" << endl <<
+"           solvers 0 and 2 the weights can differ in the last digits" << endl <<
+"           for different numbers of threads)" << endl <<
+"  -online  Train WS and global tags online with this many passes over the" << endl <<
+"           corpora instead of loading them into memory (default 0=off)" << endl <<
+"  -onlinealg The online learner (0=averaged perceptron, 1=AdaGrad; default 0)" << endl <<
+"  -scratch Write the WS and global tag features to shards in this directory" << endl <<
+"           instead of keeping them in memory" << endl <<
+"  -shardmem The memory in MB (more than 0) used to buffer features for each" << endl <<
+"           shard (256)" << endl <<
 "Format Options (for advanced users): " << endl <<
 "  -wordbound The separator for words in full annotation (\" \")" << endl <<
 "  -tagbound  The separator for tags in full/partial annotation (\"/\")" << endl <<
@@ -111,10 +124,23 @@ void KyteaConfig::printUsage() {
 "  -nounk   Don't estimate the pronunciation of unknown words" << endl <<
 "  -unkbeam The width of the beam to use in beam search for unknown words " <<endl<<
 "           (default 50, 0 for full search)" << endl <<
+"  -unkcache The number of unknown words to remember the pronunciations of" << endl <<
+"           (default 10000, 0 to disable)" << endl <<
+"  -sentcache The megabytes of memory to use remembering the analysis of" << endl <<
+"           sentences that are repeated in raw input (default 0, disabled)" << endl <<
+"  -chunk   Read raw lines this many bytes at a time and write words as soon" << endl <<
+"           as they are decided, for very long lines (default 0, whole lines)" << endl <<
+"  -overlay A user dictionary to match in addition to the model's dictionary" << endl <<
+"           (one 'word/tag' entry per line), used without retraining" << endl <<
+"  -overlayslot The dictionary of the model (n starts at 1) whose weights" << endl <<
+"           words in the -overlay dictionary use (default 1)" << endl <<
 "  -debug   The debugging level (0=silent, 1=simple, 2=detailed)" << endl <<
+"  -stats   Print the time of each stage of analysis and counts of what was" << endl <<
+"           analyzed to stderr at the end (needs configure --enable-stats)" << endl <<
 "Format Options: " << endl <<
 "  -in      The formatting of the input  (raw/full/part/conf, default raw)" << endl <<
-"  -out     The formatting of the output (full/part/conf, default full)" << endl <<
+"  -out     The formatting of the output (full/part/conf/offset, default full)" << endl <<
+"           (offset gives the byte range of each word in the input and its tags)" << endl <<
 "  -tagmax  The maximum number of tags to print for one word (default 3," << endl <<
 "            0 implies no limit)" << endl << 
 "  -deftag  A tag for words that cannot be given any tag (for example, "<<endl<<
@@ -167,6 +193,7 @@ unsigned KyteaConfig::parseTrainArg(const char * n, const char * v) {
     // output option for training
     else if(!strcmp(n, "-model"))    { ch(n,v); setModelFile(v); }
     else if(!strcmp(n, "-modtext"))  { setModelFormat('T'); r=0; }
+    else if(!strcmp(n, "-init"))     { ch(n,v); setInitModelFile(v); }
     else if(!strcmp(n, "-featout"))  { ch(n,v); setFeatureOut(v); }
     else if(!strcmp(n, "-feat"))     { ch(n,v); setFeatureIn(v); }
     else if(!strcmp(n, "-numtags"))  { ch(n,v); setNumTags(util_->parseInt(v)); }
@@ -175,6 +202,15 @@ unsigned KyteaConfig::parseTrainArg(const char * n, const char * v) {
     else if(!strcmp(n, "-eps"))      { ch(n,v); setEpsilon(util_->parseFloat(v)); }
     else if(!strcmp(n, "-cost"))      { ch(n,v); setCost(util_->parseFloat(v)); }
     else if(!strcmp(n, "-solver"))   { ch(n,v); setSolverType(util_->parseInt(v)); }
+    else if(!strcmp(n, "-threads"))  { ch(n,v); setNumThreads(util_->parseInt(v)); }
+    else if(!strcmp(n, "-online"))   { ch(n,v); setOnlineEpochs(util_->parseInt(v)); }
+    else if(!strcmp(n, "-onlinealg")) { ch(n,v); setOnlineAlgorithm(util_->parseInt(v)); }
+    else if(!strcmp(n, "-scratch"))  { ch(n,v); setScratchDir(v); }
+    else if(!strcmp(n, "-shardmem")) {
+        ch(n,v);
+        if(util_->parseFloat(v) <= 0) THROW_ERROR("Illegal setting "<<v<<" for -shardmem (must be greater than 0)");
+        setShardMemory(util_->parseFloat(v));
+    }
 
     // feature options
     else if(!strcmp(n, "-charw"))    { ch(n,v); setCharWindow(util_->parseInt(v)); }
@@ -241,6 +277,16 @@ unsigned KyteaConfig::parseRunArg(const char * n, const char * v) {
     else if(!strcmp(n, "-unktag"))   { ch(n,v); setUnkTag(v); }
     else if(!strcmp(n, "-deftag"))   { ch(n,v); setDefaultTag(v); }
     else if(!strcmp(n, "-unkbeam"))  { ch(n,v); setUnkBeam(util_->parseInt(v)); }
+    else if(!strcmp(n, "-unkcache")) { ch(n,v); setUnkCache(util_->parseInt(v)); }
+    else if(!strcmp(n, "-sentcache")) { ch(n,v); setSentenceCache(util_->parseInt(v)); }
+    else if(!strcmp(n, "-chunk"))    { ch(n,v); setChunkSize(util_->parseInt(v)); }
+    else if(!strcmp(n, "-stats"))    { setStats(true); r=0; }
+    else if(!strcmp(n, "-overlay"))  { ch(n,v); setOverlayFile(v); }
+    else if(!strcmp(n, "-overlayslot")) {
+        ch(n,v);
+        if(util_->parseInt(v) < 1) THROW_ERROR("Illegal setting "<<v<<" for -overlayslot (must be 1 or greater)");
+        setOverlaySlot(util_->parseInt(v)-1);
+    }
     else if(!strcmp(n, "-debug"))    { ch(n,v); setDebug(util_->parseInt(v)); }
 
     // formatting options
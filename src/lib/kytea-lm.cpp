@@ -1,5 +1,6 @@
 #include "kytea/kytea-lm.h"
 #include <iostream>
+#include <algorithm>
 #include <cmath>
 
 using namespace kytea;
@@ -69,56 +70,155 @@ void KyteaLM::train(const std::vector<KyteaString> & corpus) {
     // calculate the fallbacks
     for(KyteaDoubleMap::iterator it = fallbacks_.begin(); it != fallbacks_.end(); it++)
         it->second = log((it->second*discounts[it->first.length()])/denominators[it->first]);
+    compile();
 }
 
-double KyteaLM::scoreSingle(const KyteaString & val, int pos) {
-    KyteaString ngram(n_);
-    for(unsigned i = 0; i < n_; i++) ngram[i] = 0;
-    int npos = n_;
-    if((int)val.length() == pos) {
-        npos--;
-        pos--;
+// order the edges by state, then character
+class KyteaLMEdgeLess {
+public:
+    bool operator() (const pair<unsigned,KyteaLMEdge> & a, const pair<unsigned,KyteaLMEdge> & b) const {
+        return a.first < b.first || (a.first == b.first && a.second.next < b.second.next);
     }
-    while(--npos >= 0 && pos >= 0)
-        ngram[npos] = val[pos--];
-    double prob = 0;
-    for(npos = 0; npos < (int)n_; npos++) {
-        KyteaDoubleMap::const_iterator it = probs_.find(ngram.substr(npos));
-        if(it != probs_.end()) {
-            prob += it->second;
-            return prob;
-        } else {
-            it = fallbacks_.find(ngram.substr(npos, n_-npos-1));
-            if(it != fallbacks_.end())
-                prob += it->second;
+};
+
+// add a context and all of its prefixes as states
+unsigned addState(KyteaUnsignedMap & ids, vector<KyteaString> & strs, const KyteaString & str) {
+    KyteaUnsignedMap::const_iterator it = ids.find(str);
+    if(it != ids.end())
+        return it->second;
+    if(str.length() > 0)
+        addState(ids, strs, str.substr(0, str.length()-1));
+    unsigned id = strs.size();
+    ids.insert(pair<KyteaString,unsigned>(str, id));
+    strs.push_back(str);
+    return id;
+}
+
+void KyteaLM::compile() {
+    // the states are every context with a fallback or a probability
+    KyteaUnsignedMap ids;
+    vector<KyteaString> strs;
+    addState(ids, strs, KyteaString());
+    for(KyteaDoubleMap::const_iterator it = fallbacks_.begin(); it != fallbacks_.end(); it++)
+        if(it->first.length() < n_)
+            addState(ids, strs, it->first);
+    for(KyteaDoubleMap::const_iterator it = probs_.begin(); it != probs_.end(); it++)
+        if(it->first.length() > 0 && it->first.length() <= n_)
+            addState(ids, strs, it->first.substr(0, it->first.length()-1));
+    // find the fallbacks and the longest suffix of each state
+    vector<KyteaLMState> states(strs.size()+1);
+    for(unsigned i = 0; i < strs.size(); i++) {
+        KyteaDoubleMap::const_iterator fit = fallbacks_.find(strs[i]);
+        states[i].fallback = (fit == fallbacks_.end() ? 0 : fit->second);
+        states[i].back = -1;
+        for(unsigned j = 1; j <= strs[i].length() && states[i].back == -1; j++) {
+            KyteaUnsignedMap::const_iterator bit = ids.find(strs[i].substr(j));
+            if(bit != ids.end())
+                states[i].back = bit->second;
         }
     }
+    // gather the edges to longer states and the probabilities
+    vector< pair<unsigned,KyteaLMEdge> > edges;
+    KyteaLMEdge edge;
+    for(unsigned i = 0; i < strs.size(); i++) {
+        if(strs[i].length() == 0) continue;
+        edge.next = strs[i][strs[i].length()-1];
+        edge.state = i;
+        edge.hasProb = false; edge.prob = 0;
+        edges.push_back(pair<unsigned,KyteaLMEdge>(ids[strs[i].substr(0, strs[i].length()-1)], edge));
+    }
+    for(KyteaDoubleMap::const_iterator it = probs_.begin(); it != probs_.end(); it++) {
+        if(it->first.length() == 0 || it->first.length() > n_) continue;
+        edge.next = it->first[it->first.length()-1];
+        edge.state = -1;
+        edge.hasProb = true; edge.prob = it->second;
+        edges.push_back(pair<unsigned,KyteaLMEdge>(ids[it->first.substr(0, it->first.length()-1)], edge));
+    }
+    sort(edges.begin(), edges.end(), KyteaLMEdgeLess());
+    // merge the edges for the same character
+    edges_.clear();
+    unsigned curr = 0;
+    for(unsigned i = 0; i < edges.size(); i++) {
+        while(curr <= edges[i].first)
+            states[curr++].edges = edges_.size();
+        if(i > 0 && edges[i-1].first == edges[i].first && edges_.back().next == edges[i].second.next) {
+            if(edges[i].second.state != -1) edges_.back().state = edges[i].second.state;
+            if(edges[i].second.hasProb) {
+                edges_.back().hasProb = true;
+                edges_.back().prob = edges[i].second.prob;
+            }
+        } else
+            edges_.push_back(edges[i].second);
+    }
+    while(curr < states.size())
+        states[curr++].edges = edges_.size();
+    states_.swap(states);
+    // the start state comes after n-1 positions before the string
+    startState_ = 0;
+    for(unsigned i = 0; i+1 < n_; i++)
+        startState_ = nextState(startState_, 0);
+}
+
+const KyteaLMEdge * KyteaLM::findEdge(unsigned state, KyteaChar next) const {
+    if(states_[state].edges == states_[state+1].edges)
+        return 0;
+    const KyteaLMEdge * first = &edges_[0] + states_[state].edges;
+    const KyteaLMEdge * last = &edges_[0] + states_[state+1].edges;
+    // binary search for the character
+    while(first < last) {
+        const KyteaLMEdge * mid = first + (last-first)/2;
+        if(mid->next < next)
+            first = mid+1;
+        else if(next < mid->next)
+            last = mid;
+        else
+            return mid;
+    }
+    return 0;
+}
+
+unsigned KyteaLM::nextState(unsigned state, KyteaChar next) const {
+    // back off until there is a state that can be extended
+    while(true) {
+        const KyteaLMEdge * edge = findEdge(state, next);
+        if(edge != 0 && edge->state != -1)
+            return edge->state;
+        if(states_[state].back == -1)
+            return 0;
+        state = states_[state].back;
+    }
+}
+
+double KyteaLM::scoreNext(unsigned state, KyteaChar next) const {
+    double prob = 0;
+    while(true) {
+        const KyteaLMEdge * edge = findEdge(state, next);
+        if(edge != 0 && edge->hasProb)
+            return prob + edge->prob;
+        prob += states_[state].fallback;
+        if(states_[state].back == -1)
+            break;
+        state = states_[state].back;
+    }
     return prob + log(1.0/vocabSize_);
 }
 
+double KyteaLM::scoreSingle(const KyteaString & val, int pos) const {
+    // only the last n-1 characters are needed for the context
+    int start = max(0, pos-(int)n_+1);
+    unsigned state = (start == 0 ? startState_ : 0);
+    for(int i = start; i < pos; i++)
+        state = nextState(state, val[i]);
+    return scoreNext(state, (pos == (int)val.length() ? 0 : val[pos]));
+}
+
 // score a string with the language model (log probability)
 double KyteaLM::score(const KyteaString& val) const {
-    unsigned j, len;
     double prob = 0;
-    KyteaString testString(val.length()+n_);
-    for(j = 0; j < n_-1; j++)
-        testString[j] = 0;
-    testString[testString.length()-1] = 0;
-    testString.splice(val,n_-1);
-    for(j = n_; j < testString.length(); j++) {
-        for(len = n_; len > 0; len--) {
-            KyteaDoubleMap::const_iterator it = const_cast<KyteaDoubleMap*>(&probs_)->find(testString.substr(j-len, len));
-            if(it != probs_.end()) {
-                prob += it->second;
-                break;
-            } else {
-                it = const_cast<KyteaDoubleMap*>(&fallbacks_)->find(testString.substr(j-len, len-1));
-                if(it != fallbacks_.end())
-                    prob += it->second;
-            }
-        }
-        if(n_ == 0)
-            prob += log(1.0/vocabSize_);
+    unsigned state = startState_;
+    for(unsigned i = 0; i < val.length(); i++) {
+        prob += scoreNext(state, val[i]);
+        state = nextState(state, val[i]);
     }
-    return prob;
+    return prob + scoreNext(state, 0);
 }
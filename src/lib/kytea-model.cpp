@@ -1,5 +1,7 @@
 #include <kytea/kytea-model.h>
 #include <kytea/feature-lookup.h>
+#include <kytea/dictionary.h>
+#include <kytea/feature-shards.h>
 #include "liblinear/linear.h"
 #include <cstdlib>
 #include <cmath>
@@ -10,7 +12,27 @@ using namespace kytea;
 using namespace std;
 
 #define SIG_CUTOFF 1E-6
-#define SHORT_MAX 32767
+// the largest quantized weight (kept symmetric so weights can be negated)
+#if QUANTIZE_8BIT
+#   define FEATVAL_MAX 127
+#else
+#   define FEATVAL_MAX 32767
+#endif
+
+// convert a scaled weight to a feature value. 8-bit weights are rounded as
+// truncation loses too much, and values are clipped to the quantized range
+inline FeatVal quantizeWeight(double val) {
+#if DISABLE_QUANTIZE
+    return val;
+#else
+    val = max(-(double)FEATVAL_MAX, min((double)FEATVAL_MAX, val));
+#   if QUANTIZE_8BIT
+    return (FeatVal)(val < 0 ? val-0.5 : val+0.5);
+#   else
+    return (FeatVal)val;
+#   endif
+#endif
+}
 
 int KyteaModel::featuresAdded_ = 0;
 
@@ -157,16 +179,38 @@ feature_node * allocateFeatures(const vector<unsigned> & feats, int biasId, doub
     return nodes;
 }
 // train the model
-void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> & ys, double bias, int solver, double epsilon, double cost) {
+void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> & ys, double bias, int solver, double epsilon, double cost, int numThreads, const ModelWeights * init) {
     if(xs.size() == 0) return;
+    setBias(bias);
+    // allocate the feature space
+    feature_node** myXs = (feature_node**)malloc(sizeof(feature_node*)*xs.size());
+    int biasId = getBiasId();
+    for(int i = 0; i < (int)xs.size(); i++)
+        myXs[i] = allocateFeatures(xs[i], biasId, bias);
+    trainLiblinear(myXs, ys, solver, epsilon, cost, numThreads, init);
+    // free the problem
+    for(int i = 0; i < (int)xs.size(); i++)
+        free(myXs[i]);
+    free(myXs);
+}
+
+// train the model from examples that were written to disk
+void KyteaModel::trainModel(FeatureShards & shards, double bias, int solver, double epsilon, double cost, int numThreads, const ModelWeights * init) {
+    if(shards.size() == 0) return;
+    setBias(bias);
+    feature_node** myXs = shards.mapExamples(getBiasId());
+    trainLiblinear(myXs, shards.getLabels(), solver, epsilon, cost, numThreads, init);
+    free(myXs);
+}
+
+void KyteaModel::trainLiblinear(feature_node ** xs, vector<int> & ys, int solver, double epsilon, double cost, int numThreads, const ModelWeights * init) {
     solver_ = solver;
     if(weights_.size()>0)
         weights_.clear();
-    setBias(bias);
     // build the liblinear model
     struct problem   prob;
     struct parameter param;
-    prob.l = xs.size();
+    prob.l = ys.size();
     // for(int i = 0; i < min(5,(int)xs.size()); i++) {
     //     cerr << "ys["<<i<<"] == "<<ys[i]<<":";
     //     for(int j = 0; j < (int)xs[i].size(); j++) {
@@ -175,16 +219,10 @@ void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> &
     //     cerr << endl;
     // }
     prob.y = &ys.front();
+    prob.x = xs;
 
-    // allocate the feature space
-    feature_node** myXs = (feature_node**)malloc(sizeof(feature_node*)*xs.size());
-    int biasId = getBiasId();
-    for(int i = 0; i < prob.l; i++)
-        myXs[i] = allocateFeatures(xs[i], biasId, bias);
-    prob.x = myXs;
-
-    prob.bias = bias;
-    prob.n = names_.size()+(bias>=0?1:0);
+    prob.bias = bias_;
+    prob.n = names_.size()+(bias_>=0?1:0);
 
     param.solver_type = solver;
     param.C = cost;
@@ -192,6 +230,10 @@ void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> &
     param.nr_weight = 0;
     param.weight_label = NULL;
     param.weight = NULL;
+    param.nr_thread = numThreads;
+    param.init_sol = NULL;
+    if(init != NULL && (solver == L2R_LR || solver == L2R_L2LOSS_SVC))
+        param.init_sol = makeInitialSolution(ys, *init);
     if(param.eps == HUGE_VAL) {
     	if(param.solver_type == L2R_LR || param.solver_type == L2R_L2LOSS_SVC)
     		param.eps = 0.01;
@@ -202,17 +244,24 @@ void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> &
     }
     model* mod_ = train(&prob, &param);
 
-    // free the problem
-    for(int i = 0; i < prob.l; i++)
-        free(myXs[i]);
-    free(myXs);
+    if(param.init_sol)
+        delete [] param.init_sol;
+
+    vector<int> labels(mod_->label, mod_->label+mod_->nr_class);
+    setTrainedWeights(mod_->w, labels);
 
+    free_and_destroy_model(&mod_);
+    // When we're done with training, no more adding features
+    addFeat_ = false;
+
+}
+
+// set the trained weights, removing features that have no weight
+void KyteaModel::setTrainedWeights(const double * w, const vector<int> & labels) {
     int i, j;
 
-    // create the labels
-    labels_.resize(mod_->nr_class);
-    for(int i = 0; i < mod_->nr_class; i++)
-        labels_[i] = mod_->label[i];
+    // set the labels
+    labels_ = labels;
 
     numW_ = (labels_.size()==2 && solver_ != MCSVM_CS?1:labels_.size());
     
@@ -224,11 +273,11 @@ void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> &
     multiplier_ = 0;
     double val;
     for(unsigned i = 0; i < wSize; i++) {
-        val = abs(mod_->w[i]);
+        val = abs(w[i]);
         if(val > multiplier_)
             multiplier_ = val;
     }
-    multiplier_ /= SHORT_MAX;
+    multiplier_ = (multiplier_ > 0 ? multiplier_/FEATVAL_MAX : 1);
 #endif
 
     // trim values
@@ -241,39 +290,164 @@ void KyteaModel::trainModel(const vector< vector<unsigned> > & xs, vector<int> &
     for(i=0; i<(int)oldNames_.size()-1; i++) {
         double myMax = 0.0;
     	for(j=0; j<numW_; j++) 
-            myMax = max(abs(mod_->w[i*numW_+j]),myMax);
+            myMax = max(abs(w[i*numW_+j]),myMax);
         if(myMax>SIG_CUTOFF) {
             mapFeat(oldNames_[i+1]);
             // If the number of weights is two, push the difference
             if(numW_ == 2) {
-                weights_.push_back((FeatVal)
-                        ((mod_->w[i*numW_]-mod_->w[i*numW_+1])/multiplier_));
+                weights_.push_back(quantizeWeight(
+                        (w[i*numW_]-w[i*numW_+1])/multiplier_));
             // Otherwise, keep the number of weights as-is, and push all
             } else {
                 for(j = 0; j < numW_; j++)
-                    weights_.push_back((FeatVal)(mod_->w[i*numW_+j]/multiplier_));
+                    weights_.push_back(quantizeWeight(w[i*numW_+j]/multiplier_));
             }
         }
     }
     if(bias_>=0) {
         // If the number of weights is two, push the difference
         if(numW_ == 2) {
-            weights_.push_back((FeatVal)
-                    ((mod_->w[i*numW_]-mod_->w[i*numW_+1])/multiplier_));
+            weights_.push_back(quantizeWeight(
+                    (w[i*numW_]-w[i*numW_+1])/multiplier_));
         // Otherwise push all
         } else {
             for(j = 0; j < numW_; j++)
-                weights_.push_back((FeatVal)(mod_->w[i*numW_+j]/multiplier_));
+                weights_.push_back(quantizeWeight(w[i*numW_+j]/multiplier_));
         }
     }
 
     // If the number of weights was two, we've converted to one
     if(numW_ == 2) numW_ = 1;
 
-    free_and_destroy_model(&mod_);
-    // When we're done with training, no more adding features
-    addFeat_ = false;
+}
 
+// Build a starting point for liblinear. Classes are ordered as liblinear
+// finds them (by first appearance in ys), and weights are laid out as in
+// model->w (w[j*nr_class+i], or a single vector for two classes)
+double * KyteaModel::makeInitialSolution(const vector<int> & ys, const ModelWeights & init) {
+    vector<int> labels;
+    for(unsigned i = 0; i < ys.size(); i++)
+        if(find(labels.begin(), labels.end(), ys[i]) == labels.end())
+            labels.push_back(ys[i]);
+    const int nr_class = labels.size(), nr_w = (nr_class == 2 ? 1 : nr_class);
+    const int w_size = names_.size()+(bias_>=0?1:0);
+    // find the sign and index of the old weight vector for each new class
+    vector< pair<int,double> > from(nr_w, pair<int,double>(-1,0));
+    for(int i = 0; i < nr_w; i++) {
+        for(int k = 0; k < (int)init.labels.size(); k++) {
+            if(init.labels[k] != labels[i]) continue;
+            // old models with two classes only have weights for the first
+            if(init.labels.size() != 2) from[i] = pair<int,double>(k,1);
+            else from[i] = pair<int,double>(0,(k==0?1:-1));
+        }
+    }
+    double * ret = new double[w_size*nr_w];
+    fill(ret, ret+w_size*nr_w, 0.0);
+    for(int j = 0; j < w_size; j++) {
+        // the feature with index j+1, the bias has index names_.size() and
+        // is stored under the empty name (the same as names_[0])
+        if(j+1 > (int)names_.size() || (j+1 == (int)names_.size() && bias_ < 0)) continue;
+        const KyteaString & name = names_[(j+1) % names_.size()];
+        KyteaStringMap< vector<double> >::const_iterator it = init.weights.find(name);
+        if(it == init.weights.end()) continue;
+        for(int i = 0; i < nr_w; i++)
+            if(from[i].first != -1 && from[i].first < (int)it->second.size())
+                ret[j*nr_w+i] = it->second[from[i].first]*from[i].second;
+    }
+    return ret;
+}
+
+// Add the weights of a feature dictionary. Each entry holds a weight
+// vector for every prefix, either adjusted for the length of the entry
+// (n-gram dictionaries) or not (self dictionaries)
+static void addDictionaryWeights(const Dictionary<FeatVec> * dict, 
+                                 const vector<KyteaString> & prefs, 
+                                 bool adjustPos, int numW, double mult,
+                                 StringUtil * from, StringUtil * to,
+                                 ModelWeights & ret) {
+    if(dict == NULL) return;
+    Dictionary<FeatVec>::WordMap wm;
+    dict->getWordMap(wm);
+    const int numPrefs = prefs.size();
+    for(Dictionary<FeatVec>::WordMap::const_iterator it = wm.begin(); it != wm.end(); it++) {
+        const FeatVec & vals = *it->second;
+        const int len = it->first.length();
+        KyteaString word = to->mapString(from->showString(it->first));
+        for(int id = 0; id+numW <= (int)vals.size(); id += numW) {
+            int pos = (adjustPos ? numPrefs-len-id/numW : id/numW);
+            if(pos < 0 || pos >= numPrefs) continue;
+            bool nonZero = false;
+            for(int j = 0; j < numW; j++) nonZero = nonZero || vals[id+j] != 0;
+            if(!nonZero) continue;
+            vector<double> & w = ret.weights[prefs[pos]+word];
+            w.resize(numW);
+            for(int j = 0; j < numW; j++) w[j] = vals[id+j]*mult;
+        }
+    }
+}
+
+void KyteaModel::getModelWeights(StringUtil * from, StringUtil * to, int maxLen, ModelWeights & ret) const {
+    ret.weights.clear();
+    ret.labels = labels_;
+    if(featLookup_ == NULL || labels_.size() < 2)
+        return;
+    // values in the lookup are quantized and multiplied by the first label
+    const double mult = multiplier_/labels_[0];
+    const int numL = labels_.size();
+    // the character and type n-grams, the window size is implied by the
+    // length of the weight vectors
+    const Dictionary<FeatVec> * dicts[2] = { featLookup_->getCharDict(), featLookup_->getTypeDict() };
+    const char * prefNames[2] = { "X", "T" };
+    for(int d = 0; d < 2; d++) {
+        if(dicts[d] == NULL || dicts[d]->getEntries().size() == 0) continue;
+        int w = dicts[d]->getEntries()[0]->size()/numW_/2;
+        vector<KyteaString> prefs;
+        for(int i = 1-w; i <= w; i++) {
+            ostringstream oss; oss << prefNames[d] << i;
+            prefs.push_back(to->mapString(oss.str()));
+        }
+        addDictionaryWeights(dicts[d], prefs, true, numW_, mult, from, to, ret);
+    }
+    vector<KyteaString> selfPrefs;
+    selfPrefs.push_back(to->mapString("SX"));
+    selfPrefs.push_back(to->mapString("ST"));
+    addDictionaryWeights(featLookup_->getSelfDict(), selfPrefs, false, numW_, mult, from, to, ret);
+    // the bias
+    if(featLookup_->getBiases() != NULL && featLookup_->getBiases()->size() > 0) {
+        vector<double> & w = ret.weights[KyteaString()];
+        for(int j = 0; j < numW_ && j < (int)featLookup_->getBiases()->size(); j++)
+            w.push_back(featLookup_->getBias(j)*mult);
+    }
+    // the word segmentation dictionary features
+    const FeatVec * dictVec = featLookup_->getDictVector();
+    if(dictVec != NULL && maxLen > 0) {
+        const char * types = "RIL";
+        for(int id = 0; id < (int)dictVec->size(); id++) {
+            if((*dictVec)[id] == 0) continue;
+            ostringstream oss; oss << "D" << id/3/maxLen << types[id%3] << id/3%maxLen+1;
+            ret.weights[to->mapString(oss.str())].push_back((*dictVec)[id]*mult);
+        }
+    }
+    // the tag dictionary features
+    const FeatVec * tagDictVec = featLookup_->getTagDictVector();
+    if(tagDictVec != NULL) {
+        for(int id = 0; id+numL <= (int)tagDictVec->size(); id += numL) {
+            ostringstream oss; oss << "D" << id/numL/numL << "T" << id/numL%numL;
+            vector<double> w(numW_);
+            bool nonZero = false;
+            for(int k = 0; k < numW_; k++) {
+                w[k] = (*tagDictVec)[id+k]*mult;
+                nonZero = nonZero || w[k] != 0;
+            }
+            if(nonZero) ret.weights[to->mapString(oss.str())] = w;
+        }
+    }
+    const FeatVec * tagUnkVec = featLookup_->getTagUnkVector();
+    if(tagUnkVec != NULL && (int)tagUnkVec->size() >= numW_) {
+        vector<double> & w = ret.weights[to->mapString("UNK")];
+        for(int k = 0; k < numW_; k++)
+            w.push_back((*tagUnkVec)[k]*mult);
+    }
 }
 
 void KyteaModel::setNumClasses(unsigned v) {
@@ -319,6 +493,10 @@ Dictionary<vector<FeatVal> > * KyteaModel::makeDictionaryFromPrefixes(const vect
 }
 
 void KyteaModel::buildFeatureLookup(StringUtil * util, int charw, int typew, int numDicts, int maxLen) {
+    // Models that were read from a file have no feature names (other than
+    // the dummy feature), so their lookup cannot be rebuilt and is kept as-is
+    if(names_.size() <= 1 && featLookup_)
+        return;
     if(featLookup_) {
         delete featLookup_;
         featLookup_ = 0;
@@ -0,0 +1,484 @@
+#include <kytea/config.h>
+#include <kytea/kytea-server.h>
+#include <kytea/model-handle.h>
+#include <kytea/kytea.h>
+#include <kytea/kytea-config.h>
+#include <kytea/corpus-io.h>
+#include <kytea/kytea-util.h>
+#include <kytea/kytea-stats.h>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#if HAVE_PTHREAD_H && HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H && HAVE_NETINET_IN_H
+#define KYTEA_SERVER_SOCKETS 1
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#else
+#define KYTEA_SERVER_SOCKETS 0
+#endif
+
+using namespace kytea;
+using namespace std;
+
+// the largest message that will be read, so a bad length cannot use up memory
+#define SERVER_MAX_MESSAGE (64*1024*1024)
+
+namespace kytea {
+
+// A request that is waiting in the queue or being analyzed
+struct ServerJob {
+    string request, response;
+    bool done;
+};
+
+struct ServerState {
+    deque<ServerJob*> queue;
+    bool running;
+    int connections;
+    unsigned long requests, batches;
+#if KYTEA_SERVER_SOCKETS
+    pthread_mutex_t mutex;
+    // signaled when a job is added, a job is taken, jobs are done, and a
+    // connection closes
+    pthread_cond_t added, taken, done, closed;
+    vector<pthread_t> workers;
+    vector<int> fds;
+#endif
+};
+
+}
+
+#if KYTEA_SERVER_SOCKETS
+// a connection and the server that is handling it
+struct ServerConnection {
+    KyteaServer * server;
+    int fd;
+};
+#endif
+
+KyteaServer::KyteaServer(ModelHandle & handle, int threads, int batchSize, int deadline, int queueSize) :
+        handle_(handle), threads_(threads), batchSize_(batchSize), deadline_(deadline), queueSize_(queueSize), listenFd_(-1), state_(new ServerState) {
+    if(threads_ < 1 || batchSize_ < 1 || deadline_ < 0 || queueSize_ < 1)
+        THROW_ERROR("Illegal server settings (threads="<<threads<<", batch="<<batchSize<<", deadline="<<deadline<<", queue="<<queueSize<<")");
+    state_->running = false;
+    state_->connections = 0;
+    state_->requests = state_->batches = 0;
+#if KYTEA_SERVER_SOCKETS
+    pthread_mutex_init(&state_->mutex, NULL);
+    pthread_cond_init(&state_->added, NULL);
+    pthread_cond_init(&state_->taken, NULL);
+    pthread_cond_init(&state_->done, NULL);
+    pthread_cond_init(&state_->closed, NULL);
+#endif
+}
+
+KyteaServer::~KyteaServer() {
+#if KYTEA_SERVER_SOCKETS
+    if(listenFd_ >= 0)
+        close(listenFd_);
+    if(socketFile_.length())
+        unlink(socketFile_.c_str());
+    pthread_mutex_destroy(&state_->mutex);
+    pthread_cond_destroy(&state_->added);
+    pthread_cond_destroy(&state_->taken);
+    pthread_cond_destroy(&state_->done);
+    pthread_cond_destroy(&state_->closed);
+#endif
+    delete state_;
+}
+
+string KyteaServer::processRequest(Kytea & kytea, const string & request) {
+    KyteaConfig * config = kytea.getConfig();
+    StringUtil * util = kytea.getStringUtil();
+    const int numTags = config->getNumTags();
+    vector<bool> doTags(numTags, false);
+    for(int i = 0; i < numTags; i++)
+        doTags[i] = (config->getDoTags() && config->getDoTag(i));
+    CorpusIO::Format outForm = config->getOutputFormat();
+    // the first line holds the options
+    size_t eol = request.find('\n');
+    istringstream opts(request.substr(0, eol));
+    string text = (eol == string::npos ? string() : request.substr(eol+1));
+    // the last sentence is only read if it ends with a newline
+    if(text.length() && text[text.length()-1] != '\n')
+        text += '\n';
+    stringstream in(text), out;
+    CorpusIO *inIO = 0, *outIO = 0;
+    try {
+        string opt, val;
+        while(opts >> opt) {
+            if(opt == "-notags")
+                doTags.assign(numTags, false);
+            else if(opt == "-notag") {
+                if(!(opts >> val)) THROW_ERROR("-notag must be followed by a tag level");
+                int lev = util->parseInt(val.c_str());
+                if(lev < 1) THROW_ERROR("Illegal setting "<<val<<" for -notag (must be 1 or greater)");
+                if(lev <= numTags) doTags[lev-1] = false;
+            } else if(opt == "-out") {
+                if(!(opts >> val)) THROW_ERROR("-out must be followed by a format");
+                config->setIOFormat(val.c_str(), outForm);
+            } else if(opt == "-stats") {
+                // report the statistics of the process instead of analyzing
+                if(!KyteaStats::isEnabled())
+                    THROW_ERROR("-stats can only be used if KyTea was configured with --enable-stats");
+                KyteaStats::write(out);
+                return "OK\n" + out.str();
+            } else
+                THROW_ERROR("Unknown request option '"<<opt<<"'");
+        }
+        if(!config->getDoWS())
+            THROW_ERROR("The model cannot perform word segmentation of raw text");
+        inIO = CorpusIO::createIO(in, CORP_FORMAT_RAW, *config, false, util);
+        outIO = CorpusIO::createIO(out, outForm, *config, true, util);
+        outIO->setUnkTag(config->getUnkTag());
+        outIO->setNumTags(numTags);
+        for(int i = 0; i < numTags; i++)
+            outIO->setDoTag(i, doTags[i]);
+        KyteaSentence * next;
+        while((next = inIO->readSentence()) != 0) {
+            kytea.analyzeSentence(*next, doTags);
+            outIO->writeSentence(next);
+            delete next;
+        }
+    } catch(exception & e) {
+        if(inIO) delete inIO;
+        if(outIO) delete outIO;
+        return string("ERROR ") + e.what() + "\n";
+    }
+    delete inIO;
+    delete outIO;
+    return "OK\n" + out.str();
+}
+
+#if KYTEA_SERVER_SOCKETS
+
+#ifdef MSG_NOSIGNAL
+#define SERVER_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SERVER_SEND_FLAGS 0
+#endif
+
+// read or write exactly len bytes
+static bool readAll(int fd, char * buff, size_t len) {
+    while(len > 0) {
+        ssize_t r = read(fd, buff, len);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        buff += r; len -= r;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const char * buff, size_t len) {
+    while(len > 0) {
+        // a client that disconnects must not kill the server with SIGPIPE
+        ssize_t r = send(fd, buff, len, SERVER_SEND_FLAGS);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        buff += r; len -= r;
+    }
+    return true;
+}
+
+// fill in the address of a Unix domain socket
+static socklen_t makeSocketAddress(const string & file, sockaddr_storage & addr) {
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_un * un = (sockaddr_un*)&addr;
+    if(file.length() == 0 || file.length() >= sizeof(un->sun_path))
+        THROW_ERROR("Bad socket file name '"<<file<<"' (it must not be empty or longer than "<<sizeof(un->sun_path)-1<<" bytes)");
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, file.c_str());
+    return sizeof(sockaddr_un);
+}
+
+// fill in the address of a TCP port of localhost
+static socklen_t makePortAddress(int port, sockaddr_storage & addr) {
+    memset(&addr, 0, sizeof(addr));
+    if(port <= 0 || port > 65535)
+        THROW_ERROR("Illegal port number "<<port<<" (must be from 1 to 65535)");
+    sockaddr_in * in = (sockaddr_in*)&addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sizeof(sockaddr_in);
+}
+
+static int connectAddress(const sockaddr_storage & addr, socklen_t len, const string & name) {
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if(fd < 0 || ::connect(fd, (const sockaddr*)&addr, len) != 0) {
+        if(fd >= 0) close(fd);
+        THROW_ERROR("Could not connect to the server at "<<name);
+    }
+    return fd;
+}
+
+#endif
+
+bool KyteaServer::readMessage(int fd, string & message) {
+#if KYTEA_SERVER_SOCKETS
+    unsigned char head[4];
+    if(!readAll(fd, (char*)head, 4))
+        return false;
+    size_t len = ((size_t)head[0] << 24) | (head[1] << 16) | (head[2] << 8) | head[3];
+    if(len > SERVER_MAX_MESSAGE)
+        return false;
+    message.resize(len);
+    return len == 0 || readAll(fd, &message[0], len);
+#else
+    return false;
+#endif
+}
+
+bool KyteaServer::writeMessage(int fd, const string & message) {
+#if KYTEA_SERVER_SOCKETS
+    size_t len = message.length();
+    unsigned char head[4] = { (unsigned char)(len >> 24), (unsigned char)(len >> 16), (unsigned char)(len >> 8), (unsigned char)len };
+    return writeAll(fd, (const char*)head, 4) && writeAll(fd, message.data(), len);
+#else
+    return false;
+#endif
+}
+
+int KyteaServer::connectSocket(const string & file) {
+#if KYTEA_SERVER_SOCKETS
+    sockaddr_storage addr;
+    socklen_t len = makeSocketAddress(file, addr);
+    return connectAddress(addr, len, file);
+#else
+    THROW_ERROR("The server is not supported on this system (no sockets or pthreads)");
+#endif
+}
+
+int KyteaServer::connectPort(int port) {
+#if KYTEA_SERVER_SOCKETS
+    sockaddr_storage addr;
+    socklen_t len = makePortAddress(port, addr);
+    ostringstream name; name << "port " << port;
+    return connectAddress(addr, len, name.str());
+#else
+    THROW_ERROR("The server is not supported on this system (no sockets or pthreads)");
+#endif
+}
+
+void KyteaServer::listenSocket(const string & file) {
+#if KYTEA_SERVER_SOCKETS
+    sockaddr_storage addr;
+    socklen_t len = makeSocketAddress(file, addr);
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenFd_ < 0)
+        THROW_ERROR("Could not create a socket for "<<file);
+    unlink(file.c_str());
+    socketFile_ = file;
+    if(bind(listenFd_, (sockaddr*)&addr, len) != 0 || ::listen(listenFd_, 64) != 0)
+        THROW_ERROR("Could not listen on "<<file);
+#else
+    THROW_ERROR("The server is not supported on this system (no sockets or pthreads)");
+#endif
+}
+
+void KyteaServer::listenPort(int port) {
+#if KYTEA_SERVER_SOCKETS
+    sockaddr_storage addr;
+    socklen_t len = makePortAddress(port, addr);
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if(listenFd_ < 0)
+        THROW_ERROR("Could not create a socket for port "<<port);
+    int on = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(bind(listenFd_, (sockaddr*)&addr, len) != 0 || ::listen(listenFd_, 64) != 0)
+        THROW_ERROR("Could not listen on port "<<port);
+#else
+    THROW_ERROR("The server is not supported on this system (no sockets or pthreads)");
+#endif
+}
+
+void KyteaServer::serve() {
+#if KYTEA_SERVER_SOCKETS
+    if(listenFd_ < 0)
+        THROW_ERROR("The server must listen on an address before serving");
+    pthread_mutex_lock(&state_->mutex);
+    state_->running = true;
+    state_->workers.resize(threads_);
+    pthread_mutex_unlock(&state_->mutex);
+    for(int i = 0; i < threads_; i++)
+        pthread_create(&state_->workers[i], NULL, &KyteaServer::workerThread, this);
+    while(true) {
+        int fd = accept(listenFd_, NULL, NULL);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        pthread_mutex_lock(&state_->mutex);
+        bool running = state_->running;
+        if(running) {
+            state_->connections++;
+            state_->fds.push_back(fd);
+        }
+        pthread_mutex_unlock(&state_->mutex);
+        if(!running) {
+            close(fd);
+            break;
+        }
+        ServerConnection * conn = new ServerConnection;
+        conn->server = this;
+        conn->fd = fd;
+        pthread_t thread;
+        pthread_create(&thread, NULL, &KyteaServer::connectionThread, conn);
+        pthread_detach(thread);
+    }
+    // close the connections that are still open and wait for their threads
+    pthread_mutex_lock(&state_->mutex);
+    state_->running = false;
+    for(unsigned i = 0; i < state_->fds.size(); i++)
+        shutdown(state_->fds[i], SHUT_RDWR);
+    pthread_cond_broadcast(&state_->added);
+    pthread_cond_broadcast(&state_->taken);
+    while(state_->connections > 0)
+        pthread_cond_wait(&state_->closed, &state_->mutex);
+    pthread_mutex_unlock(&state_->mutex);
+    for(int i = 0; i < threads_; i++)
+        pthread_join(state_->workers[i], NULL);
+#else
+    THROW_ERROR("The server is not supported on this system (no sockets or pthreads)");
+#endif
+}
+
+void KyteaServer::stop() {
+#if KYTEA_SERVER_SOCKETS
+    pthread_mutex_lock(&state_->mutex);
+    state_->running = false;
+    pthread_mutex_unlock(&state_->mutex);
+    // wake up accept() in serve()
+    if(listenFd_ >= 0)
+        shutdown(listenFd_, SHUT_RDWR);
+#endif
+}
+
+unsigned long KyteaServer::getNumRequests() const {
+#if KYTEA_SERVER_SOCKETS
+    pthread_mutex_lock(&state_->mutex);
+    unsigned long ret = state_->requests;
+    pthread_mutex_unlock(&state_->mutex);
+    return ret;
+#else
+    return state_->requests;
+#endif
+}
+
+unsigned long KyteaServer::getNumBatches() const {
+#if KYTEA_SERVER_SOCKETS
+    pthread_mutex_lock(&state_->mutex);
+    unsigned long ret = state_->batches;
+    pthread_mutex_unlock(&state_->mutex);
+    return ret;
+#else
+    return state_->batches;
+#endif
+}
+
+void * KyteaServer::connectionThread(void * arg) {
+#if KYTEA_SERVER_SOCKETS
+    ServerConnection * conn = (ServerConnection*)arg;
+    conn->server->handleConnection(conn->fd);
+    delete conn;
+#endif
+    return 0;
+}
+
+void * KyteaServer::workerThread(void * arg) {
+    ((KyteaServer*)arg)->work();
+    return 0;
+}
+
+void KyteaServer::handleConnection(int fd) {
+#if KYTEA_SERVER_SOCKETS
+    ServerJob job;
+    while(readMessage(fd, job.request)) {
+        job.done = false;
+        pthread_mutex_lock(&state_->mutex);
+        // wait for room in the queue, so clients slow down when busy
+        while(state_->running && (int)state_->queue.size() >= queueSize_)
+            pthread_cond_wait(&state_->taken, &state_->mutex);
+        if(!state_->running) {
+            pthread_mutex_unlock(&state_->mutex);
+            break;
+        }
+        state_->queue.push_back(&job);
+        pthread_cond_signal(&state_->added);
+        while(!job.done)
+            pthread_cond_wait(&state_->done, &state_->mutex);
+        pthread_mutex_unlock(&state_->mutex);
+        if(!writeMessage(fd, job.response))
+            break;
+    }
+    close(fd);
+    pthread_mutex_lock(&state_->mutex);
+    for(unsigned i = 0; i < state_->fds.size(); i++)
+        if(state_->fds[i] == fd) {
+            state_->fds.erase(state_->fds.begin()+i);
+            break;
+        }
+    state_->connections--;
+    pthread_cond_broadcast(&state_->closed);
+    pthread_mutex_unlock(&state_->mutex);
+#endif
+}
+
+void KyteaServer::work() {
+#if KYTEA_SERVER_SOCKETS
+    vector<ServerJob*> batch;
+    while(true) {
+        batch.clear();
+        pthread_mutex_lock(&state_->mutex);
+        while(state_->running && state_->queue.empty())
+            pthread_cond_wait(&state_->added, &state_->mutex);
+        // wait until the batch is full or the deadline has passed
+        if(state_->running && (int)state_->queue.size() < batchSize_ && deadline_ > 0) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            struct timespec until;
+            long usec = now.tv_usec + deadline_*1000L;
+            until.tv_sec = now.tv_sec + usec / 1000000;
+            until.tv_nsec = (usec % 1000000) * 1000;
+            while(state_->running && (int)state_->queue.size() < batchSize_)
+                if(pthread_cond_timedwait(&state_->added, &state_->mutex, &until) == ETIMEDOUT)
+                    break;
+        }
+        while(!state_->queue.empty() && (int)batch.size() < batchSize_) {
+            batch.push_back(state_->queue.front());
+            state_->queue.pop_front();
+        }
+        bool running = state_->running;
+        pthread_cond_broadcast(&state_->taken);
+        pthread_mutex_unlock(&state_->mutex);
+        if(batch.empty()) {
+            if(!running) break;
+            continue;
+        }
+        // analyze the whole batch with the same model
+        {
+            ModelHandle::Lease lease(handle_);
+            for(unsigned i = 0; i < batch.size(); i++)
+                batch[i]->response = (lease.get() ?
+                    processRequest(*lease.get(), batch[i]->request) :
+                    string("ERROR No model has been loaded\n"));
+        }
+        pthread_mutex_lock(&state_->mutex);
+        for(unsigned i = 0; i < batch.size(); i++)
+            batch[i]->done = true;
+        state_->requests += batch.size();
+        state_->batches++;
+        pthread_cond_broadcast(&state_->done);
+        pthread_mutex_unlock(&state_->mutex);
+    }
+#endif
+}
@@ -0,0 +1,65 @@
+#include <kytea/config.h>
+#include <kytea/kytea-stats.h>
+#include <iomanip>
+#if ENABLE_STATS
+#include <time.h>
+#endif
+
+using namespace kytea;
+using namespace std;
+
+static const char * timerNames[KyteaStats::NUM_TIMERS] = {
+    "time_read", "time_decode", "time_ws_ngram", "time_ws_dict", "time_ws_refresh",
+    "time_tag_known", "time_tag_unknown", "time_write"
+};
+static const char * counterNames[KyteaStats::NUM_COUNTERS] = {
+    "sentences", "chars", "words", "unknown_words", "dict_matches", "beam_truncations"
+};
+
+// the totals, which are added to atomically by all threads
+static unsigned long long timers[KyteaStats::NUM_TIMERS];
+static unsigned long long counters[KyteaStats::NUM_COUNTERS];
+
+bool KyteaStats::isEnabled() {
+    return ENABLE_STATS;
+}
+
+unsigned long long KyteaStats::now() {
+#if ENABLE_STATS
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+void KyteaStats::addTime(Timer timer, unsigned long long start) {
+#if ENABLE_STATS
+    __sync_fetch_and_add(&timers[timer], now()-start);
+#else
+    (void)timer; (void)start;
+#endif
+}
+
+void KyteaStats::count(Counter counter, unsigned long long n) {
+#if ENABLE_STATS
+    __sync_fetch_and_add(&counters[counter], n);
+#else
+    (void)counter; (void)n;
+#endif
+}
+
+void KyteaStats::write(ostream & out) {
+    for(int i = 0; i < NUM_COUNTERS; i++)
+        out << counterNames[i] << '\t' << counters[i] << endl;
+    for(int i = 0; i < NUM_TIMERS; i++)
+        out << timerNames[i] << '\t' << fixed << setprecision(6) << timers[i]/1e9 << endl;
+}
+
+void KyteaStats::reset() {
+    for(int i = 0; i < NUM_TIMERS; i++)
+        timers[i] = 0;
+    for(int i = 0; i < NUM_COUNTERS; i++)
+        counters[i] = 0;
+}
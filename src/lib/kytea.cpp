@@ -15,12 +15,20 @@
 */
 
 #include <set>
+#include <functional>
+#include <climits>
 #include <cmath>
 #include <kytea/config.h>
 #include <kytea/kytea.h>
+#include <kytea/kytea-stats.h>
+#include <kytea/online-learner.h>
+#include <kytea/feature-shards.h>
 #include <kytea/corpus-io.h>
 #include <kytea/model-io.h>
 #include <kytea/dictionary.h>
+#if HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
 
 using namespace kytea;
 using namespace std;
@@ -69,12 +77,15 @@ template <class Entry>
 void Kytea::addTag(typename Dictionary<Entry>::WordMap& allWords, const KyteaString & word, const KyteaTag * tag, int dict) {
     addTag<Entry>(allWords,word,(tag?&tag->first:0),dict);
 }
+// the tests add words to dictionaries directly, so the functions must be
+//  kept even when every use here is inlined
+template void Kytea::addTag<ModelTagEntry>(Dictionary<ModelTagEntry>::WordMap&, const KyteaString &, int, const KyteaString *, int);
 
 template <class Entry>
-void Kytea::scanDictionaries(const vector<string> & dict, typename Dictionary<Entry>::WordMap & wordMap, KyteaConfig * config, StringUtil * util, bool saveIds) {
+void Kytea::scanDictionaries(const vector<string> & dict, typename Dictionary<Entry>::WordMap & wordMap, KyteaConfig * config, StringUtil * util, bool saveIds, int firstDict) {
     // scan the dictionaries
     KyteaString word;
-    unsigned char numDicts = 0;
+    unsigned char numDicts = firstDict;
     for(vector<string>::const_iterator it = dict.begin(); it != dict.end(); it++) {
         if(config_->getDebug())
             cerr << "Reading dictionary from " << *it << " ";
@@ -114,6 +125,34 @@ void Kytea::scanDictionaries(const vector<string> & dict, typename Dictionary<En
     }
 }
 
+// the generations of the dictionaries built or read by any analyzer
+static unsigned lastDictGeneration = 0;
+static unsigned newDictGeneration() {
+    return __sync_add_and_fetch(&lastDictGeneration, 1);
+}
+
+// check whether a sentence has any annotation that can be used in training
+static bool hasAnnotation(const KyteaSentence & sent) {
+    for(unsigned i = 0; i < sent.words.size(); i++)
+        if(sent.words[i].isCertain)
+            return true;
+    for(unsigned i = 0; i < sent.wsConfs.size(); i++)
+        if(sent.wsConfs[i] != 0)
+            return true;
+    return false;
+}
+
+// check whether a corpus can be opened again for each training stage, which
+// is not the case for stdin, pipes, or process substitution
+static bool canReread(const string & file) {
+#if HAVE_SYS_STAT_H
+    struct stat st;
+    return stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+#else
+    return true;
+#endif
+}
+
 void Kytea::buildVocabulary() {
 
     Dictionary<ModelTagEntry>::WordMap & allWords = fio_.getWordMap();
@@ -125,16 +164,20 @@ void Kytea::buildVocabulary() {
     vector<string> corpora = config_->getCorpusFiles();
     vector<CorpusIO::Format> corpForm = config_->getCorpusFormats();
     int maxTag = config_->getNumTags();
+    unsigned numSents = 0;
+    clearKeptSentences();
+    keptCorpora_.resize(corpora.size());
+    keptSents_.resize(corpora.size());
     for(unsigned i = 0; i < corpora.size(); i++) {
         if(config_->getDebug() > 0)
             cerr << "Reading corpus from " << corpora[i] << " ";
+        bool keep = keptCorpora_[i] = !canReread(corpora[i]);
         CorpusIO * io = CorpusIO::createIO(corpora[i].c_str(), corpForm[i], *config_, false, util_);
         io->setNumTags(config_->getNumTags());
         KyteaSentence* next;
         int lines = 0;
         while((next = io->readSentence())) {
             lines++;
-            bool toAdd = false;
             for(unsigned i = 0; i < next->words.size(); i++) {
                 if(next->words[i].isCertain) {
                     maxTag = max(next->words[i].getNumTags(),maxTag);
@@ -143,17 +186,18 @@ void Kytea::buildVocabulary() {
                             addTag<ModelTagEntry>(allWords, next->words[i].surf, j, &next->words[i].getTagSurf(j), -1);
                     if(next->words[i].getNumTags() == 0)
                         addTag<ModelTagEntry>(allWords, next->words[i].surf, 0, 0, -1);
-                    
-                    toAdd = true;
                 }
             }
-            const unsigned wsSize = next->wsConfs.size();
-            for(unsigned i = 0; !toAdd && i < wsSize; i++)
-                toAdd = (next->wsConfs[i] != 0);
-            if(toAdd)
-                sentences_.push_back(next);
-            else
-                delete next;
+            // the sentences are read from the corpora again during training,
+            // unless the corpus cannot be read again
+            if(hasAnnotation(*next)) {
+                numSents++;
+                if(keep) {
+                    keptSents_[i].push_back(next);
+                    continue;
+                }
+            }
+            delete next;
         }
         if(config_->getDebug() > 0) {
             if(lines)
@@ -164,11 +208,12 @@ void Kytea::buildVocabulary() {
         delete io;
     }
     config_->setNumTags(maxTag);
+    numSents_ = numSents;
 
     // scan the dictionaries
     scanDictionaries<ModelTagEntry>(config_->getDictionaryFiles(), allWords, config_, util_, true);
 
-    if(sentences_.size() == 0 && fio_.getFeatures().size() == 0)
+    if(numSents == 0 && fio_.getFeatures().size() == 0)
         THROW_ERROR("There were no sentences in the training data. Check to make sure your training file contains sentences.");
 
     if(config_->getDebug() > 0)
@@ -178,20 +223,78 @@ void Kytea::buildVocabulary() {
     if(dict_ != 0) delete dict_;
     dict_ = new Dictionary<ModelTagEntry>(util_);
     dict_->buildIndex(allWords);
+    dictGeneration_ = newDictGeneration();
+    maxWordLength_ = dict_->getMaxLength();
     dict_->setNumDicts(max((int)config_->getDictionaryFiles().size(),fio_.getNumDicts()));
     if(config_->getDebug() > 0)
         cerr << "done!" << endl;
 
 }
 
+// make shards to write the training features to, if a scratch directory was
+// specified
+FeatureShards * Kytea::makeShards() {
+    if(config_->getScratchDir().length() == 0)
+        return 0;
+    return new FeatureShards(config_->getScratchDir(), (size_t)(config_->getShardMemory()*1024*1024), config_->getBias());
+}
+
+void Kytea::resetSentences() {
+    corpusPos_ = 0; keptPos_ = 0; passSents_ = 0;
+    if(corpusIO_) { delete corpusIO_; corpusIO_ = 0; }
+    if(streamSent_) { delete streamSent_; streamSent_ = 0; }
+}
+
+KyteaSentence * Kytea::nextSentence() {
+    if(streamSent_) { delete streamSent_; streamSent_ = 0; }
+    const vector<string> & corpora = config_->getCorpusFiles();
+    while(corpusPos_ < corpora.size()) {
+        if(corpusPos_ < keptCorpora_.size() && keptCorpora_[corpusPos_]) {
+            // give a copy, as the training stages may change the sentence
+            if(keptPos_ < keptSents_[corpusPos_].size()) {
+                passSents_++;
+                streamSent_ = new KyteaSentence(*keptSents_[corpusPos_][keptPos_++]);
+                return streamSent_;
+            }
+            keptPos_ = 0;
+            corpusPos_++;
+            continue;
+        }
+        if(!corpusIO_) {
+            corpusIO_ = CorpusIO::createIO(corpora[corpusPos_].c_str(), config_->getCorpusFormats()[corpusPos_], *config_, false, util_);
+            corpusIO_->setNumTags(config_->getNumTags());
+        }
+        while((streamSent_ = corpusIO_->readSentence())) {
+            if(hasAnnotation(*streamSent_)) {
+                passSents_++;
+                return streamSent_;
+            }
+            delete streamSent_;
+        }
+        delete corpusIO_; corpusIO_ = 0;
+        corpusPos_++;
+    }
+    if(passSents_ < numSents_) {
+        ostringstream buff;
+        buff << "Only " << passSents_ << " of the " << numSents_ << " training sentences could be read again from the corpora. Make sure they were not changed during training";
+        THROW_ERROR(buff.str());
+    }
+    return 0;
+}
+
+void Kytea::clearKeptSentences() {
+    for(unsigned i = 0; i < keptSents_.size(); i++)
+        for(unsigned j = 0; j < keptSents_[i].size(); j++)
+            delete keptSents_[i][j];
+    keptSents_.clear();
+    keptCorpora_.clear();
+}
+
 /////////////////////////////////
 // Word segmentation functions //
 /////////////////////////////////
 
 unsigned Kytea::wsDictionaryFeatures(const KyteaString & chars, SentenceFeatures & features) {
-    // vector<Entry*> & entries = dict_->getEntries();
-    // vector<DictionaryState*> & states = dict_->getStates();
-    // unsigned currState = 0, nextState;
     ModelTagEntry* myEntry;
     const unsigned len = features.size(), max=config_->getDictionaryN(), dictLen = len*3*max;
     vector<char> on(dict_->getNumDicts()*dictLen, 0);
@@ -304,27 +407,49 @@ void Kytea::trainWS() {
         cerr << "Creating word segmentation features ";
     // create word prefixes
     vector<unsigned> dictFeats;
-    bool hasDictionary = (dict_->getNumDicts() > 0 && dict_->getStates().size() > 0);
+    bool hasDictionary = (dict_->getNumDicts() > 0 && dict_->getNumStates() > 0);
     preparePrefixes();
-    // make the sentence features one by one
-    unsigned scount = 0;
+    // when training online, the weights are updated as the features are
+    // made, and the corpora are read once for every epoch
+    OnlineLearner * learner = (config_->getOnlineEpochs() > 0 ? new OnlineLearner(config_->getOnlineAlgorithm(), config_->getBias()) : 0);
+    // otherwise, the features can be written to disk instead of memory
+    FeatureShardsHolder shardsHolder(!learner ? makeShards() : 0);
+    FeatureShards * shards = shardsHolder.get();
     vector< vector<unsigned> > & xs = trip->first;
     vector<int> & ys = trip->second;
-    for(Sentences::const_iterator it = sentences_.begin(); it != sentences_.end(); it++) {
-        if(++scount % 1000 == 0)
-            cerr << ".";
-        KyteaSentence * sent = *it;
-        SentenceFeatures feats(sent->wsConfs.size());
-        unsigned fts = 0;
-        if(hasDictionary)
-            fts += wsDictionaryFeatures(sent->chars, feats);
-        fts += wsNgramFeatures(sent->chars, feats, charPrefixes_, config_->getCharN());
-        string str = util_->getTypeString(sent->chars);
-        fts += wsNgramFeatures(util_->mapString(str), feats, typePrefixes_, config_->getTypeN());
-        for(unsigned i = 0; i < feats.size(); i++) {
-            if(abs(sent->wsConfs[i]) > config_->getConfidence()) {
-                xs.push_back(feats[i]);
-                ys.push_back(sent->wsConfs[i]>1?1:-1);
+    const unsigned numLoaded = xs.size();
+    for(unsigned i = 0; shards && i < numLoaded; i++)
+        shards->addExample(xs[i], ys[i]);
+    for(int epoch = 0; epoch < max(config_->getOnlineEpochs(),1); epoch++) {
+        for(unsigned i = 0; learner && i < numLoaded; i++)
+            learner->update(xs[i], ys[i]);
+        // make the sentence features one by one
+        unsigned scount = 0;
+        KyteaSentence * sent;
+        resetSentences();
+        while((sent = nextSentence())) {
+            if(++scount % 1000 == 0)
+                cerr << ".";
+            SentenceFeatures feats(sent->wsConfs.size());
+            unsigned fts = 0;
+            if(hasDictionary)
+                fts += wsDictionaryFeatures(sent->chars, feats);
+            fts += wsNgramFeatures(sent->chars, feats, charPrefixes_, config_->getCharN());
+            string str = util_->getTypeString(sent->chars);
+            fts += wsNgramFeatures(util_->mapString(str), feats, typePrefixes_, config_->getTypeN());
+            for(unsigned i = 0; i < feats.size(); i++) {
+                if(abs(sent->wsConfs[i]) > config_->getConfidence()) {
+                    int y = (sent->wsConfs[i]>1?1:-1);
+                    if(learner)
+                        learner->update(feats[i], y);
+                    else if(shards)
+                        shards->addExample(feats[i], y);
+                    // only keep the features in memory for liblinear or -featout
+                    if((!learner && !shards) || (epoch == 0 && config_->getWriteFeatures())) {
+                        xs.push_back(feats[i]);
+                        ys.push_back(y);
+                    }
+                }
             }
         }
     }
@@ -332,7 +457,17 @@ void Kytea::trainWS() {
         cerr << " done!" << endl << "Building classifier ";
 
     // train the model
-    wsModel_->trainModel(xs,ys,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost());
+    if(learner) {
+        learner->finish(*wsModel_);
+        delete learner;
+    } else {
+        ModelWeights initWeights;
+        const ModelWeights * init = getInitWeights(initModel_ ? initModel_->wsModel_ : 0, 0, 0, initWeights);
+        if(shards)
+            wsModel_->trainModel(*shards,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost(),config_->getNumThreads(),init);
+        else
+            wsModel_->trainModel(xs,ys,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost(),config_->getNumThreads(),init);
+    }
 
     if(config_->getDebug() > 0)
         cerr << " done!" << endl;
@@ -402,39 +537,68 @@ void Kytea::trainGlobalTags(int lev) {
     globalMods_[lev] = (trip->third?trip->third:new KyteaModel());
     trip->third = globalMods_[lev];
     KyteaString kssx = util_->mapString("SX"), ksst = util_->mapString("ST");
+    OnlineLearner * learner = (config_->getOnlineEpochs() > 0 ? new OnlineLearner(config_->getOnlineAlgorithm(), config_->getBias()) : 0);
+    FeatureShardsHolder shardsHolder(!learner ? makeShards() : 0);
+    FeatureShards * shards = shardsHolder.get();
+    const unsigned numLoaded = trip->first.size();
+    for(unsigned i = 0; shards && i < numLoaded; i++)
+        shards->addExample(trip->first[i], trip->second[i]);
     
     // build features
-    for(Sentences::const_iterator it = sentences_.begin(); it != sentences_.end(); it++) {
-        int startPos = 0, finPos=0;
-        KyteaString charStr = (*it)->chars;
-        KyteaString typeStr = util_->mapString(util_->getTypeString(charStr));
-        for(unsigned j = 0; j < (*it)->words.size(); j++) {
-            startPos = finPos;
-            KyteaWord & word = (*it)->words[j];
-            finPos = startPos+word.surf.length();
-            if(!word.getTag(lev) || word.getTagConf(lev) <= config_->getConfidence())
-                continue;
-            unsigned myTag;
-            KyteaString tagSurf = word.getTagSurf(lev);
-            for(myTag = 0; myTag < trip->fourth.size() && tagSurf != trip->fourth[myTag]; myTag++);
-            if(myTag == trip->fourth.size()) 
-                trip->fourth.push_back(tagSurf);
-            myTag++;
-            vector<unsigned> feat;
-            tagNgramFeatures(charStr, feat, charPrefixes_, trip->third, config_->getCharN(), startPos-1, finPos);
-            tagNgramFeatures(typeStr, feat, typePrefixes_, trip->third, config_->getTypeN(), startPos-1, finPos);
-            tagSelfFeatures(word.surf, feat, kssx, trip->third);
-            tagSelfFeatures(util_->mapString(util_->getTypeString(word.surf)), feat, ksst, trip->third);
-            tagDictFeatures(word.surf, lev, feat, trip->third);
-            trip->first.push_back(feat);
-            trip->second.push_back(myTag);
+    for(int epoch = 0; epoch < max(config_->getOnlineEpochs(),1); epoch++) {
+        for(unsigned i = 0; learner && i < numLoaded; i++)
+            learner->update(trip->first[i], trip->second[i]);
+        KyteaSentence * sent;
+        resetSentences();
+        while((sent = nextSentence())) {
+            int startPos = 0, finPos=0;
+            KyteaString charStr = sent->chars;
+            KyteaString typeStr = util_->mapString(util_->getTypeString(charStr));
+            for(unsigned j = 0; j < sent->words.size(); j++) {
+                startPos = finPos;
+                KyteaWord & word = sent->words[j];
+                finPos = startPos+word.surf.length();
+                if(!word.getTag(lev) || word.getTagConf(lev) <= config_->getConfidence())
+                    continue;
+                unsigned myTag;
+                KyteaString tagSurf = word.getTagSurf(lev);
+                for(myTag = 0; myTag < trip->fourth.size() && tagSurf != trip->fourth[myTag]; myTag++);
+                if(myTag == trip->fourth.size()) 
+                    trip->fourth.push_back(tagSurf);
+                myTag++;
+                vector<unsigned> feat;
+                tagNgramFeatures(charStr, feat, charPrefixes_, trip->third, config_->getCharN(), startPos-1, finPos);
+                tagNgramFeatures(typeStr, feat, typePrefixes_, trip->third, config_->getTypeN(), startPos-1, finPos);
+                tagSelfFeatures(word.surf, feat, kssx, trip->third);
+                tagSelfFeatures(util_->mapString(util_->getTypeString(word.surf)), feat, ksst, trip->third);
+                tagDictFeatures(word.surf, lev, feat, trip->third);
+                if(learner)
+                    learner->update(feat, myTag);
+                else if(shards)
+                    shards->addExample(feat, myTag);
+                if((!learner && !shards) || (epoch == 0 && config_->getWriteFeatures())) {
+                    trip->first.push_back(feat);
+                    trip->second.push_back(myTag);
+                }
+            }
         }
     }
     if(config_->getDebug() > 0)
         cerr << "done!" << endl << "Training global tag classifiers ";
 
-
-    trip->third->trainModel(trip->first,trip->second,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost()); 
+    if(learner) {
+        learner->finish(*trip->third);
+        delete learner;
+    } else {
+        ModelWeights initWeights;
+        const ModelWeights * init = 0;
+        if(initModel_ && lev < (int)initModel_->globalMods_.size())
+            init = getInitWeights(initModel_->globalMods_[lev], &initModel_->globalTags_[lev], &trip->fourth, initWeights);
+        if(shards)
+            trip->third->trainModel(*shards,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost(),config_->getNumThreads(),init);
+        else
+            trip->third->trainModel(trip->first,trip->second,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost(),config_->getNumThreads(),init); 
+    }
 
     globalTags_[lev] = trip->fourth;
     if(config_->getDebug() > 0)
@@ -479,13 +643,15 @@ void Kytea::trainLocalTags(int lev) {
         }
     }
     // build features
-    for(Sentences::const_iterator it = sentences_.begin(); it != sentences_.end(); it++) {
+    KyteaSentence * sent;
+    resetSentences();
+    while((sent = nextSentence())) {
         int startPos = 0, finPos=0;
-        KyteaString charStr = (*it)->chars;
+        KyteaString charStr = sent->chars;
         KyteaString typeStr = util_->mapString(util_->getTypeString(charStr));
-        for(unsigned j = 0; j < (*it)->words.size(); j++) {
+        for(unsigned j = 0; j < sent->words.size(); j++) {
             startPos = finPos;
-            KyteaWord & word = (*it)->words[j];
+            KyteaWord & word = sent->words[j];
             finPos = startPos+word.surf.length();
             if(!word.getTag(lev) || word.getTagConf(lev) <= config_->getConfidence())
                 continue;
@@ -513,8 +679,16 @@ void Kytea::trainLocalTags(int lev) {
             vector< vector<unsigned> > & xs = trip->first;
             vector<int> & ys = trip->second;
             
+            // find the model of the same word in the initial model
+            ModelWeights initWeights;
+            const ModelWeights * init = 0;
+            if(initModel_ && initModel_->dict_) {
+                const ModelTagEntry * oldEntry = initModel_->dict_->findEntry(initModel_->util_->mapString(util_->showString(myEntry->word)));
+                if(oldEntry && (int)oldEntry->tagMods.size() > lev)
+                    init = getInitWeights(oldEntry->tagMods[lev], &oldEntry->tags[lev], &myEntry->tags[lev], initWeights);
+            }
             // train the model
-            trip->third->trainModel(xs,ys,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost());
+            trip->third->trainModel(xs,ys,config_->getBias(),config_->getSolverType(),config_->getEpsilon(),config_->getCost(),config_->getNumThreads(),init);
             if(trip->third->getNumClasses() == 1) {
                 int myLab = trip->third->getLabel(0)-1;
                 KyteaString tmpString = myEntry->tags[lev][0]; myEntry->tags[lev][0] = myEntry->tags[lev][myLab]; myEntry->tags[lev][myLab] = tmpString;
@@ -530,10 +704,55 @@ void Kytea::trainLocalTags(int lev) {
         cerr << "done!" << endl;
 }
 
+void Kytea::loadInitModel() {
+    if(config_->getInitModelFile().length() == 0)
+        return;
+    if(config_->getSolverType() != 0 && config_->getSolverType() != 2)
+        cerr << "WARNING: -init is only effective with solvers 0 and 2, training will start from zero" << endl;
+    if(config_->getOnlineEpochs() > 0)
+        cerr << "WARNING: -init is not used for models trained online (WS and global tags)" << endl;
+    if(config_->getDebug() > 0)
+        cerr << "Loading the initial model ";
+    if(initModel_)
+        delete initModel_;
+    initModel_ = new Kytea();
+    initModel_->readModel(config_->getInitModelFile().c_str());
+    if(config_->getDebug() > 0)
+        cerr << " done!" << endl;
+}
+
+// Get the weights of a model from the initial model to start training
+// from. If tags are given, the labels of the old model are converted from
+// indices into oldTags to indices into newTags
+const ModelWeights * Kytea::getInitWeights(const KyteaModel * oldMod, const vector<KyteaString> * oldTags, const vector<KyteaString> * newTags, ModelWeights & ret) {
+    if(oldMod == 0)
+        return 0;
+    StringUtil * oldUtil = initModel_->util_;
+    oldMod->getModelWeights(oldUtil, util_, initModel_->config_->getDictionaryN(), ret);
+    if(ret.weights.size() == 0)
+        return 0;
+    if(oldTags && newTags) {
+        for(unsigned i = 0; i < ret.labels.size(); i++) {
+            int oldLab = ret.labels[i]-1;
+            ret.labels[i] = 0;
+            if(oldLab < 0 || oldLab >= (int)oldTags->size())
+                continue;
+            KyteaString tag = util_->mapString(oldUtil->showString((*oldTags)[oldLab]));
+            for(unsigned j = 0; j < newTags->size(); j++)
+                if((*newTags)[j] == tag)
+                    ret.labels[i] = j+1;
+        }
+    }
+    return &ret;
+}
+
 vector<pair<int,int> > Kytea::getDictionaryMatches(const KyteaString & surf, int lev) {
+    if(!dict_) return vector<pair<int,int> >();
+    return getDictionaryMatches(dict_->findEntry(surf), lev);
+}
+
+vector<pair<int,int> > Kytea::getDictionaryMatches(const ModelTagEntry * ent, int lev) {
     vector<pair<int,int> > ret;
-    if(!dict_) return ret;
-    const ModelTagEntry* ent = dict_->findEntry(surf);
     if(ent == 0 || ent->inDict == 0 || (int)ent->tagInDicts.size() <= lev)
         return ret;
     // For each tag
@@ -547,6 +766,100 @@ vector<pair<int,int> > Kytea::getDictionaryMatches(const KyteaString & surf, int
     return ret;
 }
 
+void Kytea::getTagCandidates(int lev, vector<KyteaString> & tags) const {
+    tags.clear();
+    KyteaStringMap<int> seen;
+    if(lev < (int)globalTags_.size())
+        for(unsigned i = 0; i < globalTags_[lev].size(); i++)
+            if(seen.insert(pair<KyteaString,int>(globalTags_[lev][i], tags.size())).second)
+                tags.push_back(globalTags_[lev][i]);
+    if(dict_ == 0)
+        return;
+    const vector<ModelTagEntry*> & entries = dict_->getEntries();
+    for(unsigned i = 0; i < entries.size(); i++) {
+        if((int)entries[i]->tags.size() <= lev)
+            continue;
+        const vector<KyteaString> & myTags = entries[i]->tags[lev];
+        for(unsigned j = 0; j < myTags.size(); j++)
+            if(seen.insert(pair<KyteaString,int>(myTags[j], tags.size())).second)
+                tags.push_back(myTags[j]);
+    }
+}
+
+void Kytea::buildTagIds() {
+    tagIds_.clear();
+    tagIds_.resize(config_->getNumTags());
+    vector<KyteaString> tags;
+    for(int i = 0; i < config_->getNumTags(); i++) {
+        getTagCandidates(i, tags);
+        for(unsigned j = 0; j < tags.size(); j++)
+            tagIds_[i].insert(pair<KyteaString,int>(tags[j], j));
+    }
+}
+
+int Kytea::getTagId(int lev, const KyteaString & tag) const {
+    if(lev < 0 || lev >= (int)tagIds_.size())
+        return -1;
+    KyteaStringMap<int>::const_iterator it = tagIds_[lev].find(tag);
+    return (it == tagIds_[lev].end() ? -1 : it->second);
+}
+
+// mark matches as found in chars with the dictionary of generation gen
+static void markMatches(const KyteaString & chars, unsigned gen, unsigned & matchGen, KyteaString & matchChars) {
+    matchGen = gen;
+    matchChars = KyteaString(chars.length());
+    matchChars.splice(chars, 0);
+}
+
+// check whether matches were found in chars with the dictionary of
+//  generation gen
+static bool hasMatches(const KyteaString & chars, unsigned gen, unsigned matchGen, const KyteaString & matchChars) {
+    return gen != 0 && matchGen == gen && matchChars == chars;
+}
+
+// the same for the dictionary matches of a sentence
+static void markSentenceMatches(KyteaSentence & sent, unsigned gen) {
+    markMatches(sent.chars, gen, sent.dictMatchGeneration, sent.dictMatchChars);
+}
+static bool hasSentenceMatches(const KyteaSentence & sent, unsigned gen) {
+    return hasMatches(sent.chars, gen, sent.dictMatchGeneration, sent.dictMatchChars);
+}
+
+const Dictionary<ModelTagEntry>::MatchResult & Kytea::getOverlayMatches(KyteaSentence & sent, const OverlayDictionary * overlay) {
+    const unsigned gen = (overlay ? overlay->generation : 0);
+    if(!hasMatches(sent.chars, gen, sent.overlayMatchGeneration, sent.overlayMatchChars)) {
+        if(overlay) {
+            sent.overlayMatches = overlay->dict->match(sent.chars);
+            KYTEA_STATS_COUNT(COUNT_DICT_MATCHES, sent.overlayMatches.size());
+        } else
+            sent.overlayMatches.clear();
+        markMatches(sent.chars, gen, sent.overlayMatchGeneration, sent.overlayMatchChars);
+    }
+    return sent.overlayMatches;
+}
+
+const Dictionary<ModelTagEntry>::MatchResult & Kytea::getSentenceMatches(KyteaSentence & sent) {
+    if(dict_ == 0 || !hasSentenceMatches(sent, dictGeneration_)) {
+        if(dict_) {
+            sent.dictMatches = dict_->match(sent.chars);
+            KYTEA_STATS_COUNT(COUNT_DICT_MATCHES, sent.dictMatches.size());
+        } else
+            sent.dictMatches.clear();
+        markSentenceMatches(sent, dictGeneration_);
+    }
+    return sent.dictMatches;
+}
+
+ModelTagEntry * Kytea::findMatchedEntry(const Dictionary<ModelTagEntry>::MatchResult & matches, unsigned end, unsigned len) {
+    // the matches are in order of their last character
+    Dictionary<ModelTagEntry>::MatchResult::const_iterator it = lower_bound(matches.begin(), matches.end(),
+        pair<unsigned,ModelTagEntry*>(end, (ModelTagEntry*)0));
+    for( ; it != matches.end() && it->first == end; it++)
+        if(it->second->word.length() == len)
+            return it->second;
+    return 0;
+}
+
 unsigned Kytea::tagDictFeatures(const KyteaString & surf, int lev, vector<unsigned> & myFeats, KyteaModel * model) {
     vector<pair<int,int> > matches = getDictionaryMatches(surf,lev);
     if(matches.size() == 0) {
@@ -764,16 +1077,20 @@ void Kytea::trainUnk(int lev) {
 //////////////////
 
 void Kytea::buildFeatureLookups() {
+    // models read from a file may not have a dictionary
+    const int numDicts = (dict_ ? dict_->getNumDicts() : 0);
     // Write out the word segmentation features
-    wsModel_->buildFeatureLookup(util_, 
-                                 config_->getCharWindow(), config_->getTypeWindow(),
-                                 dict_->getNumDicts(), config_->getDictionaryN());
+    if(wsModel_)
+        wsModel_->buildFeatureLookup(util_, 
+                                     config_->getCharWindow(), config_->getTypeWindow(),
+                                     numDicts, config_->getDictionaryN());
     for(int i = 0; i < (int)globalMods_.size(); i++)
         if(globalMods_[i])
             globalMods_[i]->buildFeatureLookup(util_, 
                                                config_->getCharWindow(), config_->getTypeWindow(),
-                                               dict_->getNumDicts(), config_->getDictionaryN());
+                                               numDicts, config_->getDictionaryN());
     // Build the entries for the local models
+    if(!dict_) return;
     vector<ModelTagEntry*> & localEntries = dict_->getEntries();
     for(int i = 0; i < (int)localEntries.size(); i++) {
         if(localEntries[i]) {
@@ -781,7 +1098,7 @@ void Kytea::buildFeatureLookups() {
                 if(localEntries[i]->tagMods[j]) {
                     localEntries[i]->tagMods[j]->buildFeatureLookup(util_, 
                                                        config_->getCharWindow(), config_->getTypeWindow(),
-                                                       dict_->getNumDicts(), config_->getDictionaryN());    
+                                                       numDicts, config_->getDictionaryN());    
                 }
             }
         }
@@ -789,6 +1106,41 @@ void Kytea::buildFeatureLookups() {
 
 }
 
+vector<KyteaModel*> Kytea::getLookupModels() {
+    vector<KyteaModel*> ret;
+    if(wsModel_ && wsModel_->getFeatureLookup())
+        ret.push_back(wsModel_);
+    for(int i = 0; i < (int)globalMods_.size(); i++)
+        if(globalMods_[i] && globalMods_[i]->getFeatureLookup())
+            ret.push_back(globalMods_[i]);
+    if(dict_) {
+        vector<ModelTagEntry*> & localEntries = dict_->getEntries();
+        for(int i = 0; i < (int)localEntries.size(); i++)
+            for(int j = 0; localEntries[i] && j < (int)localEntries[i]->tagMods.size(); j++)
+                if(localEntries[i]->tagMods[j] && localEntries[i]->tagMods[j]->getFeatureLookup())
+                    ret.push_back(localEntries[i]->tagMods[j]);
+    }
+    return ret;
+}
+
+void Kytea::getFeatureWeights(vector<double> & weights) {
+    vector<KyteaModel*> models = getLookupModels();
+    for(unsigned i = 0; i < models.size(); i++) {
+        vector<double> vals;
+        models[i]->getFeatureLookup()->getEntryWeights(vals);
+        for(unsigned j = 0; j < vals.size(); j++)
+            weights.push_back(vals[j]*models[i]->getMultiplier());
+    }
+}
+
+unsigned Kytea::pruneFeatures(double cutoff) {
+    vector<KyteaModel*> models = getLookupModels();
+    unsigned removed = 0;
+    for(unsigned i = 0; i < models.size(); i++)
+        removed += models[i]->getFeatureLookup()->prune(cutoff, models[i]->getMultiplier(), util_);
+    return removed;
+}
+
 void Kytea::writeModel(const char* fileName) {
 
     if(config_->getDebug() > 0)    
@@ -838,15 +1190,26 @@ void Kytea::readModel(const char* fileName) {
     }
     // read the dictionaries
     dict_ = modin->readModelDictionary();
+    dictGeneration_ = (dict_ ? newDictGeneration() : 0);
+    maxWordLength_ = (dict_ ? dict_->getMaxLength() : 0);
     subwordDict_ = modin->readProbDictionary();
     subwordModels_.resize(config_->getNumTags(),0);
     for(int i = 0; i < config_->getNumTags(); i++)
         subwordModels_[i] = modin->readLM();
 
     delete modin;
+
+    // cache the tags of unknown words, and optionally whole sentences
+    if(unkCache_) delete unkCache_;
+    unkCache_ = new TagCache(config_->getUnkCache());
+    if(sentCache_) delete sentCache_;
+    sentCache_ = 0;
+    if(config_->getSentenceCache() > 0)
+        sentCache_ = new SentenceCache(UINT_MAX, (size_t)config_->getSentenceCache()*1024*1024);
     
     // prepare the prefixes in advance for faster analysis
     preparePrefixes();
+    buildTagIds();
 
     if(config_->getDebug() > 0)    
         cerr << " done!" << endl;
@@ -857,13 +1220,85 @@ void Kytea::readModel(const char* fileName) {
 // Analysis functions //
 ////////////////////////
 
+OverlayDictionary * Kytea::acquireOverlay() {
+    overlayMutex_.lock();
+    OverlayDictionary * ret = overlay_;
+    if(ret) ret->refs++;
+    overlayMutex_.unlock();
+    return ret;
+}
+
+void Kytea::releaseOverlay(OverlayDictionary * overlay) {
+    if(!overlay) return;
+    overlayMutex_.lock();
+    bool last = (--overlay->refs == 0);
+    overlayMutex_.unlock();
+    if(last) delete overlay;
+}
+
+void Kytea::loadOverlayDictionary(const string & file, int slot) {
+    // models trained without dictionaries can still use the overlay's tags
+    const int numDicts = (dict_ ? max((int)dict_->getNumDicts(), 1) : 0);
+    if(slot < 0 || slot >= numDicts)
+        THROW_ERROR("The overlay dictionary must use one of the "<<numDicts<<" dictionaries of the model (not "<<slot+1<<")");
+    // build the new dictionary before replacing the old one
+    Dictionary<ModelTagEntry>::WordMap wordMap;
+    scanDictionaries<ModelTagEntry>(vector<string>(1, file), wordMap, config_, util_, true, slot);
+    if(wordMap.size() == 0)
+        THROW_ERROR("The overlay dictionary "<<file<<" has no entries");
+    Dictionary<ModelTagEntry> * dict = new Dictionary<ModelTagEntry>(util_);
+    dict->buildIndex(wordMap);
+    dict->setNumDicts(dict_->getNumDicts());
+    overlayMutex_.lock();
+    OverlayDictionary * old = overlay_;
+    overlay_ = new OverlayDictionary(dict, slot, newDictGeneration());
+    overlayMutex_.unlock();
+    releaseOverlay(old);
+}
+
+void Kytea::clearOverlayDictionary() {
+    overlayMutex_.lock();
+    OverlayDictionary * old = overlay_;
+    overlay_ = 0;
+    overlayMutex_.unlock();
+    releaseOverlay(old);
+}
+
 void Kytea::calculateWS(KyteaSentence & sent) {
+    OverlayHolder overlay(*this);
+    calculateWS(sent, overlay.get());
+}
+
+void Kytea::calculateWS(KyteaSentence & sent, const OverlayDictionary * overlay) {
     
     // Skip empty sentences
     if(sent.chars.length() == 0)
         return;
 
+    calculateWSConfs(sent, overlay);
+    KYTEA_STATS_START(TIME_WS_REFRESH);
+    const Dictionary<ModelTagEntry>::MatchResult & matches = sent.dictMatches, & overlayMatches = sent.overlayMatches;
+    sent.refreshWS(config_->getConfidence());
+    unsigned end = 0;
+    for(int i = 0; i < (int)sent.words.size(); i++) {
+        KyteaWord & word = sent.words[i];
+        end += word.surf.length();
+        word.setUnknown(findMatchedEntry(matches, end-1, word.surf.length()) == 0 &&
+                        findMatchedEntry(overlayMatches, end-1, word.surf.length()) == 0);
+        KYTEA_STATS_COUNT(COUNT_UNKNOWN_WORDS, word.getUnknown());
+    }
+    KYTEA_STATS_COUNT(COUNT_WORDS, sent.words.size());
+    if(KyteaModel::isProbabilistic(config_->getSolverType())) {
+        for(unsigned i = 0; i < sent.wsConfs.size(); i++)
+            sent.wsConfs[i] = 1/(1.0+exp(-abs(sent.wsConfs[i])));
+    }
+    KYTEA_STATS_STOP(TIME_WS_REFRESH);
+}
+
+void Kytea::calculateWSConfs(KyteaSentence & sent, const OverlayDictionary * overlay) {
+
     // get the features for the sentence
+    KYTEA_STATS_START(TIME_WS_NGRAM);
     FeatureLookup * featLookup = wsModel_->getFeatureLookup();
     vector<FeatSum> scores(sent.chars.length()-1, featLookup->getBias(0));
     featLookup->addNgramScores(featLookup->getCharDict(), 
@@ -872,25 +1307,32 @@ void Kytea::calculateWS(KyteaSentence & sent) {
     featLookup->addNgramScores(featLookup->getTypeDict(), 
                                util_->mapString(util_->getTypeString(sent.chars)), 
                                config_->getTypeWindow(), scores);
-    if(featLookup->getDictVector())
-        featLookup->addDictionaryScores(
-            dict_->match(sent.chars),
-            dict_->getNumDicts(), config_->getDictionaryN(),
-            scores);
+    KYTEA_STATS_STOP(TIME_WS_NGRAM);
+    KYTEA_STATS_START(TIME_WS_DICT);
+    const Dictionary<ModelTagEntry>::MatchResult & matches = getSentenceMatches(sent);
+    sent.overlayGeneration = (overlay ? overlay->generation : 0);
+    // the words of the overlay are in one of the model's dictionaries
+    const Dictionary<ModelTagEntry>::MatchResult & overlayMatches = getOverlayMatches(sent, overlay);
+    if(featLookup->getDictVector()) {
+        if(overlayMatches.size() && overlay->slot < dict_->getNumDicts()) {
+            Dictionary<ModelTagEntry>::MatchResult allMatches(matches);
+            allMatches.insert(allMatches.end(), overlayMatches.begin(), overlayMatches.end());
+            featLookup->addDictionaryScores(
+                allMatches,
+                dict_->getNumDicts(), config_->getDictionaryN(),
+                scores);
+        } else
+            featLookup->addDictionaryScores(
+                matches,
+                dict_->getNumDicts(), config_->getDictionaryN(),
+                scores);
+    }
+    KYTEA_STATS_STOP(TIME_WS_DICT);
 
     // Update values, but only ones that are not already sure
     for(unsigned i = 0; i < sent.wsConfs.size(); i++)
         if(abs(sent.wsConfs[i]) <= config_->getConfidence())
             sent.wsConfs[i] = scores[i]*wsModel_->getMultiplier();
-    sent.refreshWS(config_->getConfidence());
-    for(int i = 0; i < (int)sent.words.size(); i++) {
-        KyteaWord & word = sent.words[i];
-        word.setUnknown(dict_->findEntry(word.surf) == 0);
-    }
-    if(KyteaModel::isProbabilistic(config_->getSolverType())) {
-        for(unsigned i = 0; i < sent.wsConfs.size(); i++)
-            sent.wsConfs[i] = 1/(1.0+exp(-abs(sent.wsConfs[i])));
-    }
 }
 
 // generate candidates with TM scores
@@ -898,44 +1340,106 @@ bool kyteaTagMore(const KyteaTag a, const KyteaTag b) {
     return a.second > b.second;
 }
 
-# define BEAM_SIZE 50
+// a hypothesis in the search for the tags of unknown words. hypotheses
+// point back to the previous subword, so tag strings only need to be built
+// for the final candidates
+class UnkHypothesis {
+public:
+    UnkHypothesis(int back, const KyteaString * tag, unsigned len, unsigned state, double score) :
+        back(back), tag(tag), len(len), state(state), score(score) { }
+    int back;                // the previous hypothesis (-1 for the start)
+    const KyteaString * tag; // the tag of the last subword
+    unsigned len;            // the total length of the tag string
+    unsigned state;          // the LM state after the tag string
+    double score;
+};
+
+// compare hypotheses by score, used to keep the beam as a min-heap
+class UnkHypothesisMore {
+public:
+    UnkHypothesisMore(const vector<UnkHypothesis> & hyps) : hyps_(hyps) { }
+    bool operator() (int a, int b) const {
+        return hyps_[a].score > hyps_[b].score;
+    }
+private:
+    const vector<UnkHypothesis> & hyps_;
+};
+
 vector< KyteaTag > Kytea::generateTagCandidates(const KyteaString & str, int lev) {
     // cerr << "generateTagCandidates("<<util_->showString(str)<<")"<<endl;
     Dictionary<ProbTagEntry>::MatchResult matches = subwordDict_->match(str);
-    vector< vector< KyteaTag > > stack(str.length()+1);
-    stack[0].push_back(KyteaTag(KyteaString(),0));
-    unsigned end, start, lastEnd = 0;
+    const KyteaLM * lm = subwordModels_[lev];
+    const unsigned len = str.length(), beam = config_->getUnkBeam();
+    vector<UnkHypothesis> hyps(1, UnkHypothesis(-1, 0, 0, lm->getStartState(), 0));
+    vector< vector<int> > stack(len+1);
+    stack[0].push_back(0);
+    UnkHypothesisMore more(hyps);
+    // the number of hypotheses that were dropped from a full beam
+    unsigned long long truncated = 0;
     for(unsigned i = 0; i < matches.size(); i++) {
-        // cerr << " match "<<util_->showString(matches[i].second->word)<<" "<<matches[i].first<<endl;
         ProbTagEntry* entry = matches[i].second;
-        end = matches[i].first+1;
-        start = end-entry->word.length();
-        // trim to the beam size
-        if(end != lastEnd && config_->getUnkBeam() > 0 && stack[lastEnd].size() > config_->getUnkBeam()) {
-            sort(stack[lastEnd].begin(), stack[lastEnd].end(), kyteaTagMore);
-            stack[lastEnd].resize(config_->getUnkBeam());
-        }
-        lastEnd = end;
+        const unsigned end = matches[i].first+1;
+        const unsigned start = end-entry->word.length();
+        // all but the final stack are trimmed to the beam size
+        const bool useBeam = (beam > 0 && end < len);
+        vector<int> & next = stack[end];
         // expand the hypotheses
         for(unsigned j = 0; j < entry->tags[lev].size(); j++) {
+            const KyteaString & tag = entry->tags[lev][j];
             for(unsigned k = 0; k < stack[start].size(); k++) {
-                KyteaTag nextPair(
-                    stack[start][k].first+entry->tags[lev][j],
-                    stack[start][k].second+entry->probs[lev][j]
-                );
-                // cerr << "  ("<<start<<","<<end<<") "<<util_->showString(entry->word)<<", "<<util_->showString(nextPair.first)<<"/"<<nextPair.second;
-                for(unsigned pos = stack[start][k].first.length(); pos < nextPair.first.length(); pos++) {
-                    nextPair.second += subwordModels_[lev]->scoreSingle(nextPair.first,pos);
-                    // cerr << "-->" << nextPair.second;
+                const int prev = stack[start][k];
+                double score = hyps[prev].score+entry->probs[lev][j];
+                unsigned state = hyps[prev].state;
+                for(unsigned pos = 0; pos < tag.length(); pos++) {
+                    score += lm->scoreNext(state, tag[pos]);
+                    state = lm->nextState(state, tag[pos]);
+                }
+                // skip hypotheses that would fall out of a full beam
+                const bool full = (useBeam && next.size() >= beam);
+                if(full && score <= hyps[next.front()].score) {
+                    truncated++;
+                    continue;
+                }
+                hyps.push_back(UnkHypothesis(prev, &tag, hyps[prev].len+tag.length(), state, score));
+                if(full) {
+                    truncated++;
+                    pop_heap(next.begin(), next.end(), more);
+                    next.back() = hyps.size()-1;
+                    push_heap(next.begin(), next.end(), more);
+                } else {
+                    next.push_back(hyps.size()-1);
+                    if(useBeam)
+                        push_heap(next.begin(), next.end(), more);
                 }
-                // cerr << endl;
-                stack[end].push_back(nextPair);
             }
         }
     }
-    vector<KyteaTag> ret = stack[stack.size()-1];
-    for(unsigned i = 0; i < ret.size(); i++)
-        ret[i].second += subwordModels_[lev]->scoreSingle(ret[i].first,ret[i].first.length());
+    KYTEA_STATS_COUNT(COUNT_BEAM_TRUNCATIONS, truncated);
+    // add the score of the end of the string, and normalize into probabilities
+    const vector<int> & fin = stack[len];
+    vector< pair<double,int> > scores(fin.size());
+    double maxProb = -1e20, totalProb = 0;
+    for(unsigned i = 0; i < fin.size(); i++) {
+        scores[i] = pair<double,int>(hyps[fin[i]].score+lm->scoreNext(hyps[fin[i]].state, 0), fin[i]);
+        maxProb = max(maxProb, scores[i].first);
+    }
+    for(unsigned i = 0; i < scores.size(); i++)
+        totalProb += exp(scores[i].first-maxProb);
+    // build the strings for the best candidates only
+    unsigned numTags = scores.size();
+    if(config_->getTagMax() != 0 && config_->getTagMax() < numTags)
+        numTags = config_->getTagMax();
+    partial_sort(scores.begin(), scores.begin()+numTags, scores.end(), greater< pair<double,int> >());
+    vector<KyteaTag> ret(numTags);
+    for(unsigned i = 0; i < numTags; i++) {
+        int id = scores[i].second;
+        KyteaString tagStr(hyps[id].len);
+        for(unsigned pos = hyps[id].len; hyps[id].back >= 0; id = hyps[id].back) {
+            pos -= hyps[id].tag->length();
+            tagStr.splice(*hyps[id].tag, pos);
+        }
+        ret[i] = KyteaTag(tagStr, exp(scores[i].first-maxProb)/totalProb);
+    }
     return ret;
 }
 void Kytea::calculateUnknownTag(KyteaWord & word, int lev) {
@@ -948,43 +1452,41 @@ void Kytea::calculateUnknownTag(KyteaWord & word, int lev) {
         word.addTag(lev, KyteaTag(util_->mapString("<NULL>"),0));
         return;
     }
-    // generate candidates
     if((int)word.tags.size() <= lev) word.tags.resize(lev+1);
+    if(unkCache_ && unkCache_->find(word.surf, lev, word.tags[lev]))
+        return;
+    // generate candidates
     word.tags[lev] = generateTagCandidates(word.surf, lev);
-    vector<KyteaTag> & tags = word.tags[lev];
-    // get the max
-    double maxProb = -1e20, totalProb = 0;
-    for(unsigned i = 0; i < tags.size(); i++)
-        maxProb = max(maxProb,tags[i].second);
-    // convert to prob and get the normalizing constant
-    for(unsigned i = 0; i < tags.size(); i++) {
-        tags[i].second = exp(tags[i].second-maxProb);
-        totalProb += tags[i].second;
-    }
-    // normalize the values
-    for(unsigned i = 0; i < tags.size(); i++)
-        tags[i].second /= totalProb;
-    sort(tags.begin(), tags.end());
-    // trim the number of candidates
-    if(config_->getTagMax() != 0 && config_->getTagMax() < tags.size())
-        tags.resize(config_->getTagMax());
-
+    sort(word.tags[lev].begin(), word.tags[lev].end());
+    if(unkCache_)
+        unkCache_->add(word.surf, lev, word.tags[lev]);
 }
 void Kytea::calculateTags(KyteaSentence & sent, int lev) {
+    OverlayHolder overlay(*this);
+    calculateTags(sent, lev, overlay.get());
+}
+
+void Kytea::calculateTags(KyteaSentence & sent, int lev, const OverlayDictionary * overlay, unsigned firstWord, unsigned endWord) {
     int startPos = 0, finPos=0;
+    endWord = min(endWord, (unsigned)sent.words.size());
+    for(unsigned i = 0; i < firstWord; i++)
+        finPos += sent.words[i].surf.length();
     KyteaString charStr = sent.chars;
     KyteaString typeStr = util_->mapString(util_->getTypeString(charStr));
     KyteaString kssx = util_->mapString("SX"), ksst = util_->mapString("ST");
     string defTag = config_->getDefaultTag();
-    for(unsigned i = 0; i < sent.words.size(); i++) {
+    const Dictionary<ModelTagEntry>::MatchResult & matches = getSentenceMatches(sent);
+    const Dictionary<ModelTagEntry>::MatchResult & overlayMatches = getOverlayMatches(sent, overlay);
+    for(unsigned i = firstWord; i < endWord; i++) {
         KyteaWord & word = sent.words[i];
+        startPos = finPos;
+        finPos = startPos+word.surf.length();
         if((int)word.tags.size() > lev
             && (int)word.tags[lev].size() > 0
             && abs(word.tags[lev][0].second) > config_->getConfidence())
                 continue;
-        startPos = finPos;
-        finPos = startPos+word.surf.length();
-        ModelTagEntry* ent = dict_->findEntry(word.surf);
+        ModelTagEntry* ent = findMatchedEntry(matches, finPos-1, word.surf.length());
+        ModelTagEntry* overlayEnt = findMatchedEntry(overlayMatches, finPos-1, word.surf.length());
         // choose whether to do local or global estimation
         vector<KyteaString> * tags = 0;
         KyteaModel * tagMod = 0;
@@ -998,16 +1500,24 @@ void Kytea::calculateTags(KyteaSentence & sent, int lev) {
             tagMod = ent->tagMods[lev];
             tags = &(ent->tags[lev]);
         }
+        // words with no tags in the model take the tags of the overlay
+        if((tags == 0 || tags->size() == 0) && overlayEnt != 0 && (int)overlayEnt->tags.size() > lev) {
+            tagMod = 0;
+            tags = &(overlayEnt->tags[lev]);
+        }
         // calculate unknown tags
         if(tags == 0 || tags->size() == 0) {
             if(config_->getDoUnk()) {
+                KYTEA_STATS_START(TIME_TAG_UNKNOWN);
                 calculateUnknownTag(word,lev);
+                KYTEA_STATS_STOP(TIME_TAG_UNKNOWN);
                 if(config_->getDebug() >= 2)
                     cerr << "Tag "<<i+1<<" ("<<util_->showString(sent.words[i].surf)<<"->UNK)"<<endl;
             }
         }
         // calculate known tags
         else {
+            KYTEA_STATS_START(TIME_TAG_KNOWN);
             vector<unsigned> feat;
             FeatureLookup * look;
             if(tagMod == 0 || (look = tagMod->getFeatureLookup()) == NULL)
@@ -1022,7 +1532,12 @@ void Kytea::calculateTags(KyteaSentence & sent, int lev) {
                 if(useSelf) {
                     look->addSelfWeights(charStr.substr(startPos,finPos-startPos), scores, 0);
                     look->addSelfWeights(typeStr.substr(startPos,finPos-startPos), scores, 1);
-                    look->addTagDictWeights(getDictionaryMatches(charStr.substr(startPos,finPos-startPos), 0), scores);
+                    vector<pair<int,int> > dictMatches = getDictionaryMatches(ent, 0);
+                    if(overlayEnt && overlay->slot < dict_->getNumDicts()) {
+                        vector<pair<int,int> > overlayDictMatches = getDictionaryMatches(overlayEnt, 0);
+                        dictMatches.insert(dictMatches.end(), overlayDictMatches.begin(), overlayDictMatches.end());
+                    }
+                    look->addTagDictWeights(dictMatches, scores);
                 }
                 for(int j = 0; j < (int)scores.size(); j++) 
                     scores[j] += look->getBias(j);
@@ -1048,6 +1563,7 @@ void Kytea::calculateTags(KyteaSentence & sent, int lev) {
                         word.tags[lev][i].second -= secondBest;
                 }
             }
+            KYTEA_STATS_STOP(TIME_TAG_KNOWN);
         }
         if(!word.hasTag(lev) && defTag.length())
             word.addTag(lev,KyteaTag(util_->mapString(defTag),0));
@@ -1074,6 +1590,9 @@ void Kytea::trainAll() {
     if(config_->getFeatureOut().length())
         fio_.openOut(config_->getFeatureOut());
 
+    // load the model to start training from
+    loadInitModel();
+
     // load the vocabulary, tags
     buildVocabulary();
     fio_.setNumTags(config_->getNumTags());
@@ -1109,6 +1628,365 @@ void Kytea::trainAll() {
 }
 
 // load the models and analyze the input
+void Kytea::analyzeSentence(KyteaSentence & sent) {
+    const int numTags = config_->getNumTags();
+    vector<bool> doTags(numTags, false);
+    for(int i = 0; i < numTags; i++)
+        doTags[i] = (config_->getDoTags() && config_->getDoTag(i));
+    analyzeSentence(sent, doTags);
+}
+
+void Kytea::analyzeSentence(KyteaSentence & sent, const vector<bool> & doTags) {
+    KYTEA_STATS_COUNT(COUNT_SENTENCES, 1);
+    KYTEA_STATS_COUNT(COUNT_CHARS, sent.chars.length());
+    // only cache sentences with no annotation that would constrain analysis
+    bool useCache = (sentCache_ != 0 && config_->getDoWS() && sent.words.size() == 0);
+    for(unsigned i = 0; useCache && i < sent.wsConfs.size(); i++)
+        useCache = (sent.wsConfs[i] == 0);
+    // use the same overlay for the whole sentence, even if it is reloaded
+    OverlayHolder holder(*this);
+    const OverlayDictionary * overlay = holder.get();
+    // the key is the overlay generation and the tag levels that are turned
+    // on, then the characters
+    const int numTags = min(config_->getNumTags(), (int)doTags.size());
+    KyteaString key;
+    if(useCache) {
+        const unsigned generation = (overlay ? overlay->generation : 0);
+        key = KyteaString(sent.chars.length()+numTags+2);
+        key[0] = generation & 0xFFFF;
+        key[1] = generation >> 16;
+        for(int i = 0; i < numTags; i++)
+            key[i+2] = (doTags[i] ? 1 : 0);
+        key.splice(sent.chars, numTags+2);
+        // the byte offsets come from the line that was read, not the analysis
+        vector<unsigned> byteEnds(sent.byteEnds);
+        if(sentCache_->find(key, sent)) {
+            sent.byteEnds.swap(byteEnds);
+            return;
+        }
+    }
+    if(config_->getDoWS())
+        calculateWS(sent, overlay);
+    for(int i = 0; i < numTags; i++)
+        if(doTags[i])
+            calculateTags(sent, i, overlay);
+    holder.release();
+    if(useCache)
+        sentCache_->add(key, sent);
+}
+
+// copy len characters of a buffer starting at start into a string
+static KyteaString bufferString(const vector<KyteaChar> & buff, unsigned start, unsigned len) {
+    KyteaString ret(len);
+    for(unsigned i = 0; i < len; i++)
+        ret[i] = buff[start+i];
+    return ret;
+}
+
+void Kytea::analyzeStream(RawCorpusIO & in, FullCorpusIO & out, unsigned chunk) {
+    if(!config_->getDoWS())
+        THROW_ERROR("Lines can only be analyzed in parts when doing word segmentation");
+    const int numTags = config_->getNumTags();
+    const double confidence = config_->getConfidence();
+    const int window = max(max((int)config_->getCharWindow(), (int)config_->getTypeWindow()),
+                           max((int)config_->getCharN(), (int)config_->getTypeN()));
+    // the characters of the current line that are kept, of which the first
+    //  ctx have already been written and are only context, and the
+    //  confidences of their boundaries, of which the first scored will not
+    //  change as more characters are read
+    vector<KyteaChar> buff;
+    KyteaSentence::Floats confs;
+    int ctx = 0, scored = 0;
+    OverlayHolder holder(*this);
+    KyteaSentence * part;
+    bool lineEnd;
+    while((part = in.readSentencePart(chunk, lineEnd)) != 0) {
+        // use the same overlay for a whole line
+        holder.acquire();
+        const OverlayDictionary * overlay = holder.get();
+        for(unsigned i = 0; i < part->chars.length(); i++)
+            buff.push_back(part->chars[i]);
+        KYTEA_STATS_COUNT(COUNT_CHARS, part->chars.length());
+        delete part;
+        // boundaries are decided once the characters and dictionary words
+        //  that their features use have all been read
+        const int reach = max(max(window, (int)maxWordLength_), (overlay ? (int)overlay->maxLength : 0));
+        const int len = buff.size();
+        // only score the boundaries whose features can use the new
+        //  characters, from a slice with enough characters before them
+        const int sliceOff = max(0, scored+1-reach);
+        KyteaSentence slice;
+        if(len > ctx) {
+            slice = KyteaSentence(bufferString(buff, sliceOff, len-sliceOff));
+            calculateWSConfs(slice, overlay);
+            confs.resize(len-1);
+            for(int i = scored; i < len-1; i++)
+                confs[i] = slice.wsConfs[i-sliceOff];
+        }
+        // find the end of the last word that is decided
+        int end = len;
+        if(!lineEnd) {
+            scored = max(scored, len-reach);
+            for(end = len-reach; end > ctx && confs[end-1] <= confidence; end--);
+            if(end <= ctx)
+                continue;
+        }
+        // the written characters are a single word for the tagging context
+        KyteaSentence sent(bufferString(buff, 0, len));
+        if(ctx > 0)
+            sent.words.push_back(KyteaWord(sent.chars.substr(0, ctx)));
+        const unsigned firstWord = sent.words.size();
+        // the words end inside the slice, and a word that starts before it
+        //  is too long to be in a dictionary
+        for(int i = ctx, last = ctx; i < end; i++) {
+            if(i < end-1 && confs[i] <= confidence)
+                continue;
+            KyteaWord word(sent.chars.substr(last, i-last+1));
+            word.setUnknown(findMatchedEntry(slice.dictMatches, i-sliceOff, i-last+1) == 0 &&
+                            findMatchedEntry(slice.overlayMatches, i-sliceOff, i-last+1) == 0);
+            KYTEA_STATS_COUNT(COUNT_UNKNOWN_WORDS, word.getUnknown());
+            sent.words.push_back(word);
+            last = i+1;
+        }
+        // the matches of the slice are enough to tag the new words
+        for(unsigned i = 0; i < slice.dictMatches.size(); i++)
+            sent.dictMatches.push_back(make_pair(slice.dictMatches[i].first+sliceOff, slice.dictMatches[i].second));
+        markSentenceMatches(sent, slice.dictMatchGeneration);
+        for(unsigned i = 0; i < slice.overlayMatches.size(); i++)
+            sent.overlayMatches.push_back(make_pair(slice.overlayMatches[i].first+sliceOff, slice.overlayMatches[i].second));
+        markMatches(sent.chars, slice.overlayMatchGeneration, sent.overlayMatchGeneration, sent.overlayMatchChars);
+        for(int lev = 0; lev < numTags; lev++)
+            if(config_->getDoTags() && config_->getDoTag(lev))
+                calculateTags(sent, lev, overlay, firstWord, sent.words.size());
+        KYTEA_STATS_COUNT(COUNT_WORDS, sent.words.size()-firstWord);
+        KYTEA_STATS_START(TIME_WRITE);
+        out.writeWords(&sent, firstWord, ctx > 0, lineEnd);
+        KYTEA_STATS_STOP(TIME_WRITE);
+        if(lineEnd) {
+            KYTEA_STATS_COUNT(COUNT_SENTENCES, 1);
+            holder.release();
+            buff.clear();
+            confs.clear();
+            ctx = scored = 0;
+        } else {
+            // keep enough written characters to be the context of the rest
+            const int keep = max(0, end-reach);
+            buff.erase(buff.begin(), buff.begin()+keep);
+            confs.erase(confs.begin(), confs.begin()+keep);
+            ctx = end-keep;
+            scored -= keep;
+        }
+    }
+}
+// whether a boundary confidence is above a threshold
+struct ConfAbove {
+    ConfAbove(double conf) : conf_(conf) { }
+    bool operator() (double val) const { return val > conf_; }
+    double conf_;
+};
+void Kytea::segmentSentence(KyteaSentence & sent, vector<char> * unknown) {
+    if(unknown)
+        unknown->clear();
+    KYTEA_STATS_COUNT(COUNT_SENTENCES, 1);
+    if(sent.chars.length() == 0)
+        return;
+    KYTEA_STATS_COUNT(COUNT_CHARS, sent.chars.length());
+    OverlayHolder overlay(*this);
+    calculateWSConfs(sent, overlay.get());
+    KYTEA_STATS_COUNT(COUNT_WORDS, 1+count_if(sent.wsConfs.begin(), sent.wsConfs.end(), ConfAbove(config_->getConfidence())));
+    // words are unknown if they match neither the dictionary nor the overlay
+    if(unknown) {
+        unsigned begin = 0;
+        for(unsigned i = 0; i <= sent.wsConfs.size(); i++) {
+            if(i < sent.wsConfs.size() && sent.wsConfs[i] <= config_->getConfidence())
+                continue;
+            unknown->push_back(findMatchedEntry(sent.dictMatches, i, i+1-begin) == 0 &&
+                               findMatchedEntry(sent.overlayMatches, i, i+1-begin) == 0);
+            KYTEA_STATS_COUNT(COUNT_UNKNOWN_WORDS, unknown->back());
+            begin = i+1;
+        }
+    }
+}
+// order dictionary matches by the position of their last character
+static bool matchEndLess(const pair<unsigned,ModelTagEntry*> & a, const pair<unsigned,ModelTagEntry*> & b) {
+    return a.first < b.first;
+}
+void Kytea::reanalyzeSentence(KyteaSentence & sent, unsigned offset, unsigned deleted, const KyteaString & inserted) {
+    if(!config_->getDoWS())
+        THROW_ERROR("Sentences can only be re-analyzed when doing word segmentation");
+    const int oldLen = sent.chars.length();
+    if(offset+deleted > (unsigned)oldLen)
+        THROW_ERROR("An edit of "<<deleted<<" characters at "<<offset<<" is outside of a sentence of length "<<oldLen);
+    const int start = offset, oldEnd = offset+deleted, newEnd = offset+inserted.length();
+    const int delta = newEnd-oldEnd, len = oldLen+delta;
+    KyteaString chars(len);
+    chars.splice(sent.chars.substr(0, start), 0);
+    chars.splice(inserted, start);
+    chars.splice(sent.chars.substr(oldEnd), newEnd);
+    // the byte offsets of the inserted characters are not known
+    sent.byteEnds.clear();
+
+    // boundaries further than the character windows and the longest
+    //  dictionary word from the edit keep their features
+    OverlayHolder holder(*this);
+    const OverlayDictionary * overlay = holder.get();
+    int reach = max(max((int)config_->getCharWindow(), (int)config_->getTypeWindow()), (int)maxWordLength_);
+    if(overlay)
+        reach = max(reach, (int)overlay->maxLength);
+    const int lo = start-reach, hi = newEnd+reach-1;
+    // keep the words that end before the window or start after it
+    unsigned firstMid = 0, endMid = 0;
+    int midStart = 0, midEnd = len, pos = 0;
+    for(unsigned i = 0; i < sent.words.size(); i++) {
+        const int wordLen = sent.words[i].surf.length();
+        if(pos+wordLen-1 < lo) {
+            firstMid = i+1;
+            midStart = pos+wordLen;
+        }
+        if(pos+delta <= hi+1)
+            endMid = i+1;
+        else if(midEnd == len)
+            midEnd = pos+delta;
+        pos += wordLen;
+    }
+    // analyze the whole sentence if the edit is near both ends, or the
+    //  sentence was not analyzed with this dictionary and overlay
+    if(lo <= 0 || hi >= len-2 || pos != oldLen || sent.wsConfs.size() != (unsigned)oldLen-1 ||
+       dict_ == 0 || !hasSentenceMatches(sent, dictGeneration_) ||
+       sent.overlayGeneration != (overlay ? overlay->generation : 0)) {
+        holder.release();
+        KyteaSentence fresh(chars);
+        analyzeSentence(fresh);
+        sent = fresh;
+        return;
+    }
+
+    // calculate the window from a slice that contains the characters and
+    //  dictionary words around it, as well as the words to be rebuilt
+    const int sliceOff = max(0, min(lo+1-reach, midStart)), sliceEnd = min(len, max(hi+1+reach, midEnd));
+    KyteaSentence slice(chars.substr(sliceOff, sliceEnd-sliceOff));
+    calculateWSConfs(slice, overlay);
+    KyteaSentence::Floats & confs = sent.wsConfs;
+    confs.erase(confs.begin()+lo, confs.begin()+hi-delta+1);
+    confs.insert(confs.begin()+lo, slice.wsConfs.begin()+lo-sliceOff, slice.wsConfs.begin()+hi+1-sliceOff);
+
+    // build the words between the kept ones
+    KyteaSentence::Words mid;
+    const double confidence = config_->getConfidence();
+    for(int i = midStart, last = midStart; i < midEnd; i++) {
+        if(i < midEnd-1 && (i < lo || i > hi || confs[i] <= confidence))
+            continue;
+        KyteaWord word(chars.substr(last, i-last+1));
+        word.setUnknown(findMatchedEntry(slice.dictMatches, i-sliceOff, i-last+1) == 0 &&
+                        findMatchedEntry(slice.overlayMatches, i-sliceOff, i-last+1) == 0);
+        KYTEA_STATS_COUNT(COUNT_UNKNOWN_WORDS, word.getUnknown());
+        mid.push_back(word);
+        last = i+1;
+    }
+    if(KyteaModel::isProbabilistic(config_->getSolverType())) {
+        for(int i = lo; i <= hi; i++)
+            confs[i] = 1/(1.0+exp(-abs(confs[i])));
+    }
+    KYTEA_STATS_COUNT(COUNT_WORDS, mid.size());
+    sent.words.erase(sent.words.begin()+firstMid, sent.words.begin()+endMid);
+    sent.words.insert(sent.words.begin()+firstMid, mid.begin(), mid.end());
+
+    // the dictionary words that do not touch the edit are kept, and those
+    //  that do are found in the slice
+    Dictionary<ModelTagEntry>::MatchResult & matches = sent.dictMatches;
+    unsigned keep = 0;
+    for(unsigned i = 0; i < matches.size(); i++) {
+        const int end = matches[i].first, begin = end+1-matches[i].second->word.length();
+        if(end < start)
+            matches[keep++] = matches[i];
+        else if(begin >= oldEnd)
+            matches[keep++] = make_pair((unsigned)(end+delta), matches[i].second);
+    }
+    matches.resize(keep);
+    const unsigned kept = lower_bound(matches.begin(), matches.end(), make_pair((unsigned)start, (ModelTagEntry*)0)) - matches.begin();
+    Dictionary<ModelTagEntry>::MatchResult added;
+    for(unsigned i = 0; i < slice.dictMatches.size(); i++) {
+        const int end = slice.dictMatches[i].first+sliceOff, begin = end+1-slice.dictMatches[i].second->word.length();
+        if(begin < newEnd && end >= start)
+            added.push_back(make_pair((unsigned)end, slice.dictMatches[i].second));
+    }
+    matches.insert(matches.begin()+kept, added.begin(), added.end());
+    inplace_merge(matches.begin(), matches.begin()+kept+added.size(), matches.end(), matchEndLess);
+    sent.chars = chars;
+    markSentenceMatches(sent, dictGeneration_);
+
+    // tag the new words and those whose context contains the edit
+    const int tagReach = max(config_->getCharN(), config_->getTypeN());
+    unsigned firstTag = firstMid, endTag = firstMid+mid.size();
+    int tagStart = midStart, tagEnd = midEnd;
+    while(firstTag > 0 && tagStart > start-tagReach-1)
+        tagStart -= sent.words[--firstTag].surf.length();
+    while(endTag < sent.words.size() && tagEnd <= newEnd+tagReach)
+        tagEnd += sent.words[endTag++].surf.length();
+    // along with the words that are within reach of them
+    unsigned firstCtx = firstTag, endCtx = endTag;
+    int ctxStart = tagStart, ctxEnd = tagEnd;
+    while(firstCtx > 0 && ctxStart > tagStart-tagReach)
+        ctxStart -= sent.words[--firstCtx].surf.length();
+    while(endCtx < sent.words.size() && ctxEnd < tagEnd+tagReach)
+        ctxEnd += sent.words[endCtx++].surf.length();
+    KyteaSentence tagSent(chars.substr(ctxStart, ctxEnd-ctxStart));
+    tagSent.words.assign(sent.words.begin()+firstCtx, sent.words.begin()+endCtx);
+    const int numTags = config_->getNumTags();
+    for(int lev = 0; lev < numTags; lev++) {
+        if(!config_->getDoTags() || !config_->getDoTag(lev))
+            continue;
+        for(unsigned i = firstTag; i < endTag; i++)
+            tagSent.words[i-firstCtx].clearTags(lev);
+        calculateTags(tagSent, lev, overlay, firstTag-firstCtx, endTag-firstCtx);
+    }
+    holder.release();
+    for(unsigned i = firstTag; i < endTag; i++)
+        sent.words[i] = tagSent.words[i-firstCtx];
+}
+void Kytea::analyzeOffsets(KyteaSentence & sent, const vector<bool> & doTags, KyteaOffsets & offsets) {
+    if(sent.byteEnds.size() != sent.chars.length())
+        THROW_ERROR("Byte offsets can only be found for sentences that were read as raw text");
+    offsets.begins.clear();
+    offsets.ends.clear();
+    offsets.tagIds.clear();
+    offsets.numLevels = min(config_->getNumTags(), (int)doTags.size());
+    bool anyTags = false;
+    for(int i = 0; i < offsets.numLevels; i++)
+        anyTags = (anyTags || doTags[i]);
+    unsigned begin = 0;
+    if(!anyTags) {
+        // find the words directly from the boundaries
+        if(sent.chars.length() == 0)
+            return;
+        if(config_->getDoWS()) {
+            OverlayHolder overlay(*this);
+            calculateWSConfs(sent, overlay.get());
+        }
+        for(unsigned i = 0; i <= sent.wsConfs.size(); i++) {
+            if(i < sent.wsConfs.size() && sent.wsConfs[i] <= config_->getConfidence())
+                continue;
+            offsets.begins.push_back(begin);
+            offsets.ends.push_back(begin = sent.byteEnds[i]);
+        }
+        offsets.tagIds.resize(offsets.ends.size()*offsets.numLevels, -1);
+        KYTEA_STATS_COUNT(COUNT_SENTENCES, 1);
+        KYTEA_STATS_COUNT(COUNT_CHARS, sent.chars.length());
+        KYTEA_STATS_COUNT(COUNT_WORDS, offsets.ends.size());
+        return;
+    }
+    analyzeSentence(sent, doTags);
+    unsigned charPos = 0;
+    for(unsigned i = 0; i < sent.words.size(); i++) {
+        const KyteaWord & word = sent.words[i];
+        charPos += word.surf.length();
+        offsets.begins.push_back(begin);
+        offsets.ends.push_back(begin = sent.byteEnds[charPos-1]);
+        for(int lev = 0; lev < offsets.numLevels; lev++)
+            offsets.tagIds.push_back(doTags[lev] && word.hasTag(lev) ? getTagId(lev, word.getTagSurf(lev)) : -1);
+    }
+}
+
 void Kytea::analyze() {
     
     // on full input, disable word segmentation
@@ -1119,9 +1997,13 @@ void Kytea::analyze() {
     std::ostringstream buff;
     if(config_->getModelFile().length() == 0)
         throw std::runtime_error("A model file must be specified to run Kytea (-model)");
+    if(config_->getStats() && !KyteaStats::isEnabled())
+        THROW_ERROR("-stats can only be used if KyTea was configured with --enable-stats");
     
     // read the models in from the model file
     readModel(config_->getModelFile().c_str());
+    if(config_->getOverlayFile().length())
+        loadOverlayDictionary(config_->getOverlayFile(), config_->getOverlaySlot());
     if(!config_->getDoWS() && !config_->getDoTags()) {
         buff << "Both word segmentation and tagging are disabled." << std::endl
              << "At least one must be selected to perform processing." << std::endl;
@@ -1168,17 +2050,41 @@ void Kytea::analyze() {
     for(int i = 0; i < config_->getNumTags(); i++)
         out->setDoTag(i,config_->getDoTag(i));
 
-    KyteaSentence* next;
-    while((next = in->readSentence()) != 0) {
-        if(config_->getDoWS())
-            calculateWS(*next);
-        if(config_->getDoTags())
-            for(int i = 0; i < config_->getNumTags(); i++)
-                if(config_->getDoTag(i))
-                    calculateTags(*next, i);
-        out->writeSentence(next);
-        delete next;
+    // very long lines can be read in parts
+    if(config_->getChunkSize() > 0) {
+        if(config_->getInputFormat() != CORP_FORMAT_RAW || config_->getOutputFormat() != CORP_FORMAT_FULL)
+            THROW_ERROR("-chunk can only be used with raw input and full output");
+        analyzeStream(*(RawCorpusIO*)in, *(FullCorpusIO*)out, config_->getChunkSize());
+    } else {
+        // when only segmenting raw text, write the words straight from the
+        //  boundaries without building them
+        bool anyTags = false;
+        for(int i = 0; i < config_->getNumTags(); i++)
+            anyTags = (anyTags || (config_->getDoTags() && config_->getDoTag(i)));
+        bool boundsOnly = (!anyTags && config_->getDoWS() && sentCache_ == 0 &&
+                           config_->getInputFormat() == CORP_FORMAT_RAW &&
+                           config_->getOutputFormat() == CORP_FORMAT_FULL);
+        vector<char> unknown;
+        vector<char> * unknownPtr = (config_->getUnkTag().length() ? &unknown : 0);
+
+        KyteaSentence* next;
+        while((next = in->readSentence()) != 0) {
+            if(boundsOnly) {
+                segmentSentence(*next, unknownPtr);
+                KYTEA_STATS_START(TIME_WRITE);
+                ((FullCorpusIO*)out)->writeBoundaries(next, config_->getConfidence(), unknownPtr);
+                KYTEA_STATS_STOP(TIME_WRITE);
+            } else {
+                analyzeSentence(*next);
+                KYTEA_STATS_START(TIME_WRITE);
+                out->writeSentence(next);
+                KYTEA_STATS_STOP(TIME_WRITE);
+            }
+            delete next;
+        }
     }
+    if(config_->getStats())
+        KyteaStats::write(cerr);
 
     delete in;
     delete out;
@@ -18,6 +18,12 @@ typedef int blasbool;
 #define FALSE 0
 #define TRUE  1
 
+/* With OpenMP 4.5, unit-stride loops are vectorized with "omp simd". They
+   stay on the calling thread, which has no way to be told the thread count */
+#if defined(_OPENMP) && _OPENMP >= 201511
+#define BLAS_OMP_SIMD
+#endif
+
 /* Macro functions */
 #define MIN(a,b) ((a) <= (b) ? (a) : (b))
 #define MAX(a,b) ((a) >= (b) ? (a) : (b))
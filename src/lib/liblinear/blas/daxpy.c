@@ -3,7 +3,7 @@
 int daxpy_(int *n, double *sa, double *sx, int *incx, double *sy,
            int *incy)
 {
-  long int i, m, ix, iy, nn, iincx, iincy;
+  long int i, ix, iy, nn, iincx, iincy;
   register double ssa;
 
   /* constant times a vector plus a vector.   
@@ -21,7 +21,12 @@ int daxpy_(int *n, double *sa, double *sx, int *incx, double *sy,
   {
     if (iincx == 1 && iincy == 1) /* code for both increments equal to 1 */
     {
-      m = nn-3;
+#ifdef BLAS_OMP_SIMD
+#pragma omp simd
+      for (i = 0; i < nn; i++)
+        sy[i] += ssa * sx[i];
+#else
+      long int m = nn-3;
       for (i = 0; i < m; i += 4)
       {
         sy[i] += ssa * sx[i];
@@ -31,6 +36,7 @@ int daxpy_(int *n, double *sa, double *sx, int *incx, double *sy,
       }
       for ( ; i < nn; ++i) /* clean-up loop */
         sy[i] += ssa * sx[i];
+#endif
     }
     else /* code for unequal increments or equal increments not equal to 1 */
     {
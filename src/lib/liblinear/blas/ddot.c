@@ -2,7 +2,7 @@
 
 double ddot_(int *n, double *sx, int *incx, double *sy, int *incy)
 {
-  long int i, m, nn, iincx, iincy;
+  long int i, nn, iincx, iincy;
   double stemp;
   long int ix, iy;
 
@@ -21,13 +21,19 @@ double ddot_(int *n, double *sx, int *incx, double *sy, int *incy)
   {
     if (iincx == 1 && iincy == 1) /* code for both increments equal to 1 */
     {
-      m = nn-4;
+#ifdef BLAS_OMP_SIMD
+#pragma omp simd reduction(+:stemp)
+      for (i = 0; i < nn; i++)
+        stemp += sx[i] * sy[i];
+#else
+      long int m = nn-4;
       for (i = 0; i < m; i += 5)
         stemp += sx[i] * sy[i] + sx[i+1] * sy[i+1] + sx[i+2] * sy[i+2] +
                  sx[i+3] * sy[i+3] + sx[i+4] * sy[i+4];
 
       for ( ; i < nn; i++)        /* clean-up loop */
         stemp += sx[i] * sy[i];
+#endif
     }
     else /* code for unequal increments or equal increments not equal to 1 */
     {
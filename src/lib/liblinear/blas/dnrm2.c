@@ -25,6 +25,27 @@ double dnrm2_(int *n, double *x, int *incx)
     {
       norm = fabs(x[0]);
     }  
+#ifdef BLAS_OMP_SIMD
+    else if (iincx == 1)
+    {
+      /* For unit stride, find the scale first and then sum the scaled
+         squares; unlike the loop below both passes can be vectorized */
+      long int i;
+      scale = 0.0;
+#pragma omp simd reduction(max:scale)
+      for (i = 0; i < nn; i++)
+        scale = MAX(scale, fabs(x[i]));
+      ssq = 0.0;
+      if (scale > 0.0)
+      {
+        double iscale = 1.0 / scale;
+#pragma omp simd reduction(+:ssq)
+        for (i = 0; i < nn; i++)
+          ssq += (x[i] * iscale) * (x[i] * iscale);
+      }
+      norm = scale * sqrt(ssq);
+    }
+#endif
     else
     {
       scale = 0.0;
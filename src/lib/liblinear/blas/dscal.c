@@ -2,7 +2,7 @@
 
 int dscal_(int *n, double *sa, double *sx, int *incx)
 {
-  long int i, m, nincx, nn, iincx;
+  long int i, nincx, nn, iincx;
   double ssa;
 
   /* scales a vector by a constant.   
@@ -20,7 +20,12 @@ int dscal_(int *n, double *sa, double *sx, int *incx)
   {
     if (iincx == 1) /* code for increment equal to 1 */
     {
-      m = nn-4;
+#ifdef BLAS_OMP_SIMD
+#pragma omp simd
+      for (i = 0; i < nn; i++)
+        sx[i] = ssa * sx[i];
+#else
+      long int m = nn-4;
       for (i = 0; i < m; i += 5)
       {
         sx[i] = ssa * sx[i];
@@ -31,6 +36,7 @@ int dscal_(int *n, double *sa, double *sx, int *incx)
       }
       for ( ; i < nn; ++i) /* clean-up loop */
         sx[i] = ssa * sx[i];
+#endif
     }
     else /* code for increment not equal to 1 */
     {
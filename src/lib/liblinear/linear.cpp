@@ -5,6 +5,9 @@
 #include <stdarg.h>
 #include "linear.h"
 #include "tron.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 typedef signed char schar;
 template <class T> static inline void swap(T& x, T& y) { T t=x; x=y; y=t; }
 #ifndef min
@@ -21,6 +24,93 @@ template <class S, class T> static inline void clone(T*& dst, S* src, int n)
 #define Malloc(type,n) (type *)malloc((n)*sizeof(type))
 #define INF HUGE_VAL
 
+// the number of threads to use for nr_thread (<= 0: the OpenMP default).
+// Inside an already parallel region (e.g. when classes are trained
+// concurrently) a single thread is used to avoid allocating buffers that
+// are never touched
+static int solver_threads(int nr_thread)
+{
+#ifdef _OPENMP
+	if(omp_in_parallel())
+		return 1;
+	return nr_thread > 0 ? nr_thread : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// XTv = X^T v over the rows in idx (or all rows if idx is NULL). With
+// multiple threads each accumulates into its own slice of buf (nr_thread
+// vectors of size w_size), and the slices are summed at the end. As with
+// the sums over rows in fun(), the order of the additions depends on the
+// number of threads, so the result can differ in its last digits
+static void sparse_XTv(feature_node **x, const int *idx, int l, double *v, double *XTv, int w_size, double *buf, int nr_thread)
+{
+	int i;
+#ifdef _OPENMP
+	if(nr_thread > 1)
+	{
+#pragma omp parallel num_threads(nr_thread)
+		{
+			int nt = omp_get_num_threads();
+			double *my_XTv = buf + (size_t)omp_get_thread_num()*w_size;
+			int j, k;
+			for(j=0;j<w_size;j++)
+				my_XTv[j]=0;
+#pragma omp for schedule(static)
+			for(j=0;j<l;j++)
+			{
+				feature_node *s=x[idx ? idx[j] : j];
+				double vj=v[j];
+				while(s->index!=-1)
+				{
+					my_XTv[s->index-1]+=vj*s->value;
+					s++;
+				}
+			}
+#pragma omp for schedule(static)
+			for(j=0;j<w_size;j++)
+			{
+				double sum=0;
+				for(k=0;k<nt;k++)
+					sum+=buf[(size_t)k*w_size+j];
+				XTv[j]=sum;
+			}
+		}
+		return;
+	}
+#endif
+	for(i=0;i<w_size;i++)
+		XTv[i]=0;
+	for(i=0;i<l;i++)
+	{
+		feature_node *s=x[idx ? idx[i] : i];
+		while(s->index!=-1)
+		{
+			XTv[s->index-1]+=v[i]*s->value;
+			s++;
+		}
+	}
+}
+
+// Xv = X v over the rows in idx (or all rows if idx is NULL)
+static void sparse_Xv(feature_node **x, const int *idx, int l, double *v, double *Xv, int nr_thread)
+{
+	int i;
+#pragma omp parallel for schedule(static) num_threads(nr_thread) if(nr_thread > 1)
+	for(i=0;i<l;i++)
+	{
+		feature_node *s=x[idx ? idx[i] : i];
+		double sum=0;
+		while(s->index!=-1)
+		{
+			sum+=v[s->index-1]*s->value;
+			s++;
+		}
+		Xv[i]=sum;
+	}
+}
+
 static void print_string_stdout(const char *s)
 {
 	fputs(s,stdout);
@@ -43,10 +133,23 @@ static void info(const char *fmt,...)
 static void info(const char *fmt,...) {}
 #endif
 
+// xorshift generator used by the coordinate descent solvers in place of
+// rand(), so that subproblems solved concurrently each have their own
+// state and the result does not depend on the number of threads
+static inline int rand_int(unsigned int *seed, int n)
+{
+	unsigned int x = *seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed = x;
+	return (int)(x % (unsigned int)n);
+}
+
 class l2r_lr_fun : public function
 {
 public:
-	l2r_lr_fun(const problem *prob, double Cp, double Cn);
+	l2r_lr_fun(const problem *prob, double Cp, double Cn, int nr_thread);
 	~l2r_lr_fun();
 
 	double fun(double *w);
@@ -62,10 +165,12 @@ private:
 	double *C;
 	double *z;
 	double *D;
+	double *buf;
+	int nr_thread;
 	const problem *prob;
 };
 
-l2r_lr_fun::l2r_lr_fun(const problem *prob, double Cp, double Cn)
+l2r_lr_fun::l2r_lr_fun(const problem *prob, double Cp, double Cn, int nr_thread)
 {
 	int i;
 	int l=prob->l;
@@ -76,6 +181,8 @@ l2r_lr_fun::l2r_lr_fun(const problem *prob, double Cp, double Cn)
 	z = new double[l];
 	D = new double[l];
 	C = new double[l];
+	this->nr_thread = solver_threads(nr_thread);
+	buf = (this->nr_thread > 1 ? new double[(size_t)this->nr_thread*prob->n] : NULL);
 
 	for (i=0; i<l; i++)
 	{
@@ -91,6 +198,7 @@ l2r_lr_fun::~l2r_lr_fun()
 	delete[] z;
 	delete[] D;
 	delete[] C;
+	delete[] buf;
 }
 
 
@@ -103,6 +211,7 @@ double l2r_lr_fun::fun(double *w)
 	int w_size=get_nr_variable();
 
 	Xv(w, z);
+#pragma omp parallel for schedule(static) reduction(+:f) num_threads(nr_thread) if(nr_thread > 1)
 	for(i=0;i<l;i++)
 	{
 		double yz = y[i]*z[i];
@@ -126,6 +235,7 @@ void l2r_lr_fun::grad(double *w, double *g)
 	int l=prob->l;
 	int w_size=get_nr_variable();
 
+#pragma omp parallel for schedule(static) num_threads(nr_thread) if(nr_thread > 1)
 	for(i=0;i<l;i++)
 	{
 		z[i] = 1/(1 + exp(-y[i]*z[i]));
@@ -162,46 +272,18 @@ void l2r_lr_fun::Hv(double *s, double *Hs)
 
 void l2r_lr_fun::Xv(double *v, double *Xv)
 {
-	int i;
-	int l=prob->l;
-	feature_node **x=prob->x;
-
-	for(i=0;i<l;i++)
-	{
-		feature_node *s=x[i];
-		Xv[i]=0;
-		while(s->index!=-1)
-		{
-			Xv[i]+=v[s->index-1]*s->value;
-			s++;
-		}
-	}
+	sparse_Xv(prob->x, NULL, prob->l, v, Xv, nr_thread);
 }
 
 void l2r_lr_fun::XTv(double *v, double *XTv)
 {
-	int i;
-	int l=prob->l;
-	int w_size=get_nr_variable();
-	feature_node **x=prob->x;
-
-	for(i=0;i<w_size;i++)
-		XTv[i]=0;
-	for(i=0;i<l;i++)
-	{
-		feature_node *s=x[i];
-		while(s->index!=-1)
-		{
-			XTv[s->index-1]+=v[i]*s->value;
-			s++;
-		}
-	}
+	sparse_XTv(prob->x, NULL, prob->l, v, XTv, get_nr_variable(), buf, nr_thread);
 }
 
 class l2r_l2_svc_fun : public function
 {
 public:
-	l2r_l2_svc_fun(const problem *prob, double Cp, double Cn);
+	l2r_l2_svc_fun(const problem *prob, double Cp, double Cn, int nr_thread);
 	~l2r_l2_svc_fun();
 
 	double fun(double *w);
@@ -220,10 +302,12 @@ private:
 	double *D;
 	int *I;
 	int sizeI;
+	double *buf;
+	int nr_thread;
 	const problem *prob;
 };
 
-l2r_l2_svc_fun::l2r_l2_svc_fun(const problem *prob, double Cp, double Cn)
+l2r_l2_svc_fun::l2r_l2_svc_fun(const problem *prob, double Cp, double Cn, int nr_thread)
 {
 	int i;
 	int l=prob->l;
@@ -235,6 +319,8 @@ l2r_l2_svc_fun::l2r_l2_svc_fun(const problem *prob, double Cp, double Cn)
 	D = new double[l];
 	C = new double[l];
 	I = new int[l];
+	this->nr_thread = solver_threads(nr_thread);
+	buf = (this->nr_thread > 1 ? new double[(size_t)this->nr_thread*prob->n] : NULL);
 
 	for (i=0; i<l; i++)
 	{
@@ -251,6 +337,7 @@ l2r_l2_svc_fun::~l2r_l2_svc_fun()
 	delete[] D;
 	delete[] C;
 	delete[] I;
+	delete[] buf;
 }
 
 double l2r_l2_svc_fun::fun(double *w)
@@ -262,6 +349,7 @@ double l2r_l2_svc_fun::fun(double *w)
 	int w_size=get_nr_variable();
 
 	Xv(w, z);
+#pragma omp parallel for schedule(static) reduction(+:f) num_threads(nr_thread) if(nr_thread > 1)
 	for(i=0;i<l;i++)
 	{
 		z[i] = y[i]*z[i];
@@ -322,56 +410,17 @@ void l2r_l2_svc_fun::Hv(double *s, double *Hs)
 
 void l2r_l2_svc_fun::Xv(double *v, double *Xv)
 {
-	int i;
-	int l=prob->l;
-	feature_node **x=prob->x;
-
-	for(i=0;i<l;i++)
-	{
-		feature_node *s=x[i];
-		Xv[i]=0;
-		while(s->index!=-1)
-		{
-			Xv[i]+=v[s->index-1]*s->value;
-			s++;
-		}
-	}
+	sparse_Xv(prob->x, NULL, prob->l, v, Xv, nr_thread);
 }
 
 void l2r_l2_svc_fun::subXv(double *v, double *Xv)
 {
-	int i;
-	feature_node **x=prob->x;
-
-	for(i=0;i<sizeI;i++)
-	{
-		feature_node *s=x[I[i]];
-		Xv[i]=0;
-		while(s->index!=-1)
-		{
-			Xv[i]+=v[s->index-1]*s->value;
-			s++;
-		}
-	}
+	sparse_Xv(prob->x, I, sizeI, v, Xv, nr_thread);
 }
 
 void l2r_l2_svc_fun::subXTv(double *v, double *XTv)
 {
-	int i;
-	int w_size=get_nr_variable();
-	feature_node **x=prob->x;
-
-	for(i=0;i<w_size;i++)
-		XTv[i]=0;
-	for(i=0;i<sizeI;i++)
-	{
-		feature_node *s=x[I[i]];
-		while(s->index!=-1)
-		{
-			XTv[s->index-1]+=v[i]*s->value;
-			s++;
-		}
-	}
+	sparse_XTv(prob->x, I, sizeI, v, XTv, get_nr_variable(), buf, nr_thread);
 }
 
 // A coordinate descent algorithm for 
@@ -710,7 +759,7 @@ void Solver_MCSVM_CS::Solve(double *w)
 
 static void solve_l2r_l1l2_svc(
 	const problem *prob, double *w, double eps, 
-	double Cp, double Cn, int solver_type)
+	double Cp, double Cn, int solver_type, unsigned int seed)
 {
 	int l = prob->l;
 	int w_size = prob->n;
@@ -771,7 +820,7 @@ static void solve_l2r_l1l2_svc(
 
 		for (i=0; i<active_size; i++)
 		{
-			int j = i+rand()%(active_size-i);
+			int j = i+rand_int(&seed, active_size-i);
 			swap(index[i], index[j]);
 		}
 
@@ -909,7 +958,7 @@ static void solve_l2r_l1l2_svc(
 #define GETI(i) (y[i]+1)
 // To support weights for instances, use GETI(i) (i)
 
-void solve_l2r_lr_dual(const problem *prob, double *w, double eps, double Cp, double Cn)
+void solve_l2r_lr_dual(const problem *prob, double *w, double eps, double Cp, double Cn, unsigned int seed)
 {
 	int l = prob->l;
 	int w_size = prob->n;
@@ -954,7 +1003,7 @@ void solve_l2r_lr_dual(const problem *prob, double *w, double eps, double Cp, do
 	{
 		for (i=0; i<l; i++)
 		{
-			int j = i+rand()%(l-i);
+			int j = i+rand_int(&seed, l-i);
 			swap(index[i], index[j]);
 		}
 		int newton_iter = 0;
@@ -1074,7 +1123,7 @@ void solve_l2r_lr_dual(const problem *prob, double *w, double eps, double Cp, do
 
 static void solve_l1r_l2_svc(
 	problem *prob_col, double *w, double eps, 
-	double Cp, double Cn)
+	double Cp, double Cn, unsigned int seed)
 {
 	int l = prob_col->l;
 	int w_size = prob_col->n;
@@ -1130,7 +1179,7 @@ static void solve_l1r_l2_svc(
 
 		for(j=0; j<active_size; j++)
 		{
-			int i = j+rand()%(active_size-j);
+			int i = j+rand_int(&seed, active_size-j);
 			swap(index[i], index[j]);
 		}
 
@@ -1355,7 +1404,7 @@ static void solve_l1r_l2_svc(
 
 static void solve_l1r_lr(
 	const problem *prob_col, double *w, double eps, 
-	double Cp, double Cn)
+	double Cp, double Cn, unsigned int seed)
 {
 	int l = prob_col->l;
 	int w_size = prob_col->n;
@@ -1424,7 +1473,7 @@ static void solve_l1r_lr(
 
 		for(j=0; j<active_size; j++)
 		{
-			int i = j+rand()%(active_size-j);
+			int i = j+rand_int(&seed, active_size-j);
 			swap(index[i], index[j]);
 		}
 
@@ -1738,7 +1787,7 @@ static void group_classes(const problem *prob, int *nr_class_ret, int **label_re
 	free(data_label);
 }
 
-static void train_one(const problem *prob, const parameter *param, double *w, double Cp, double Cn)
+static void train_one(const problem *prob, const parameter *param, double *w, double Cp, double Cn, unsigned int seed)
 {
 	double eps=param->eps;
 	int pos = 0;
@@ -1753,7 +1802,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 	{
 		case L2R_LR:
 		{
-			fun_obj=new l2r_lr_fun(prob, Cp, Cn);
+			fun_obj=new l2r_lr_fun(prob, Cp, Cn, param->nr_thread);
 			TRON tron_obj(fun_obj, eps*min(pos,neg)/prob->l);
 			tron_obj.set_print_string(liblinear_print_string);
 			tron_obj.tron(w);
@@ -1762,7 +1811,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 		}
 		case L2R_L2LOSS_SVC:
 		{
-			fun_obj=new l2r_l2_svc_fun(prob, Cp, Cn);
+			fun_obj=new l2r_l2_svc_fun(prob, Cp, Cn, param->nr_thread);
 			TRON tron_obj(fun_obj, eps*min(pos,neg)/prob->l);
 			tron_obj.set_print_string(liblinear_print_string);
 			tron_obj.tron(w);
@@ -1770,17 +1819,17 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 			break;
 		}
 		case L2R_L2LOSS_SVC_DUAL:
-			solve_l2r_l1l2_svc(prob, w, eps, Cp, Cn, L2R_L2LOSS_SVC_DUAL);
+			solve_l2r_l1l2_svc(prob, w, eps, Cp, Cn, L2R_L2LOSS_SVC_DUAL, seed);
 			break;
 		case L2R_L1LOSS_SVC_DUAL:
-			solve_l2r_l1l2_svc(prob, w, eps, Cp, Cn, L2R_L1LOSS_SVC_DUAL);
+			solve_l2r_l1l2_svc(prob, w, eps, Cp, Cn, L2R_L1LOSS_SVC_DUAL, seed);
 			break;
 		case L1R_L2LOSS_SVC:
 		{
 			problem prob_col;
 			feature_node *x_space = NULL;
 			transpose(prob, &x_space ,&prob_col);
-			solve_l1r_l2_svc(&prob_col, w, eps*min(pos,neg)/prob->l, Cp, Cn);
+			solve_l1r_l2_svc(&prob_col, w, eps*min(pos,neg)/prob->l, Cp, Cn, seed);
 			delete [] prob_col.y;
 			delete [] prob_col.x;
 			delete [] x_space;
@@ -1791,14 +1840,14 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 			problem prob_col;
 			feature_node *x_space = NULL;
 			transpose(prob, &x_space ,&prob_col);
-			solve_l1r_lr(&prob_col, w, eps*min(pos,neg)/prob->l, Cp, Cn);
+			solve_l1r_lr(&prob_col, w, eps*min(pos,neg)/prob->l, Cp, Cn, seed);
 			delete [] prob_col.y;
 			delete [] prob_col.x;
 			delete [] x_space;
 			break;
 		}
 		case L2R_LR_DUAL:
-			solve_l2r_lr_dual(prob, w, eps, Cp, Cn);
+			solve_l2r_lr_dual(prob, w, eps, Cp, Cn, seed);
 			break;
 		default:
 			fprintf(stderr, "Error: unknown solver_type\n");
@@ -1823,7 +1872,6 @@ model* train(const problem *prob, const parameter *param)
 		model_->nr_feature=n;
 	model_->param = *param;
 	model_->bias = prob->bias;
-
 	int nr_class;
 	int *label = NULL;
 	int *start = NULL;
@@ -1883,6 +1931,8 @@ model* train(const problem *prob, const parameter *param)
 		if(nr_class == 2)
 		{
 			model_->w=Malloc(double, w_size);
+			for(i=0;i<w_size;i++)
+				model_->w[i] = (param->init_sol != NULL ? param->init_sol[i] : 0);
 
 			int e0 = start[0]+count[0];
 			k=0;
@@ -1891,31 +1941,40 @@ model* train(const problem *prob, const parameter *param)
 			for(; k<sub_prob.l; k++)
 				sub_prob.y[k] = -1;
 
-			train_one(&sub_prob, param, &model_->w[0], weighted_C[0], weighted_C[1]);
+			train_one(&sub_prob, param, &model_->w[0], weighted_C[0], weighted_C[1], 1);
 		}
 		else
 		{
 			model_->w=Malloc(double, w_size*nr_class);
-			double *w=Malloc(double, w_size);
+			// the one-vs-rest subproblems are independent, so solve them
+			// concurrently, each with its own labels and weight vector
+			int nr_thread = solver_threads(param->nr_thread);
+#pragma omp parallel for schedule(dynamic,1) private(k) num_threads(nr_thread) if(nr_thread > 1)
 			for(i=0;i<nr_class;i++)
 			{
+				problem class_prob = sub_prob;
+				class_prob.y = Malloc(int,sub_prob.l);
+				double *w=Malloc(double, w_size);
+				for(int j=0;j<w_size;j++)
+					w[j] = (param->init_sol != NULL ? param->init_sol[j*nr_class+i] : 0);
 				int si = start[i];
 				int ei = si+count[i];
 
 				k=0;
 				for(; k<si; k++)
-					sub_prob.y[k] = -1;
+					class_prob.y[k] = -1;
 				for(; k<ei; k++)
-					sub_prob.y[k] = +1;
-				for(; k<sub_prob.l; k++)
-					sub_prob.y[k] = -1;
+					class_prob.y[k] = +1;
+				for(; k<class_prob.l; k++)
+					class_prob.y[k] = -1;
 
-				train_one(&sub_prob, param, w, weighted_C[i], param->C);
+				train_one(&class_prob, param, w, weighted_C[i], param->C, i+1);
 
 				for(int j=0;j<w_size;j++)
 					model_->w[j*nr_class+i] = w[j];
+				free(class_prob.y);
+				free(w);
 			}
-			free(w);
 		}
 
 	}
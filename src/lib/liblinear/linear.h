@@ -31,6 +31,8 @@ struct parameter
 	int nr_weight;
 	int *weight_label;
 	double* weight;
+	int nr_thread;		/* threads for the primal solvers (<= 0: OpenMP default) */
+	double *init_sol;	/* starting point for L2R_LR and L2R_L2LOSS_SVC (NULL: zero) */
 };
 
 struct model
@@ -71,14 +71,27 @@ void TRON::tron(double *w)
 	double *w_new = new double[n];
 	double *g = new double[n];
 
-	for (i=0; i<n; i++)
-		w[i] = 0;
+	// w is the starting point (zero unless warm-starting). The stopping
+	// condition is relative to the gradient norm at w=0, so a good starting
+	// point does not make the required precision stricter
+	double gnorm0 = -1;
+	for (i=0; i<n && w[i] == 0; i++);
+	if (i < n)
+	{
+		double *w0 = new double[n];
+		for (i=0; i<n; i++)
+			w0[i] = 0;
+		fun_obj->fun(w0);
+		fun_obj->grad(w0, g);
+		gnorm0 = dnrm2_(&n, g, &inc);
+		delete[] w0;
+	}
 
         f = fun_obj->fun(w);
 	fun_obj->grad(w, g);
 	delta = dnrm2_(&n, g, &inc);
-	double gnorm1 = delta;
-	double gnorm = gnorm1;
+	double gnorm1 = (gnorm0 >= 0 ? gnorm0 : delta);
+	double gnorm = delta;
 
 	if (gnorm <= eps*gnorm1)
 		search = 0;
@@ -0,0 +1,101 @@
+#include <kytea/config.h>
+#include <kytea/lru-cache.h>
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+using namespace kytea;
+using namespace std;
+
+// the approximate overhead of each entry in the list and index
+#define CACHE_ENTRY_OVERHEAD 64
+
+void kytea::copyCacheValue(const KyteaString & from, KyteaString & to) {
+    to = KyteaString(from.length());
+    to.splice(from, 0);
+}
+
+void kytea::copyCacheValue(const vector<KyteaTag> & from, vector<KyteaTag> & to) {
+    to.resize(from.size());
+    for(unsigned i = 0; i < from.size(); i++) {
+        copyCacheValue(from[i].first, to[i].first);
+        to[i].second = from[i].second;
+    }
+}
+
+void kytea::copyCacheValue(const KyteaSentence & from, KyteaSentence & to) {
+    copyCacheValue(from.chars, to.chars);
+    to.wsConfs = from.wsConfs;
+    to.dictMatches = from.dictMatches;
+    to.dictMatchGeneration = from.dictMatchGeneration;
+    copyCacheValue(from.dictMatchChars, to.dictMatchChars);
+    to.overlayGeneration = from.overlayGeneration;
+    to.overlayMatches = from.overlayMatches;
+    to.overlayMatchGeneration = from.overlayMatchGeneration;
+    copyCacheValue(from.overlayMatchChars, to.overlayMatchChars);
+    to.byteEnds = from.byteEnds;
+    to.words.clear();
+    for(unsigned i = 0; i < from.words.size(); i++) {
+        const KyteaWord & word = from.words[i];
+        KyteaString surf;
+        copyCacheValue(word.surf, surf);
+        to.words.push_back(KyteaWord(surf));
+        KyteaWord & myWord = to.words.back();
+        myWord.isCertain = word.isCertain;
+        myWord.unknown = word.unknown;
+        myWord.tags.resize(word.tags.size());
+        for(unsigned j = 0; j < word.tags.size(); j++)
+            copyCacheValue(word.tags[j], myWord.tags[j]);
+    }
+}
+
+size_t kytea::cacheValueSize(const KyteaString & val) {
+    return sizeof(KyteaStringImpl) + sizeof(KyteaChar)*val.length();
+}
+
+size_t kytea::cacheValueSize(const vector<KyteaTag> & val) {
+    size_t ret = CACHE_ENTRY_OVERHEAD;
+    for(unsigned i = 0; i < val.size(); i++)
+        ret += sizeof(KyteaTag) + cacheValueSize(val[i].first);
+    return ret;
+}
+
+size_t kytea::cacheValueSize(const KyteaSentence & val) {
+    size_t ret = CACHE_ENTRY_OVERHEAD + sizeof(KyteaSentence) +
+                 cacheValueSize(val.chars) + sizeof(double)*val.wsConfs.size() +
+                 sizeof(val.dictMatches[0])*val.dictMatches.size() +
+                 cacheValueSize(val.dictMatchChars) + sizeof(val.overlayMatches[0])*val.overlayMatches.size() +
+                 cacheValueSize(val.overlayMatchChars) + sizeof(unsigned)*val.byteEnds.size();
+    for(unsigned i = 0; i < val.words.size(); i++) {
+        ret += sizeof(KyteaWord) + cacheValueSize(val.words[i].surf);
+        for(unsigned j = 0; j < val.words[i].tags.size(); j++)
+            ret += cacheValueSize(val.words[i].tags[j]);
+    }
+    return ret;
+}
+
+CacheMutex::CacheMutex() : mutex_(0) {
+#if HAVE_PTHREAD_H
+    mutex_ = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*)mutex_, NULL);
+#endif
+}
+
+CacheMutex::~CacheMutex() {
+#if HAVE_PTHREAD_H
+    pthread_mutex_destroy((pthread_mutex_t*)mutex_);
+    delete (pthread_mutex_t*)mutex_;
+#endif
+}
+
+void CacheMutex::lock() {
+#if HAVE_PTHREAD_H
+    pthread_mutex_lock((pthread_mutex_t*)mutex_);
+#endif
+}
+
+void CacheMutex::unlock() {
+#if HAVE_PTHREAD_H
+    pthread_mutex_unlock((pthread_mutex_t*)mutex_);
+#endif
+}
@@ -0,0 +1,64 @@
+#include <kytea/model-handle.h>
+#include <kytea/kytea.h>
+#include <kytea/kytea-config.h>
+
+using namespace kytea;
+using namespace std;
+
+PublishedModel::~PublishedModel() {
+    delete kytea;
+}
+
+ModelHandle::~ModelHandle() {
+    release(model_);
+}
+
+void ModelHandle::loadModel(const string & file, KyteaConfig * config) {
+    if(config == 0) {
+        config = new KyteaConfig;
+        config->setDebug(0);
+    }
+    config->setOnTraining(false);
+    // the model is read before the lock is taken, so analysis continues
+    Kytea * kytea = new Kytea(config);
+    try {
+        kytea->readModel(file.c_str());
+        if(config->getOverlayFile().length())
+            kytea->loadOverlayDictionary(config->getOverlayFile(), config->getOverlaySlot());
+    } catch(...) {
+        delete kytea;
+        throw;
+    }
+    publish(kytea);
+}
+
+void ModelHandle::publish(Kytea * kytea) {
+    mutex_.lock();
+    PublishedModel * old = model_;
+    model_ = new PublishedModel(kytea, ++generation_);
+    mutex_.unlock();
+    release(old);
+}
+
+unsigned ModelHandle::getGeneration() {
+    mutex_.lock();
+    unsigned ret = generation_;
+    mutex_.unlock();
+    return ret;
+}
+
+PublishedModel * ModelHandle::acquire() {
+    mutex_.lock();
+    PublishedModel * ret = model_;
+    if(ret) ret->refs++;
+    mutex_.unlock();
+    return ret;
+}
+
+void ModelHandle::release(PublishedModel * model) {
+    if(!model) return;
+    mutex_.lock();
+    bool last = (--model->refs == 0);
+    mutex_.unlock();
+    if(last) delete model;
+}
@@ -157,7 +157,7 @@ void TextModelIO::writeModel(const KyteaModel * mod) {
         if(i < nr_feature)
             *str_ << util_->showString(names[i+1]) << endl;
     	for(j=0; j<nr_w; j++)
-            *str_ << mod->getWeight(i,j) << " ";
+            *str_ << (double)mod->getWeight(i,j) << " ";
         *str_ << endl;
     }
 
@@ -365,6 +365,7 @@ KyteaLM * TextModelIO::readLM() {
         if(prob != NEG_INFINITY)
             lm->probs_.insert(pair<KyteaString,double>(kword,prob)); 
     }
+    lm->compile();
 
     return lm;
 }
@@ -374,7 +375,7 @@ void TextModelIO::writeFeatVec(const vector<FeatVal> * entry) {
     int mySize = (int)(entry ? entry->size() : 0);
     for(int j = 0; j < mySize; j++) {
         if(j!=0) *str_ << " ";
-        *str_ << (*entry)[j];
+        *str_ << (double)(*entry)[j];
         // *str_ << util_->showString((*entry)[j]);
     }
     *str_ << endl;
@@ -667,6 +668,7 @@ KyteaLM* BinaryModelIO::readLM() {
                 lm->fallbacks_.insert(pair<KyteaString,double>(str,fallback));
         }
     } 
+    lm->compile();
 
     return lm;
 
@@ -0,0 +1,101 @@
+#include <kytea/online-learner.h>
+#include "liblinear/linear.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace kytea;
+using namespace std;
+
+// the learning rate for AdaGrad
+#define ADAGRAD_RATE 1.0
+
+double OnlineLearner::score(int k, const vector<unsigned> & feat) const {
+    const vector<double> & w = weights_[k];
+    double ret = (bias_>=0 && w.size() > 0 ? w[0]*bias_ : 0);
+    for(unsigned i = 0; i < feat.size(); i++)
+        if(feat[i] < w.size())
+            ret += w[feat[i]];
+    return ret;
+}
+
+void OnlineLearner::addWeights(int k, const vector<unsigned> & feat, double val) {
+    vector<double> & w = weights_[k], & sums = sums_[k];
+    unsigned myMax = 0;
+    for(unsigned i = 0; i < feat.size(); i++)
+        myMax = max(myMax, feat[i]);
+    if(myMax >= w.size()) {
+        w.resize(myMax+1, 0);
+        sums.resize(myMax+1, 0);
+    }
+    // feature 0 is the bias, all other features have a value of one
+    for(int i = (bias_>=0 ? -1 : 0); i < (int)feat.size(); i++) {
+        unsigned id = (i < 0 ? 0 : feat[i]);
+        double g = (i < 0 ? val*bias_ : val);
+        if(alg_ == ADAGRAD) {
+            sums[id] += g*g;
+            if(sums[id] > 0)
+                w[id] += ADAGRAD_RATE*g/sqrt(sums[id]);
+        } else {
+            w[id] += g;
+            sums[id] += count_*g;
+        }
+    }
+}
+
+void OnlineLearner::update(const vector<unsigned> & feat, int label) {
+    // find the class, adding it if it is new
+    int myClass = find(labels_.begin(), labels_.end(), label) - labels_.begin();
+    if(myClass == (int)labels_.size()) {
+        labels_.push_back(label);
+        weights_.push_back(vector<double>());
+        sums_.push_back(vector<double>());
+    }
+    // find the best scoring class other than the correct one
+    int numClasses = labels_.size(), other = -1;
+    double correct = score(myClass, feat), best = 0;
+    for(int k = 0; k < numClasses; k++) {
+        if(k == myClass) continue;
+        double val = score(k, feat);
+        if(other == -1 || val > best) {
+            other = k; best = val;
+        }
+    }
+    // the perceptron updates on mistakes, AdaGrad minimizes the hinge loss
+    if(other != -1) {
+        bool mistake = (alg_ == ADAGRAD ? correct-best < 1 :
+                                          best > correct || (best == correct && other < myClass));
+        if(mistake) {
+            addWeights(myClass, feat, 1);
+            addWeights(other, feat, -1);
+        }
+    }
+    count_++;
+}
+
+void OnlineLearner::finish(KyteaModel & model) const {
+    if(labels_.size() == 0) return;
+    // lay out the weights in the same way as liblinear, with the features
+    // followed by the bias
+    const int numClasses = labels_.size();
+    const int numW = (numClasses == 2 ? 1 : numClasses);
+    const int numNames = model.getNames().size();
+    vector<double> w(numNames*numW, 0);
+    for(int k = 0; k < numClasses; k++) {
+        const vector<double> & myW = weights_[k], & mySums = sums_[k];
+        for(int id = 0; id < (int)myW.size() && id < numNames; id++) {
+            if(id == 0 && bias_ < 0) continue;
+            double val = (alg_ == ADAGRAD ? myW[id] : myW[id]-mySums[id]/count_);
+            int row = (id == 0 ? numNames-1 : id-1);
+            // with two classes, the single vector is for the first label
+            if(numW == 1)
+                w[row] += (k == 0 ? val : -val);
+            else
+                w[row*numW+k] = val;
+        }
+    }
+    // online models give margins, in the same way as SVMs
+    model.setSolver(L2R_L2LOSS_SVC_DUAL);
+    model.setBias(bias_);
+    model.setTrainedWeights(&w.front(), labels_);
+    model.setAddFeatures(false);
+}
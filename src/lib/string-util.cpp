@@ -15,41 +15,111 @@
 */
 
 #include <kytea/string-util.h>
+#include <kytea/lru-cache.h>
 #include <iostream>
+#include <algorithm>
 
 using namespace kytea;
 using namespace std;
 
+// the number of characters that a KyteaChar can represent, and the number
+// of names and types that are allocated together
+#define UTF8_MAX_CHARS 65536
+#define UTF8_PAGE_BITS 8
+#define UTF8_PAGE_SIZE (1 << UTF8_PAGE_BITS)
+
+StringUtilUtf8::StringUtilUtf8() : charIds_(), charNames_(UTF8_MAX_CHARS/UTF8_PAGE_SIZE, (string*)0), charTypes_(UTF8_MAX_CHARS/UTF8_PAGE_SIZE, (CharType*)0), numChars_(0), codeIds_(UTF8_MAX_CHARS, 0), mutex_(new CacheMutex) {
+    const char * initial[7] = { "", "K", "T", "H", "R", "D", "O" };
+    for(unsigned i = 0; i < 7; i++)
+        addChar(initial[i], i==0?6:4); // first is other, rest romaji
+}
+
+StringUtilUtf8::~StringUtilUtf8() {
+    clearChars();
+    delete mutex_;
+}
+
+KyteaChar StringUtilUtf8::addChar(const string & str, CharType type) {
+    const KyteaChar ret = numChars_;
+    const unsigned page = ret >> UTF8_PAGE_BITS;
+    if(charNames_[page] == 0) {
+        charNames_[page] = new string[UTF8_PAGE_SIZE];
+        charTypes_[page] = new CharType[UTF8_PAGE_SIZE];
+    }
+    charNames_[page][ret & (UTF8_PAGE_SIZE-1)] = str;
+    charTypes_[page][ret & (UTF8_PAGE_SIZE-1)] = type;
+    charIds_.insert(pair<string,KyteaChar>(str, ret));
+    __atomic_store_n(&numChars_, numChars_+1, __ATOMIC_RELEASE);
+    return ret;
+}
+
+void StringUtilUtf8::clearChars() {
+    for(unsigned i = 0; i < charNames_.size(); i++) {
+        delete [] charNames_[i]; charNames_[i] = 0;
+        delete [] charTypes_[i]; charTypes_[i] = 0;
+    }
+    charIds_.clear();
+    codeIds_.assign(UTF8_MAX_CHARS, 0);
+    numChars_ = 0;
+}
+
+// the code point of a string holding a single character of the basic
+// multilingual plane, or -1 for any other string
+static int findCodePoint(const string & str) {
+    const unsigned char * s = (const unsigned char *)str.data();
+    int ret = -1;
+    if(str.length() == 1 && s[0] < 0x80)
+        ret = s[0];
+    else if(str.length() == 2 && (s[0] & 0xE0) == 0xC0 && (s[1] & 0xC0) == 0x80)
+        ret = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    else if(str.length() == 3 && (s[0] & 0xF0) == 0xE0 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80)
+        ret = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+    // overlong encodings are different strings, so they are not looked up
+    if((str.length() == 2 && ret < 0x80) || (str.length() == 3 && ret < 0x800))
+        ret = -1;
+    return ret;
+}
+
 // map a string to a character
 KyteaChar StringUtilUtf8::mapChar(const string & str, bool add) {
+    // characters that were seen before are found without locking
+    int code = findCodePoint(str);
+    if(code >= 0) {
+        KyteaChar seen = __atomic_load_n(&codeIds_[code], __ATOMIC_ACQUIRE);
+        if(seen)
+            return seen;
+    }
+    mutex_->lock();
     StringCharMap::iterator it = charIds_.find(str);
     KyteaChar ret = 0;
     if(it != charIds_.end())
         ret = it->second;
-    else if (add) {
-        ret = charTypes_.size();
-        charIds_.insert(pair<string, KyteaChar>(str,ret));
-        charTypes_.push_back(findType(str));
-        charNames_.push_back(str);
-    }
+    else if (add && numChars_ < UTF8_MAX_CHARS)
+        ret = addChar(str, findType(str));
+    // the name and type must be visible before the ID is
+    if(code >= 0 && ret)
+        __atomic_store_n(&codeIds_[code], ret, __ATOMIC_RELEASE);
+    mutex_->unlock();
     return ret;
 }
 
 string StringUtilUtf8::showChar(KyteaChar c) {
 #ifdef KYTEA_SAFE
-    if(c >= charNames_.size())
+    if(c >= __atomic_load_n(&numChars_, __ATOMIC_ACQUIRE))
         THROW_ERROR("FATAL: Index out of bounds in showChar");
 #endif 
-    return charNames_[c];
+    return charNames_[c >> UTF8_PAGE_BITS][c & (UTF8_PAGE_SIZE-1)];
 }
 
 StringUtil::CharType StringUtilUtf8::findType(KyteaChar c) {
-    return charTypes_[c];
+    return charTypes_[c >> UTF8_PAGE_BITS][c & (UTF8_PAGE_SIZE-1)];
 }
 
-KyteaString StringUtilUtf8::mapString(const string & str) {
+KyteaString StringUtilUtf8::mapString(const string & str, vector<unsigned> * byteEnds) {
     unsigned pos = 0, len = str.length();
     vector<KyteaChar> ret;
+    if(byteEnds)
+        byteEnds->clear();
     while(pos < len) {
         // single character unicode values
         if(!(maskl1 & str[pos]))
@@ -75,6 +145,8 @@ KyteaString StringUtilUtf8::mapString(const string & str) {
             ret.push_back(mapChar(str.substr(pos, 2)));
             pos += 2;
         }
+        if(byteEnds)
+            byteEnds->push_back(min(pos, len));
     }
     KyteaString retstr(ret.size());
     for(unsigned i = 0; i < ret.size(); i++)
@@ -82,6 +154,16 @@ KyteaString StringUtilUtf8::mapString(const string & str) {
     return retstr;
 }
 
+unsigned StringUtilUtf8::getCharLength(char first) {
+    if(!(maskl1 & first) || (maskl5 & first) == maskl5)
+        return 1;
+    else if((maskl4 & first) == maskl4)
+        return 4;
+    else if((maskl3 & first) == maskl3)
+        return 3;
+    return 2;
+}
+
 // find the type of a unicode character
 StringUtil::CharType StringUtilUtf8::findType(const string & str) {
     // find the type of a unicode character
@@ -123,18 +205,25 @@ StringUtil::CharType StringUtilUtf8::findType(const string & str) {
 
 
 void StringUtilUtf8::unserialize(const string & str) {
-    charIds_.clear(); charNames_.clear(); charTypes_.clear();
+    clearChars();
     mapChar("");
     KyteaString ret = mapString(str);
 }
 
 string StringUtilUtf8::serialize() const {
     ostringstream buff;
-    for(unsigned i = 1; i < charNames_.size(); i++)
-        buff << charNames_[i];
+    for(unsigned i = 1; i < numChars_; i++)
+        buff << charNames_[i >> UTF8_PAGE_BITS][i & (UTF8_PAGE_SIZE-1)];
     return buff.str();
 }
 
+vector<string> StringUtilUtf8::getCharNames() const {
+    vector<string> ret(numChars_);
+    for(unsigned i = 0; i < numChars_; i++)
+        ret[i] = charNames_[i >> UTF8_PAGE_BITS][i & (UTF8_PAGE_SIZE-1)];
+    return ret;
+}
+
 inline KyteaChar eucm(char a, char b) {
     KyteaChar ret = a & 0xFF;
     ret = ret << 8;
@@ -184,9 +273,11 @@ string StringUtilEuc::showChar(KyteaChar c) {
 }
 
 // map an unparsed string to a KyteaString
-KyteaString StringUtilEuc::mapString(const string & str) {
+KyteaString StringUtilEuc::mapString(const string & str, vector<unsigned> * byteEnds) {
     unsigned pos = 0, len = str.length();
     vector<KyteaChar> ret;
+    if(byteEnds)
+        byteEnds->clear();
     while(pos < len) {
         // single character unicode values
         if(!(maskl1 & str[pos]))
@@ -195,6 +286,8 @@ KyteaString StringUtilEuc::mapString(const string & str) {
             ret.push_back(mapChar(str.substr(pos,2)));
             pos += 2;
         }
+        if(byteEnds)
+            byteEnds->push_back(min(pos, len));
     }
     KyteaString retstr(ret.size());
     for(unsigned i = 0; i < ret.size(); i++)
@@ -202,6 +295,10 @@ KyteaString StringUtilEuc::mapString(const string & str) {
     return retstr;
 }
 
+unsigned StringUtilEuc::getCharLength(char first) {
+    return (maskl1 & first) ? 2 : 1;
+}
+
 // get the type of a character
 StringUtil::CharType StringUtilEuc::findType(const string & str) {
     return findType(mapChar(str));
@@ -294,9 +391,11 @@ string StringUtilSjis::showChar(KyteaChar c) {
 }
 
 // map an unparsed string to a KyteaString
-KyteaString StringUtilSjis::mapString(const string & str) {
+KyteaString StringUtilSjis::mapString(const string & str, vector<unsigned> * byteEnds) {
     unsigned pos = 0, len = str.length();
     vector<KyteaChar> ret;
+    if(byteEnds)
+        byteEnds->clear();
     while(pos < len) {
         // single character unicode values
         const unsigned char first = (unsigned char)str[pos];
@@ -306,6 +405,8 @@ KyteaString StringUtilSjis::mapString(const string & str) {
             ret.push_back(mapChar(str.substr(pos,2)));
             pos += 2;
         }
+        if(byteEnds)
+            byteEnds->push_back(min(pos, len));
     }
     KyteaString retstr(ret.size());
     for(unsigned i = 0; i < ret.size(); i++)
@@ -313,6 +414,11 @@ KyteaString StringUtilSjis::mapString(const string & str) {
     return retstr;
 }
 
+unsigned StringUtilSjis::getCharLength(char first) {
+    const unsigned char c = (unsigned char)first;
+    return (!(c & maskl1) || (c >= 0xA0 && c <= 0xDF)) ? 1 : 2;
+}
+
 // get the type of a character
 StringUtil::CharType StringUtilSjis::findType(const string & str) {
     return findType(mapChar(str));
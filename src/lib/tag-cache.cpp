@@ -0,0 +1,21 @@
+#include <kytea/config.h>
+#include <kytea/tag-cache.h>
+
+using namespace kytea;
+using namespace std;
+
+// the key for a word is the tag level followed by the surface
+static KyteaString makeCacheKey(const KyteaString & surf, int lev) {
+    KyteaString ret(surf.length()+1);
+    ret[0] = lev;
+    ret.splice(surf, 1);
+    return ret;
+}
+
+bool TagCache::find(const KyteaString & surf, int lev, vector<KyteaTag> & tags) {
+    return cache_.find(makeCacheKey(surf, lev), tags);
+}
+
+void TagCache::add(const KyteaString & surf, int lev, const vector<KyteaTag> & tags) {
+    cache_.add(makeCacheKey(surf, lev), tags);
+}
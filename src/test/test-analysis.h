@@ -4,6 +4,15 @@
 #include "test-base.h"
 #include <kytea/corpus-io.h>
 #include <kytea/model-io.h>
+#include <kytea/model-handle.h>
+#include <kytea/kytea-server.h>
+#include <kytea/kytea-c.h>
+#include <kytea/kytea-stats.h>
+#include <kytea/feature-shards.h>
+#include <pthread.h>
+#include <cmath>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace kytea {
 
@@ -300,6 +309,835 @@ public:
         return 1;
     }
 
+    int testQuantizedRoundTrip() {
+        // The weights have the size chosen by --enable-quantize
+#if QUANTIZE_8BIT
+        if(sizeof(FeatVal) != 1) {
+            cerr << "The 8-bit build has weights of " << sizeof(FeatVal) << " bytes" << endl;
+            return 0;
+        }
+#endif
+        const char * sents[4] = {"これは学習データです。", "どうぞモデルを学習してください！", "京都に行った", "処理をした。"};
+        const char formats[2] = {ModelIO::FORMAT_TEXT, ModelIO::FORMAT_BINARY};
+        int ok = 1;
+        for(int f = 0; f < 2; f++) {
+            // Write and read the model, which must carry the version of
+            // this build's weight size
+            kytea->getConfig()->setModelFormat(formats[f]);
+            kytea->writeModel("/tmp/kytea-quant-model.bin");
+            ifstream ifs("/tmp/kytea-quant-model.bin");
+            string header;
+            getline(ifs, header);
+            if(header.find(string(" ") + MODEL_IO_VERSION + " ") == string::npos) {
+                cerr << "The model header '" << header << "' does not have version " << MODEL_IO_VERSION << endl;
+                ok = 0;
+            }
+            Kytea actKytea;
+            actKytea.readModel("/tmp/kytea-quant-model.bin");
+            StringUtil * actUtil = actKytea.getStringUtil();
+            // The analysis must be the same, and the confidences the same
+            // within the precision that the multiplier is written with
+            for(int i = 0; i < 4; i++) {
+                KyteaSentence exp(util->mapString(sents[i])), act(actUtil->mapString(sents[i]));
+                kytea->calculateWS(exp); kytea->calculateTags(exp, 0);
+                actKytea.calculateWS(act); actKytea.calculateTags(act, 0);
+                for(unsigned j = 0; j < exp.wsConfs.size(); j++) {
+                    if(fabs(exp.wsConfs[j] - act.wsConfs[j]) > 1e-6 * max(1.0, fabs(exp.wsConfs[j]))) {
+                        cerr << "Confidence " << j << " of '" << sents[i] << "' is " << act.wsConfs[j] << " not " << exp.wsConfs[j] << endl;
+                        ok = 0;
+                    }
+                }
+                if(act.words.size() != exp.words.size()) {
+                    cerr << "'" << sents[i] << "' has " << act.words.size() << " words, not " << exp.words.size() << endl;
+                    ok = 0;
+                    continue;
+                }
+                for(unsigned j = 0; j < exp.words.size(); j++) {
+                    const KyteaTag & expTag = exp.words[j].tags[0][0], & actTag = act.words[j].tags[0][0];
+                    if(util->showString(exp.words[j].surf) != actUtil->showString(act.words[j].surf) ||
+                       util->showString(expTag.first) != actUtil->showString(actTag.first) ||
+                       fabs(expTag.second - actTag.second) > 1e-6 * max(1.0, fabs(expTag.second))) {
+                        cerr << "Word " << j << " of '" << sents[i] << "' is " << actUtil->showString(act.words[j].surf) << "/" << actUtil->showString(actTag.first) << "/" << actTag.second
+                             << " not " << util->showString(exp.words[j].surf) << "/" << util->showString(expTag.first) << "/" << expTag.second << endl;
+                        ok = 0;
+                    }
+                }
+            }
+        }
+        return ok;
+    }
+
+    // Train a model on the toy corpus (or another corpus in the same format)
+    //  with the options in opts added to the ones used for the SVM model
+    Kytea * trainToyModel(const char * model, int numOpts, const char ** opts, const char * corpus = "/tmp/kytea-toy-corpus.txt") {
+        vector<const char *> args;
+        const char * base[7] = {"", "-model", model, "-full", corpus, "-global", "1"};
+        args.insert(args.end(), base, base+7);
+        args.insert(args.end(), opts, opts+numOpts);
+        KyteaConfig * config = new KyteaConfig;
+        config->setDebug(0);
+        config->setOnTraining(true);
+        config->parseTrainCommandLine(args.size(), &args[0]);
+        Kytea * ret = new Kytea(config);
+        ret->trainAll();
+        config->setOnTraining(false);
+        return ret;
+    }
+
+    // Check that a model trained on the toy corpus analyzes its first
+    //  sentence correctly
+    int checkToyAnalysis(Kytea & toy) {
+        StringUtil * toyUtil = toy.getStringUtil();
+        KyteaSentence sentence(toyUtil->mapString("これは学習データです。"));
+        toy.calculateWS(sentence);
+        toy.calculateTags(sentence,0);
+        KyteaString::Tokens words = toyUtil->mapString("これ は 学習 データ で す 。").tokenize(toyUtil->mapString(" "));
+        KyteaString::Tokens tags = toyUtil->mapString("代名詞 助詞 名詞 名詞 助動詞 語尾 補助記号").tokenize(toyUtil->mapString(" "));
+        return checkWordSeg(sentence,words,toyUtil) && checkTags(sentence,tags,0,toyUtil);
+    }
+
+    int testWarmStart() {
+        // With a very loose stopping criterion training stops right away, so
+        // a warm-started model keeps the weights of the SVM model, and a
+        // model trained from zero keeps weights of zero
+        const char * warmOpts[6] = {"-solver", "2", "-eps", "10", "-init", "/tmp/kytea-svm-model.bin"};
+        Kytea * warm = trainToyModel("/tmp/kytea-warm-model.bin", 6, warmOpts);
+        Kytea * cold = trainToyModel("/tmp/kytea-cold-model.bin", 4, warmOpts);
+        KyteaSentence svmSent(util->mapString("これは学習データです。"));
+        KyteaSentence warmSent(warm->getStringUtil()->mapString("これは学習データです。"));
+        KyteaSentence coldSent(cold->getStringUtil()->mapString("これは学習データです。"));
+        kytea->calculateWS(svmSent);
+        warm->calculateWS(warmSent);
+        cold->calculateWS(coldSent);
+        int ok = checkToyAnalysis(*warm);
+        for(unsigned i = 0; i < svmSent.wsConfs.size(); i++) {
+            if(fabs(warmSent.wsConfs[i] - svmSent.wsConfs[i]) > 0.01 * fabs(svmSent.wsConfs[i]) + 1e-4) {
+                cerr << "Warm-started confidence " << i << " is " << warmSent.wsConfs[i] << " not " << svmSent.wsConfs[i] << endl;
+                ok = 0;
+            }
+            if(coldSent.wsConfs[i] == svmSent.wsConfs[i]) {
+                cerr << "Confidence " << i << " without -init is the same as with it" << endl;
+                ok = 0;
+            }
+        }
+        delete warm;
+        delete cold;
+        return ok;
+    }
+
+    int testOnlineTraining() {
+        // Train models with each of the online learners
+        int ok = 1;
+        for(int alg = 0; alg < 2; alg++) {
+            const char * onlineOpts[4] = {"-online", "10", "-onlinealg", (alg ? "1" : "0")};
+            Kytea * online = trainToyModel("/tmp/kytea-online-model.bin", 4, onlineOpts);
+            if(!checkToyAnalysis(*online))
+                ok = 0;
+            delete online;
+        }
+        return ok;
+    }
+
+    int testShardTraining() {
+        // A small budget writes the buffered examples to several shards
+        FeatureShards small("/tmp", 64, 1);
+        vector<unsigned> feat(4, 1);
+        for(int i = 0; i < 8; i++)
+            small.addExample(feat, 1);
+        if(small.getNumShards() < 2) {
+            cerr << "Only " << small.getNumShards() << " shards were written" << endl;
+            return 0;
+        }
+        // The holder removes the shards it owns, so their directory can be
+        // removed when it goes out of scope
+        const char * holderDir = "/tmp/kytea-shard-holder";
+        mkdir(holderDir, 0755);
+        {
+            FeatureShardsHolder holder(new FeatureShards(holderDir, 64, 1));
+            for(int i = 0; i < 8; i++)
+                holder.get()->addExample(feat, 1);
+        }
+        if(rmdir(holderDir) != 0) {
+            cerr << "The shards were not removed by their holder" << endl;
+            return 0;
+        }
+        // Train the SVM model again with the features spilled to disk in
+        // shards of about 1KB
+        const char * shardOpts[4] = {"-scratch", "/tmp", "-shardmem", "0.001"};
+        Kytea * shard = trainToyModel("/tmp/kytea-shard-model.bin", 4, shardOpts);
+        // The WS and global tag models should be the same as ones trained in
+        // memory
+        kytea->getWSModel()->checkEqual(*shard->getWSModel());
+        kytea->getGlobalModel(0)->checkEqual(*shard->getGlobalModel(0));
+        delete shard;
+        // A budget of zero would write every example to its own shard
+        const char * zeroOpts[4] = {"-scratch", "/tmp", "-shardmem", "0"};
+        try {
+            delete trainToyModel("/tmp/kytea-shard-model.bin", 4, zeroOpts);
+            cerr << "-shardmem 0 was accepted" << endl;
+            return 0;
+        } catch (std::exception & e) { }
+        return 1;
+    }
+
+    static void * pipeThread(void * fifo) {
+        // Write the toy corpus to the pipe once
+        ifstream ifs("/tmp/kytea-toy-corpus.txt");
+        ofstream ofs((const char *)fifo);
+        ofs << ifs.rdbuf();
+        return 0;
+    }
+
+    int testPipeTraining() {
+        // Train the SVM model again from a corpus that can only be read once
+        const char * fifo = "/tmp/kytea-toy-corpus.fifo";
+        unlink(fifo);
+        if(mkfifo(fifo, 0600) != 0) {
+            cerr << "Could not make the pipe " << fifo << endl;
+            return 0;
+        }
+        pthread_t thread;
+        pthread_create(&thread, NULL, pipeThread, (void *)fifo);
+        Kytea * pipe = trainToyModel("/tmp/kytea-pipe-model.bin", 0, 0, fifo);
+        pthread_join(thread, NULL);
+        unlink(fifo);
+        // The model should be the same as one trained from the file
+        kytea->getWSModel()->checkEqual(*pipe->getWSModel());
+        int ok = checkToyAnalysis(*pipe);
+        delete pipe;
+        return ok;
+    }
+
+    int testDictionaryMatchReuse() {
+        // The matches from segmentation are kept in the sentence
+        KyteaSentence sentence(util->mapString("これは学習データです。"));
+        kytea->calculateWS(sentence);
+        if(sentence.dictMatchGeneration == 0 || sentence.dictMatches.size() == 0) {
+            cerr << "Dictionary matches were not stored in the sentence" << endl;
+            return 0;
+        }
+        // Tagging with a different model must not use the stored matches
+        kyteaMCSVM->calculateTags(sentence,0);
+        KyteaString::Tokens toks = util->mapString("代名詞 助詞 名詞 名詞 助動詞 語尾 補助記号").tokenize(util->mapString(" "));
+        if(!checkTags(sentence,toks,0,util))
+            return 0;
+        // Nor may tagging after the characters were replaced, or changed in
+        // place
+        KyteaString kyoto = util->mapString("京都に行った");
+        KyteaString::Tokens kyotoWords = util->mapString("京都 に 行 っ た").tokenize(util->mapString(" "));
+        KyteaString::Tokens kyotoTags = util->mapString("名詞 助詞 動詞 語尾 助動詞").tokenize(util->mapString(" "));
+        KyteaSentence edited(util->mapString("これは学習デ"));
+        kytea->calculateWS(sentence);
+        kytea->calculateWS(edited);
+        sentence.chars = kyoto;
+        for(unsigned i = 0; i < kyoto.length(); i++)
+            edited.chars[i] = kyoto[i];
+        sentence.words.clear();
+        edited.words.clear();
+        for(unsigned i = 0; i < kyotoWords.size(); i++) {
+            sentence.words.push_back(KyteaWord(kyotoWords[i]));
+            edited.words.push_back(KyteaWord(kyotoWords[i]));
+        }
+        kytea->calculateTags(sentence,0);
+        kytea->calculateTags(edited,0);
+        // every stored match must be a word of the new characters
+        KyteaSentence * sents[2] = {&sentence, &edited};
+        for(int i = 0; i < 2; i++) {
+            for(unsigned j = 0; j < sents[i]->dictMatches.size(); j++) {
+                const KyteaString & word = sents[i]->dictMatches[j].second->word;
+                const unsigned end = sents[i]->dictMatches[j].first;
+                if(end >= kyoto.length() || end+1 < word.length() || kyoto.substr(end+1-word.length(), word.length()) != word) {
+                    cerr << "Stale dictionary match " << util->showString(word) << " at " << end << endl;
+                    return 0;
+                }
+            }
+        }
+        return checkTags(sentence,kyotoTags,0,util) && checkTags(edited,kyotoTags,0,util);
+    }
+
+    int testSentenceCache() {
+        // Read the SVM model with the sentence cache turned on
+        KyteaConfig * configCache = new KyteaConfig;
+        configCache->setDebug(0);
+        configCache->setOnTraining(false);
+        configCache->setSentenceCache(1);
+        Kytea kyteaCache(configCache);
+        kyteaCache.readModel("/tmp/kytea-svm-model.bin");
+        StringUtil * utilCache = kyteaCache.getStringUtil();
+        KyteaString::Tokens words = utilCache->mapString("これ は 学習 データ で す 。").tokenize(utilCache->mapString(" "));
+        KyteaString::Tokens tags = utilCache->mapString("代名詞 助詞 名詞 名詞 助動詞 語尾 補助記号").tokenize(utilCache->mapString(" "));
+        // The second analysis should come from the cache
+        int ok = 1;
+        KyteaSentence sentences[2];
+        for(int i = 0; i < 2; i++) {
+            KyteaSentence & sentence = sentences[i];
+            sentence = KyteaSentence(utilCache->mapString("これは学習データです。"));
+            kyteaCache.analyzeSentence(sentence);
+            if(!checkWordSeg(sentence,words,utilCache) || !checkTags(sentence,tags,0,utilCache))
+                ok = 0;
+        }
+        // and keep everything that a fresh analysis leaves in the sentence
+        if(sentences[1].dictMatches != sentences[0].dictMatches ||
+           sentences[1].dictMatchGeneration != sentences[0].dictMatchGeneration ||
+           sentences[1].dictMatchChars != sentences[0].dictMatchChars ||
+           sentences[1].overlayGeneration != sentences[0].overlayGeneration ||
+           sentences[1].overlayMatchGeneration != sentences[0].overlayMatchGeneration ||
+           sentences[1].overlayMatchChars != sentences[0].overlayMatchChars) {
+            cout << "The cached sentence lost its dictionary matches"<<endl;
+            ok = 0;
+        }
+        const SentenceCache * cache = kyteaCache.getSentenceCache();
+        if(cache->getHits() != 1 || cache->getMisses() != 1) {
+            cout << "hits="<<cache->getHits()<<", misses="<<cache->getMisses()<<endl;
+            ok = 0;
+        }
+        // Sentences with partial annotation are not cached
+        KyteaSentence partial(utilCache->mapString("これは学習データです。"));
+        partial.wsConfs[0] = 100;
+        kyteaCache.analyzeSentence(partial);
+        if(cache->getHits() != 1 || cache->getMisses() != 1) {
+            cout << "Partially annotated sentence used the cache"<<endl;
+            ok = 0;
+        }
+        return ok;
+    }
+
+    int testOverlayDictionary() {
+        // Add a reading for an unknown word without retraining
+        ofstream ofs("/tmp/kytea-overlay-dict.txt");
+        ofs << "東京/名詞/とうきょう" << endl; ofs.close();
+        Kytea kyteaOverlay;
+        kyteaOverlay.readModel("/tmp/kytea-svm-model.bin");
+        StringUtil * utilOverlay = kyteaOverlay.getStringUtil();
+        KyteaString::Tokens unk = utilOverlay->mapString("UNK に い っ た 。").tokenize(utilOverlay->mapString(" "));
+        KyteaString::Tokens known = utilOverlay->mapString("とうきょう に い っ た 。").tokenize(utilOverlay->mapString(" "));
+        int ok = 1;
+        KyteaSentence last;
+        for(int i = 0; i < 3; i++) {
+            if(i == 1) kyteaOverlay.loadOverlayDictionary("/tmp/kytea-overlay-dict.txt", 0);
+            if(i == 2) kyteaOverlay.clearOverlayDictionary();
+            // the overlay matches of the last step must not be reused
+            KyteaSentence sentence(utilOverlay->mapString("東京に行った。"));
+            sentence.overlayMatches = last.overlayMatches;
+            sentence.overlayMatchGeneration = last.overlayMatchGeneration;
+            sentence.overlayMatchChars = last.overlayMatchChars;
+            kyteaOverlay.calculateWS(sentence);
+            kyteaOverlay.calculateTags(sentence,1);
+            if(sentence.words[0].getUnknown() != (i != 1) || !checkTags(sentence,(i == 1 ? known : unk),1,utilOverlay)) {
+                cout << "Overlay dictionary failed in step "<<i<<endl;
+                ok = 0;
+            }
+            if(sentence.overlayMatches.size() != (i == 1 ? 1u : 0u)) {
+                cout << "Found "<<sentence.overlayMatches.size()<<" overlay matches in step "<<i<<endl;
+                ok = 0;
+            }
+            last = sentence;
+        }
+        return ok;
+    }
+
+    int testModelHandle() {
+        // Swap in a new model while a lease still holds the old one
+        ModelHandle handle;
+        handle.loadModel("/tmp/kytea-svm-model.bin");
+        int ok = 1;
+        {
+            ModelHandle::Lease oldLease(handle);
+            handle.loadModel("/tmp/kytea-logist-model.bin");
+            ModelHandle::Lease newLease(handle);
+            if(oldLease.getGeneration() != 1 || newLease.getGeneration() != 2 || oldLease.get() == newLease.get()) {
+                cout << "Bad generations "<<oldLease.getGeneration()<<" and "<<newLease.getGeneration()<<endl;
+                ok = 0;
+            }
+            // The old model can still be used after the swap
+            StringUtil * oldUtil = oldLease->getStringUtil();
+            KyteaSentence sentence(oldUtil->mapString("これは学習データです。"));
+            oldLease->calculateWS(sentence);
+            if(!checkWordSeg(sentence,oldUtil->mapString("これ は 学習 データ で す 。").tokenize(oldUtil->mapString(" ")),oldUtil))
+                ok = 0;
+        }
+        ModelHandle::Lease lease(handle);
+        StringUtil * leaseUtil = lease->getStringUtil();
+        KyteaSentence sentence(leaseUtil->mapString("これは学習データです。"));
+        lease->calculateWS(sentence);
+        if(!checkWordSeg(sentence,leaseUtil->mapString("これ は 学習 データ で す 。").tokenize(leaseUtil->mapString(" ")),leaseUtil))
+            ok = 0;
+        return ok;
+    }
+
+    struct LeaseThread {
+        ModelHandle * handle;
+        int ok;
+    };
+
+    static void * leaseThread(void * arg) {
+        LeaseThread * lt = (LeaseThread*)arg;
+        for(int i = 0; i < 200 && lt->ok; i++) {
+            ModelHandle::Lease lease(*lt->handle);
+            StringUtil * leaseUtil = lease->getStringUtil();
+            KyteaSentence sentence(leaseUtil->mapString("これは学習データです。"));
+            lease->analyzeSentence(sentence);
+            if(sentence.words.size() != 7 || sentence.words[2].getTagSurf(0) != leaseUtil->mapString("名詞"))
+                lt->ok = 0;
+        }
+        return 0;
+    }
+
+    int testModelHandleThreads() {
+        // Analyze with leases from several threads while models are swapped
+        ModelHandle handle;
+        handle.loadModel("/tmp/kytea-svm-model.bin");
+        const int numThreads = 8;
+        vector<pthread_t> threads(numThreads);
+        vector<LeaseThread> args(numThreads);
+        for(int i = 0; i < numThreads; i++) {
+            args[i].handle = &handle;
+            args[i].ok = 1;
+            pthread_create(&threads[i], NULL, leaseThread, &args[i]);
+        }
+        for(int i = 0; i < 4; i++)
+            handle.loadModel(i % 2 ? "/tmp/kytea-svm-model.bin" : "/tmp/kytea-logist-model.bin");
+        int ok = 1;
+        for(int i = 0; i < numThreads; i++) {
+            pthread_join(threads[i], NULL);
+            if(!args[i].ok) {
+                cout << "Bad analysis in thread "<<i<<endl;
+                ok = 0;
+            }
+        }
+        return ok;
+    }
+
+    static void * serveThread(void * server) {
+        ((KyteaServer*)server)->serve();
+        return 0;
+    }
+
+    int testServer() {
+        // Serve the SVM model on a Unix domain socket
+        ModelHandle handle;
+        handle.loadModel("/tmp/kytea-svm-model.bin");
+        KyteaServer server(handle, 2, 4, 1, 8);
+        server.listenSocket("/tmp/kytea-test-server.sock");
+        pthread_t thread;
+        pthread_create(&thread, NULL, serveThread, &server);
+        // Send requests with different options from one connection
+        const char * requests[4] = { "\nこれは学習データです。\n", "-notags\nこれは学習データです。", "-nosuchoption\n", "-notag\nこれは学習データです。" };
+        const char * responses[4] = { "OK\nこれ/代名詞/これ は/助詞/は 学習/名詞/がくしゅう データ/名詞/でーた で/助動詞/で す/語尾/す 。/補助記号/。\n",
+                                      "OK\nこれ は 学習 データ で す 。\n",
+                                      "ERROR",
+                                      "ERROR" };
+        int ok = 1;
+        int fd = KyteaServer::connectSocket("/tmp/kytea-test-server.sock");
+        for(int i = 0; i < 4; i++) {
+            string response;
+            if(!KyteaServer::writeMessage(fd, requests[i]) || !KyteaServer::readMessage(fd, response) ||
+               response.substr(0, strlen(responses[i])) != responses[i]) {
+                cout << "Bad response to request "<<i<<": "<<response<<endl;
+                ok = 0;
+            }
+        }
+        close(fd);
+        server.stop();
+        pthread_join(thread, NULL);
+        if(server.getNumRequests() != 4) {
+            cout << "Served "<<server.getNumRequests()<<" requests, expected 4"<<endl;
+            ok = 0;
+        }
+        return ok;
+    }
+
+    struct ClientThread {
+        const char * address;
+        int ok;
+    };
+
+    static void * clientThread(void * arg) {
+        ClientThread * ct = (ClientThread*)arg;
+        // each request holds several sentences, so the workers overlap
+        string request = "\n", exp = "OK\n";
+        for(int i = 0; i < 20; i++) {
+            request += "これは学習データです。\n";
+            exp += "これ/代名詞/これ は/助詞/は 学習/名詞/がくしゅう データ/名詞/でーた で/助動詞/で す/語尾/す 。/補助記号/。\n";
+        }
+        int fd = KyteaServer::connectSocket(ct->address);
+        for(int i = 0; i < 100 && ct->ok; i++) {
+            string response;
+            if(!KyteaServer::writeMessage(fd, request) || !KyteaServer::readMessage(fd, response) || response != exp)
+                ct->ok = 0;
+        }
+        close(fd);
+        return 0;
+    }
+
+    int testServerClients() {
+        // Several clients send requests at once, which are analyzed by
+        //  several workers sharing the model
+        ModelHandle handle;
+        handle.loadModel("/tmp/kytea-svm-model.bin");
+        KyteaServer server(handle, 4, 2, 1, 8);
+        // a socket file name without a directory is still a socket
+        server.listenSocket("kytea-test-clients.sock");
+        pthread_t thread;
+        pthread_create(&thread, NULL, serveThread, &server);
+        const int numClients = 8;
+        vector<pthread_t> clients(numClients);
+        vector<ClientThread> args(numClients);
+        for(int i = 0; i < numClients; i++) {
+            args[i].address = "kytea-test-clients.sock";
+            args[i].ok = 1;
+            pthread_create(&clients[i], NULL, clientThread, &args[i]);
+        }
+        int ok = 1;
+        for(int i = 0; i < numClients; i++) {
+            pthread_join(clients[i], NULL);
+            if(!args[i].ok) {
+                cout << "Bad response to client "<<i<<endl;
+                ok = 0;
+            }
+        }
+        server.stop();
+        pthread_join(thread, NULL);
+        if(server.getNumRequests() != numClients*100) {
+            cout << "Served "<<server.getNumRequests()<<" requests, expected "<<numClients*100<<endl;
+            ok = 0;
+        }
+        return ok;
+    }
+
+    int testCInterface() {
+        char error[256];
+        if(kytea_model_load("/tmp/no-such-model.bin", error, sizeof(error)) != NULL || strlen(error) == 0) {
+            cout << "Loading a missing model did not fail" << endl;
+            return 0;
+        }
+        kytea_model * model = kytea_model_load("/tmp/kytea-svm-model.bin", error, sizeof(error));
+        if(model == NULL) {
+            cout << "Could not load the model: " << error << endl;
+            return 0;
+        }
+        kytea_analyzer * analyzer = kytea_analyzer_new(model);
+        // Analyze two texts in one call
+        string first = "これは学習データです。", second = "大変です。";
+        const char * texts[2] = { first.c_str(), second.c_str() };
+        size_t lengths[2] = { first.length(), second.length() };
+        size_t wordEnds[20], numWords[2];
+        const int levels = kytea_model_num_tag_levels(model);
+        vector<int> tagIds(20*levels);
+        int ok = 1;
+        if(kytea_analyze_batch(analyzer, texts, lengths, 2, wordEnds, &tagIds[0], 20, numWords) != KYTEA_OK) {
+            cout << "Analysis failed: " << kytea_analyzer_error(analyzer) << endl;
+            ok = 0;
+        } else {
+            // Rebuild the analysis from the offsets and tag IDs
+            ostringstream oss;
+            for(size_t i = 0, w = 0; i < 2; i++) {
+                for(size_t j = 0, start = 0; j < numWords[i]; j++, w++) {
+                    oss << string(texts[i]+start, wordEnds[w]-start) << "/" << kytea_analyzer_tag_name(analyzer, 0, tagIds[w*levels]) << " ";
+                    start = wordEnds[w];
+                }
+            }
+            string exp = "これ/代名詞 は/助詞 学習/名詞 データ/名詞 で/助動詞 す/語尾 。/補助記号 大変/形状詞 で/助動詞 す/語尾 。/補助記号 ";
+            if(oss.str() != exp) {
+                cout << oss.str() << " != " << exp << endl;
+                ok = 0;
+            }
+        }
+        // Not enough space for the words
+        if(kytea_analyze_batch(analyzer, texts, lengths, 2, wordEnds, NULL, 3, numWords) != KYTEA_ERROR_SPACE) {
+            cout << "Too many words were not reported" << endl;
+            ok = 0;
+        }
+        kytea_analyzer_free(analyzer);
+        kytea_model_free(model);
+        return ok;
+    }
+
+    struct BatchThread {
+        kytea_analyzer * analyzer;
+        int ok;
+    };
+
+    static void * batchThread(void * arg) {
+        BatchThread * bt = (BatchThread*)arg;
+        string text = "これは学習データです。東京に行った。";
+        const char * texts[1] = { text.c_str() };
+        size_t lengths[1] = { text.length() };
+        size_t wordEnds[20], numWords[1];
+        int tagIds[20*3];
+        for(int i = 0; i < 300 && bt->ok; i++)
+            if(kytea_analyze_batch(bt->analyzer, texts, lengths, 1, wordEnds, tagIds, 20, numWords) != KYTEA_OK || numWords[0] != 13)
+                bt->ok = 0;
+        return 0;
+    }
+
+    int testCInterfaceThreads() {
+        // Several analyzers share one model, each on its own thread
+        char error[256];
+        kytea_model * model = kytea_model_load("/tmp/kytea-svm-model.bin", error, sizeof(error));
+        if(model == NULL) {
+            cout << "Could not load the model: " << error << endl;
+            return 0;
+        }
+        const int numThreads = 8;
+        vector<pthread_t> threads(numThreads);
+        vector<BatchThread> args(numThreads);
+        for(int i = 0; i < numThreads; i++) {
+            args[i].analyzer = kytea_analyzer_new(model);
+            args[i].ok = 1;
+            pthread_create(&threads[i], NULL, batchThread, &args[i]);
+        }
+        int ok = 1;
+        for(int i = 0; i < numThreads; i++) {
+            pthread_join(threads[i], NULL);
+            if(!args[i].ok) {
+                cout << "Analysis failed in thread "<<i<<endl;
+                ok = 0;
+            }
+            kytea_analyzer_free(args[i].analyzer);
+        }
+        kytea_model_free(model);
+        return ok;
+    }
+
+    int testOffsetOutput() {
+        // Read a raw sentence, which records the byte offsets
+        stringstream instr;
+        instr << "これは学習データです。" << endl;
+        RawCorpusIO io(util, instr, false);
+        KyteaSentence * sent = io.readSentence();
+        unsigned exp[7] = { 6, 9, 15, 24, 27, 30, 33 };
+        const char * tags[7] = { "代名詞", "助詞", "名詞", "名詞", "助動詞", "語尾", "補助記号" };
+        int ok = 1;
+        // Segmentation only, and then with the first tag level
+        for(int t = 0; t < 2; t++) {
+            KyteaOffsets offsets;
+            kytea->analyzeOffsets(*sent, vector<bool>(2, t == 1), offsets);
+            if(offsets.ends.size() != 7 || offsets.numLevels != 2) {
+                cout << "Found "<<offsets.ends.size()<<" words and "<<offsets.numLevels<<" levels"<<endl;
+                ok = 0;
+                continue;
+            }
+            for(int i = 0; i < 7; i++) {
+                int tagId = (t == 1 ? kytea->getTagId(0, util->mapString(tags[i])) : -1);
+                if(offsets.begins[i] != (i ? exp[i-1] : 0) || offsets.ends[i] != exp[i] || offsets.tagIds[i*2] != tagId) {
+                    cout << "Word "<<i<<": "<<offsets.begins[i]<<"-"<<offsets.ends[i]<<" tag "<<offsets.tagIds[i*2]<<" != "<<tagId<<endl;
+                    ok = 0;
+                }
+            }
+        }
+        // Write the offsets and tags from the command line format
+        stringstream outstr;
+        OffsetCorpusIO out(util, outstr, true);
+        kytea->analyzeSentence(*sent);
+        out.writeSentence(sent);
+        if(outstr.str().substr(0, 35) != "0-6/代名詞/これ 6-9/助詞/は") {
+            cout << outstr.str() << endl;
+            ok = 0;
+        }
+        delete sent;
+        return ok;
+    }
+
+    int testBoundaryOutput() {
+        stringstream instr;
+        instr << "これは学習データです。" << endl << "ワンピース・チョッパー" << endl << endl;
+        RawCorpusIO io(util, instr, false);
+        int ok = 1;
+        KyteaSentence * sent;
+        while((sent = io.readSentence()) != 0) {
+            // Writing from the boundaries should match writing the words
+            KyteaSentence copy(*sent);
+            stringstream expstr, actstr;
+            FullCorpusIO expout(util, expstr, true), actout(util, actstr, true);
+            expout.setUnkTag("/UNK");
+            actout.setUnkTag("/UNK");
+            kytea->analyzeSentence(*sent, vector<bool>(2, false));
+            expout.writeSentence(sent);
+            vector<char> unknown;
+            kytea->segmentSentence(copy, &unknown);
+            actout.writeBoundaries(&copy, kytea->getConfig()->getConfidence(), &unknown);
+            if(expstr.str() != actstr.str()) {
+                cout << expstr.str() << " != " << actstr.str() << endl;
+                ok = 0;
+            }
+            delete sent;
+        }
+        return ok;
+    }
+
+    int testReanalyzeSentence() {
+        string text = "これは学習データです。";
+        for(int i = 0; i < 3; i++) text += text;
+        KyteaSentence sent(util->mapString(text));
+        kytea->analyzeSentence(sent);
+        // Edits at the start, middle and end, and one that spans the sentence
+        const unsigned edits[7][2] = { { 0, 2 }, { 40, 0 }, { 30, 5 }, { 20, 1 }, { 50, 3 }, { 82, 5 }, { 1, 80 } };
+        const char * inserted[7] = { "それ", "ワンピース", "", "が", "学習", "です", "は" };
+        int ok = 1;
+        for(int e = 0; e < 7; e++) {
+            KyteaString ins = util->mapString(inserted[e]);
+            KyteaString chars = sent.chars.substr(0, edits[e][0]) + ins + sent.chars.substr(edits[e][0]+edits[e][1]);
+            kytea->reanalyzeSentence(sent, edits[e][0], edits[e][1], ins);
+            // The result should be the same as analyzing from scratch
+            KyteaSentence exp(chars);
+            kytea->analyzeSentence(exp);
+            if(!(sent.chars == exp.chars) || sent.words.size() != exp.words.size() || sent.wsConfs.size() != exp.wsConfs.size()) {
+                cout << "Edit "<<e<<": "<<util->showString(sent.chars)<<" ("<<sent.words.size()<<" words) != "<<util->showString(exp.chars)<<" ("<<exp.words.size()<<" words)"<<endl;
+                ok = 0;
+                continue;
+            }
+            for(unsigned i = 0; i < exp.wsConfs.size(); i++) {
+                if(abs(sent.wsConfs[i] - exp.wsConfs[i]) > 1e-6) {
+                    cout << "Edit "<<e<<" boundary "<<i<<": "<<sent.wsConfs[i]<<" != "<<exp.wsConfs[i]<<endl;
+                    ok = 0;
+                }
+            }
+            for(unsigned i = 0; i < exp.words.size(); i++) {
+                const KyteaWord & w = sent.words[i], & x = exp.words[i];
+                bool same = (w.surf == x.surf && w.getUnknown() == x.getUnknown() && w.getNumTags() == x.getNumTags());
+                for(int j = 0; same && j < x.getNumTags(); j++)
+                    same = (w.hasTag(j) == x.hasTag(j) && (!x.hasTag(j) || w.getTagSurf(j) == x.getTagSurf(j)));
+                if(!same) {
+                    cout << "Edit "<<e<<" word "<<i<<": "<<util->showString(w.surf)<<" != "<<util->showString(x.surf)<<endl;
+                    ok = 0;
+                }
+            }
+        }
+        return ok;
+    }
+
+    int testReanalyzeOverlay() {
+        // Reanalyze a sentence after a word was added to the overlay
+        ofstream ofs("/tmp/kytea-reanalyze-dict.txt");
+        ofs << "東京/名詞/とうきょう" << endl; ofs.close();
+        Kytea kyteaOverlay;
+        kyteaOverlay.readModel("/tmp/kytea-svm-model.bin");
+        StringUtil * utilOverlay = kyteaOverlay.getStringUtil();
+        string text = "東京に行った。";
+        for(int i = 0; i < 4; i++) text += "これは学習データです。";
+        KyteaSentence sent(utilOverlay->mapString(text));
+        kyteaOverlay.analyzeSentence(sent);
+        kyteaOverlay.loadOverlayDictionary("/tmp/kytea-reanalyze-dict.txt", 0);
+        // The edit is far from the new word, which must still be found
+        kyteaOverlay.reanalyzeSentence(sent, 30, 1, utilOverlay->mapString("が"));
+        if(sent.words.size() == 0 || sent.words[0].surf != utilOverlay->mapString("東京") || sent.words[0].getUnknown() ||
+           sent.words[0].getTagSurf(1) != utilOverlay->mapString("とうきょう")) {
+            cout << "The overlay was not used for the reanalysis" << endl;
+            return 0;
+        }
+        return 1;
+    }
+
+    int testAnalyzeStream() {
+        string line = "これは学習データです。ワンピース・チョッパー";
+        for(int i = 0; i < 4; i++) line += line;
+        string text = line + "\n\nこれは学習データです。\n" + line + "\n";
+        // Analyze whole lines
+        stringstream rawstr(text), expstr;
+        RawCorpusIO rawin(util, rawstr, false);
+        FullCorpusIO expout(util, expstr, true);
+        expout.setUnkTag("/UNK");
+        KyteaSentence * sent;
+        while((sent = rawin.readSentence()) != 0) {
+            kytea->analyzeSentence(*sent);
+            expout.writeSentence(sent);
+            delete sent;
+        }
+        // Reading a few bytes at a time should give the same result, even
+        //  when characters are split between parts
+        int ok = 1;
+        const unsigned chunks[3] = { 1, 7, 100 };
+        for(int i = 0; i < 3; i++) {
+            stringstream instr(text), actstr;
+            RawCorpusIO in(util, instr, false);
+            FullCorpusIO actout(util, actstr, true);
+            actout.setUnkTag("/UNK");
+            kytea->analyzeStream(in, actout, chunks[i]);
+            if(expstr.str() != actstr.str()) {
+                cout << "Chunk "<<chunks[i]<<": "<<actstr.str()<<" != "<<expstr.str()<<endl;
+                ok = 0;
+            }
+        }
+        // With a confidence that no boundary passes, nothing is decided until
+        //  the end of the line, and each line is a single word
+        KyteaConfig * configSure = new KyteaConfig;
+        configSure->setDebug(0);
+        configSure->setOnTraining(false);
+        configSure->setConfidence(50);
+        Kytea kyteaSure(configSure);
+        kyteaSure.readModel("/tmp/kytea-svm-model.bin");
+        StringUtil * utilSure = kyteaSure.getStringUtil();
+        stringstream surestr(text), sureexp;
+        RawCorpusIO surein(utilSure, surestr, false);
+        FullCorpusIO sureout(utilSure, sureexp, true);
+        while((sent = surein.readSentence()) != 0) {
+            kyteaSure.analyzeSentence(*sent);
+            sureout.writeSentence(sent);
+            delete sent;
+        }
+        for(int i = 0; i < 2; i++) {
+            stringstream instr(text), actstr;
+            RawCorpusIO in(utilSure, instr, false);
+            FullCorpusIO actout(utilSure, actstr, true);
+            kyteaSure.analyzeStream(in, actout, chunks[i]);
+            const string act = actstr.str();
+            if(sureexp.str() != act || count(act.begin(), act.end(), ' ') != 0) {
+                cout << "Chunk "<<chunks[i]<<" with no boundaries: "<<act<<" != "<<sureexp.str()<<endl;
+                ok = 0;
+            }
+        }
+        return ok;
+    }
+
+    int testStats() {
+        KyteaStats::reset();
+        KyteaSentence sent(util->mapString("これは学習データです。"));
+        kytea->analyzeSentence(sent);
+        // Statistics are only counted if they were enabled when configuring
+        stringstream out;
+        KyteaStats::write(out);
+        string exp = (KyteaStats::isEnabled() ?
+                      "sentences\t1\nchars\t11\nwords\t7\n" :
+                      "sentences\t0\nchars\t0\nwords\t0\n");
+        if(out.str().substr(0, exp.length()) != exp) {
+            cout << out.str() << " != " << exp << endl;
+            return 0;
+        }
+        return 1;
+    }
+
+    int testPruneFeatures() {
+        // Read the SVM model and remove the less important half of the features
+        Kytea kyteaPrune;
+        kyteaPrune.readModel("/tmp/kytea-svm-model.bin");
+        vector<double> weights, left;
+        kyteaPrune.getFeatureWeights(weights);
+        sort(weights.begin(), weights.end());
+        double cutoff = weights[weights.size()/2];
+        unsigned removed = kyteaPrune.pruneFeatures(cutoff);
+        kyteaPrune.getFeatureWeights(left);
+        if(removed == 0 || left.size() != weights.size()-removed) {
+            cout << "removed="<<removed<<", weights="<<weights.size()<<", left="<<left.size()<<endl;
+            return 0;
+        }
+        for(unsigned i = 0; i < left.size(); i++) {
+            if(left[i] <= cutoff) {
+                cout << "Weight "<<left[i]<<" is not above the cutoff "<<cutoff<<endl;
+                return 0;
+            }
+        }
+        // The pruned model should be written and read back as-is
+        kyteaPrune.writeModel("/tmp/kytea-pruned-model.bin");
+        Kytea actKytea;
+        actKytea.readModel("/tmp/kytea-pruned-model.bin");
+        vector<double> act;
+        actKytea.getFeatureWeights(act);
+        sort(left.begin(), left.end());
+        sort(act.begin(), act.end());
+        return checkVector(left, act);
+    }
+
     bool runTest() {
         int done = 0, succeeded = 0;
         done++; cout << "testWordSegmentationSVM()" << endl; if(testWordSegmentationSVM()) succeeded++; else cout << "FAILED!!!" << endl;
@@ -315,7 +1153,28 @@ public:
         done++; cout << "testPartialSegmentation()" << endl; if(testPartialSegmentation()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testTextIO()" << endl; if(testTextIO()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testBinaryIO()" << endl; if(testBinaryIO()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testQuantizedRoundTrip()" << endl; if(testQuantizedRoundTrip()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testConfidentInput()" << endl; if(testConfidentInput()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testWarmStart()" << endl; if(testWarmStart()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testPruneFeatures()" << endl; if(testPruneFeatures()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testDictionaryMatchReuse()" << endl; if(testDictionaryMatchReuse()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testOverlayDictionary()" << endl; if(testOverlayDictionary()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testModelHandle()" << endl; if(testModelHandle()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testModelHandleThreads()" << endl; if(testModelHandleThreads()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testServer()" << endl; if(testServer()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testServerClients()" << endl; if(testServerClients()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testCInterface()" << endl; if(testCInterface()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testCInterfaceThreads()" << endl; if(testCInterfaceThreads()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testOffsetOutput()" << endl; if(testOffsetOutput()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testBoundaryOutput()" << endl; if(testBoundaryOutput()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testReanalyzeSentence()" << endl; if(testReanalyzeSentence()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testReanalyzeOverlay()" << endl; if(testReanalyzeOverlay()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testAnalyzeStream()" << endl; if(testAnalyzeStream()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testStats()" << endl; if(testStats()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testSentenceCache()" << endl; if(testSentenceCache()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testOnlineTraining()" << endl; if(testOnlineTraining()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testShardTraining()" << endl; if(testShardTraining()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testPipeTraining()" << endl; if(testPipeTraining()) succeeded++; else cout << "FAILED!!!" << endl;
         cout << "#### TestAnalysis Finished with "<<succeeded<<"/"<<done<<" tests succeeding ####"<<endl;
         return done == succeeded;
     }
@@ -1,6 +1,9 @@
 #ifndef TEST_KYTEA__
 #define TEST_KYTEA__
 
+#include <kytea/model-io.h>
+#include <limits>
+
 using namespace std;
 
 namespace kytea {
@@ -264,6 +267,25 @@ public:
         return ret;
     }
 
+    int testEntryWeights() {
+        StringUtilUtf8 util;
+        // the smallest value has no negative of the same type
+        const FeatVal low = (numeric_limits<FeatVal>::is_integer ? numeric_limits<FeatVal>::min() : -numeric_limits<FeatVal>::max());
+        Dictionary<FeatVec>::WordMap wm;
+        wm[util.mapString("A")] = new FeatVec(2, low);
+        Dictionary<FeatVec> * dict = new Dictionary<FeatVec>(&util);
+        dict->buildIndex(wm);
+        FeatureLookup look;
+        look.setSelfDict(dict);
+        vector<double> weights;
+        look.getEntryWeights(weights);
+        if(weights.size() != 1 || weights[0] != -(double)low) {
+            cerr << "Entry weight "<<(weights.size() ? weights[0] : 0)<<" != "<<-(double)low<<endl;
+            return 0;
+        }
+        return 1;
+    }
+
     void makePrefixes(vector<KyteaString> & charPrefixes, vector<KyteaString> & typePrefixes, StringUtil * util) {
         charPrefixes.resize(0);
         for(int i = 1; i <= 2*3; i++) {
@@ -446,6 +468,221 @@ public:
         return ret;
     }
 
+    int testDenseDictionary() {
+        StringUtilUtf8 util;
+        Kytea kytea;
+        // Give the root more gotos than the threshold for a dense table
+        Dictionary<ModelTagEntry>::WordMap dictMap;
+        vector<KyteaString> words;
+        for(int i = 0; i <= DICTIONARY_DENSE_GOTOS; i++) {
+            KyteaString word(1+i%2);
+            word[0] = 100+i*7;
+            if(i%2) word[1] = 100;
+            words.push_back(word);
+            kytea.addTag<ModelTagEntry>(dictMap, word, 0, NULL, 0);
+        }
+        Dictionary<ModelTagEntry> dict(&util);
+        dict.buildIndex(dictMap);
+        if(dict.getNumDenseStates() != 1) {
+            cerr << "Number of dense states "<<dict.getNumDenseStates()<<" != 1"<<endl;
+            return 0;
+        }
+        // All words must be found, both directly and by matching
+        int ret = 1;
+        KyteaString all;
+        for(int i = 0; i < (int)words.size(); i++) {
+            const ModelTagEntry * ent = dict.findEntry(words[i]);
+            if(ent == 0 || ent->word != words[i]) {
+                cerr << "Could not find word "<<i<<endl;
+                ret = 0;
+            }
+            all = all + words[i];
+        }
+        KyteaString unk(1); unk[0] = 101;
+        if(dict.findEntry(unk) != 0) {
+            cerr << "Found a word that is not in the dictionary"<<endl;
+            ret = 0;
+        }
+        // every word is found, and the last character of each two-character
+        // word is also found as the first word
+        unsigned expMatches = words.size() + words.size()/2;
+        Dictionary<ModelTagEntry>::MatchResult matches = dict.match(all);
+        if(matches.size() != expMatches) {
+            cerr << "matches.size() "<<matches.size()<<" != "<<expMatches<<endl;
+            ret = 0;
+        }
+        return ret;
+    }
+
+    int testDenseDictionaryIO() {
+        StringUtilUtf8 util;
+        Kytea kytea;
+        // Make both the root and the state after its first character dense
+        // The characters must be known to util to be written as text
+        Dictionary<ModelTagEntry>::WordMap dictMap;
+        KyteaString all;
+        for(int i = 0; i <= DICTIONARY_DENSE_GOTOS; i++) {
+            const int code = 0x4E00+i*7;
+            char buff[4] = { (char)(0xE0 | (code >> 12)), (char)(0x80 | ((code >> 6) & 0x3F)), (char)(0x80 | (code & 0x3F)), 0 };
+            KyteaString first(1), second(2);
+            first[0] = util.mapChar(buff);
+            second[0] = util.mapChar("あ"); second[1] = first[0];
+            kytea.addTag<ModelTagEntry>(dictMap, first, 0, NULL, 0);
+            kytea.addTag<ModelTagEntry>(dictMap, second, 0, NULL, 0);
+            all = all + first + second;
+        }
+        Dictionary<ModelTagEntry> dict(&util);
+        dict.buildIndex(dictMap);
+        if(dict.getNumDenseStates() != 2) {
+            cerr << "Number of dense states "<<dict.getNumDenseStates()<<" != 2"<<endl;
+            return 0;
+        }
+        Dictionary<ModelTagEntry>::MatchResult expMatches = dict.match(all);
+        // Write the dictionary as text and binary, and read it back
+        int ret = 1;
+        for(int binary = 0; binary < 2; binary++) {
+            stringstream str;
+            ModelIO * out = (binary ? (ModelIO*)new BinaryModelIO(&util, str, true) : (ModelIO*)new TextModelIO(&util, str, true));
+            out->writeModelDictionary(&dict);
+            delete out;
+            ModelIO * in = (binary ? (ModelIO*)new BinaryModelIO(&util, str, false) : (ModelIO*)new TextModelIO(&util, str, false));
+            Dictionary<ModelTagEntry> * act = in->readModelDictionary();
+            delete in;
+            dict.checkEqual(*act);
+            // The matches must be the same entries in the same places
+            Dictionary<ModelTagEntry>::MatchResult actMatches = act->match(all);
+            if(actMatches.size() != expMatches.size()) {
+                cerr << "matches.size() "<<actMatches.size()<<" != "<<expMatches.size()<<" (binary="<<binary<<")"<<endl;
+                ret = 0;
+            }
+            for(unsigned i = 0; ret && i < actMatches.size(); i++) {
+                if(actMatches[i].first != expMatches[i].first || actMatches[i].second->word != expMatches[i].second->word) {
+                    cerr << "Match "<<i<<" differs (binary="<<binary<<")"<<endl;
+                    ret = 0;
+                }
+            }
+            delete act;
+        }
+        // a binary dictionary with more states than the file holds must be
+        // rejected before they are allocated
+        stringstream cut;
+        const uint32_t numStates = 1 << 20;
+        cut.put(1);
+        cut.write(reinterpret_cast<const char *>(&numStates), sizeof(numStates));
+        BinaryModelIO in(&util, cut, false);
+        try {
+            delete in.readModelDictionary();
+            cerr << "A truncated dictionary was accepted"<<endl;
+            ret = 0;
+        } catch (std::exception & e) {
+            if(string(e.what()).find("larger than the rest of the file") == string::npos) {
+                cerr << "Unexpected error for a truncated dictionary: "<<e.what()<<endl;
+                ret = 0;
+            }
+        }
+        return ret;
+    }
+
+    int testDictionaryWordArray() {
+        StringUtilUtf8 util;
+        const char * words[] = { "ab", "abc", "b", "bc", "c", "cab" };
+        Dictionary<ModelTagEntry>::WordArray input;
+        for(int i = 0; i < 6; i++) {
+            KyteaString word = util.mapString(words[i]);
+            input.push_back(make_pair(word, new ModelTagEntry(word)));
+        }
+        Dictionary<ModelTagEntry> dict(&util);
+        dict.buildIndex(input);
+        // the suffixes of each word are found through the output links
+        Dictionary<ModelTagEntry>::MatchResult matches = dict.match(util.mapString("abcab"));
+        const char * exp[] = { "ab", "b", "abc", "bc", "c", "cab", "ab", "b" };
+        unsigned expPos[] = { 1, 1, 2, 2, 2, 4, 4, 4 };
+        int ret = 1;
+        if(matches.size() != 8) {
+            cerr << "matches.size() "<<matches.size()<<" != 8"<<endl;
+            return 0;
+        }
+        for(int i = 0; i < 8; i++) {
+            if(matches[i].first != expPos[i] || matches[i].second->word != util.mapString(exp[i])) {
+                cerr << "Match "<<i<<" is "<<util.showString(matches[i].second->word)<<"@"<<matches[i].first
+                     << ", expected "<<exp[i]<<"@"<<expPos[i]<<endl;
+                ret = 0;
+            }
+        }
+        // unsorted input must be rejected
+        Dictionary<ModelTagEntry>::WordArray unsorted(input.rbegin(), input.rend());
+        Dictionary<ModelTagEntry> bad(&util);
+        try {
+            bad.buildIndex(unsorted);
+            cerr << "Unsorted words were accepted"<<endl;
+            ret = 0;
+        } catch (std::exception & e) { }
+        return ret;
+    }
+
+    int testTagCache() {
+        StringUtilUtf8 util;
+        KyteaString a = util.mapString("あ"), b = util.mapString("い"), c = util.mapString("う");
+        vector<KyteaTag> tags(1, KyteaTag(util.mapString("a"), 1.0)), act;
+        TagCache cache(2);
+        cache.add(a, 0, tags);
+        cache.add(b, 0, tags);
+        int ret = 1;
+        // the tag level is part of the key
+        if(cache.find(a, 1, act)) {
+            cout << "testTagCache::Found a word at the wrong level" << endl;
+            ret = 0;
+        }
+        // using a makes b the least recently used, so it is dropped for c
+        if(!cache.find(a, 0, act) || act != tags) {
+            cout << "testTagCache::Could not find the tags for a" << endl;
+            ret = 0;
+        }
+        cache.add(c, 0, tags);
+        if(cache.find(b, 0, act) || !cache.find(c, 0, act) || !cache.find(a, 0, act)) {
+            cout << "testTagCache::The wrong entry was dropped" << endl;
+            ret = 0;
+        }
+        if(cache.getHits() != 3 || cache.getMisses() != 2) {
+            cout << "testTagCache::hits="<<cache.getHits()<<", misses="<<cache.getMisses()<<endl;
+            ret = 0;
+        }
+        return ret;
+    }
+
+    int testLruCache() {
+        StringUtilUtf8 util;
+        KyteaString a = util.mapString("あ"), b = util.mapString("い"), c = util.mapString("う");
+        vector<KyteaTag> tags(1, KyteaTag(util.mapString("a"), 1.0)), act;
+        LruCache< vector<KyteaTag> > cache(2);
+        cache.add(a, tags);
+        cache.add(b, tags);
+        int ret = 1;
+        // using a makes b the least recently used, so it is dropped for c
+        if(!cache.find(a, act) || act != tags) {
+            cout << "testLruCache::Could not find the tags for a" << endl;
+            ret = 0;
+        }
+        cache.add(c, tags);
+        if(cache.find(b, act) || !cache.find(c, act) || !cache.find(a, act)) {
+            cout << "testLruCache::The wrong entry was dropped" << endl;
+            ret = 0;
+        }
+        if(cache.getHits() != 3 || cache.getMisses() != 1) {
+            cout << "testLruCache::hits="<<cache.getHits()<<", misses="<<cache.getMisses()<<endl;
+            ret = 0;
+        }
+        // with a limit on memory, only the last entry fits
+        LruCache< vector<KyteaTag> > small(100, cache.getBytes()/2);
+        small.add(a, tags);
+        small.add(b, tags);
+        if(small.size() != 1 || !small.find(b, act)) {
+            cout << "testLruCache::size="<<small.size()<<" with a memory limit"<<endl;
+            ret = 0;
+        }
+        return ret;
+    }
+
     bool runTest() {
         int done = 0, succeeded = 0;
         done++; cout << "testGetTypeString()" << endl; if(testGetTypeString()) succeeded++; else cout << "FAILED!!!" << endl;
@@ -455,9 +692,15 @@ public:
         done++; cout << "testTagDictFeatures()" << endl; if(testTagDictFeatures()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testModelToLookup()" << endl; if(testModelToLookup()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testFeatureLookup()" << endl; if(testFeatureLookup()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testEntryWeights()" << endl; if(testEntryWeights()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testWSLookupMatchesModel()" << endl; if(testWSLookupMatchesModel()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testTagLookupMatchesModel()" << endl; if(testTagLookupMatchesModel()) succeeded++; else cout << "FAILED!!!" << endl;
         done++; cout << "testFeatureLookupDictionary()" << endl; if(testFeatureLookupDictionary()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testDenseDictionary()" << endl; if(testDenseDictionary()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testDenseDictionaryIO()" << endl; if(testDenseDictionaryIO()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testDictionaryWordArray()" << endl; if(testDictionaryWordArray()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testTagCache()" << endl; if(testTagCache()) succeeded++; else cout << "FAILED!!!" << endl;
+        done++; cout << "testLruCache()" << endl; if(testLruCache()) succeeded++; else cout << "FAILED!!!" << endl;
         cout << "#### TestKytea Finished with "<<succeeded<<"/"<<done<<" tests succeeding ####"<<endl;
         return (done == succeeded);
     }